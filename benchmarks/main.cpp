@@ -0,0 +1,578 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// C
+#include <arpa/inet.h>
+#include <libgen.h> // basename
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Standard
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <prometheus/counter.h>
+#include <prometheus/registry.h>
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/Exposer.hpp>
+#include <ert/metrics/Metrics.hpp>
+#include <ert/metrics/Timer.hpp>
+
+const char* progname;
+
+
+////////////////////////////
+// Allocations accounting //
+////////////////////////////
+
+// Per-thread counter (no contention added to the measured code), and process-wide counter enabled only
+// when allocations happen out of the measuring threads (scrapes are served by exposer threads):
+thread_local std::uint64_t t_allocations = 0;
+std::atomic<bool> G_processWide{false};
+std::atomic<std::uint64_t> G_allocations{0};
+
+// Global operators are replaced (every allocation path, including over-aligned types). GCC warns about
+// 'free()' on memory from 'operator new' (-Wmismatched-new-delete), disabled for this target because both
+// sides are replaced here.
+static inline void countAllocation()
+{
+    t_allocations++;
+    if (G_processWide.load(std::memory_order_relaxed)) G_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size)
+{
+    countAllocation();
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    countAllocation();
+    // 'aligned_alloc()' requires a size multiple of the alignment:
+    std::size_t align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = ((size ? size : 1) + align - 1) / align * align;
+    if (void *p = std::aligned_alloc(align, rounded)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+
+/////////////
+// Harness //
+/////////////
+
+struct Result {
+    std::string name;
+    std::string parameter; // i.e. 'buckets=32'
+    unsigned threads{};
+    std::uint64_t operations{};
+    double seconds{};
+    std::uint64_t allocations{};
+    std::uint64_t bytes{}; // payload (scrapes)
+
+    double nsPerOp() const {
+        // Wall time per operation on each thread:
+        return operations ? seconds * 1e9 * threads / operations : 0;
+    }
+    double opsPerSecond() const {
+        return seconds > 0 ? operations / seconds : 0;
+    }
+    double allocationsPerOp() const {
+        return operations ? double(allocations) / operations : 0;
+    }
+};
+
+std::vector<Result> G_results;
+
+/**
+ * Run 'body(thread, iteration)' on 'threads' threads, 'iterations' times on each one.
+ * Threads are released together and wall time is measured until the last one finishes.
+ */
+template <typename Body>
+Result run(const std::string &name, const std::string &parameter, unsigned threads, std::uint64_t iterations, Body body)
+{
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> start{false};
+    std::vector<std::uint64_t> allocations(threads, 0);
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while (!start.load(std::memory_order_acquire)) std::this_thread::yield();
+
+            std::uint64_t before = t_allocations;
+            for (std::uint64_t i = 0; i < iterations; i++) body(t, i);
+            allocations[t] = t_allocations - before;
+        });
+    }
+
+    while (ready.load() != threads) std::this_thread::yield();
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto &worker: workers) worker.join();
+    auto end = std::chrono::steady_clock::now();
+
+    Result result;
+    result.name = name;
+    result.parameter = parameter;
+    result.threads = threads;
+    result.operations = iterations * threads;
+    result.seconds = std::chrono::duration<double>(end - begin).count();
+    for (auto a: allocations) result.allocations += a;
+    return result;
+}
+
+void report(const Result &result)
+{
+    G_results.push_back(result);
+
+    std::cout << result.name;
+    if (!result.parameter.empty()) std::cout << " [" << result.parameter << "]";
+    std::cout << " threads=" << result.threads << ": " << result.nsPerOp() << " ns/op, " << result.opsPerSecond() << " ops/s, "
+              << result.allocationsPerOp() << " allocs/op";
+    if (result.bytes) std::cout << ", " << result.bytes << " bytes";
+    std::cout << std::endl;
+}
+
+std::string toJson()
+{
+    std::ostringstream json;
+    json << "{\n  \"context\": {\"hardware_concurrency\": " << std::thread::hardware_concurrency() << "},\n  \"benchmarks\": [";
+    for (std::size_t k = 0; k < G_results.size(); k++) {
+        const Result &r = G_results[k];
+        json << (k ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"parameter\": \"" << r.parameter << "\", \"threads\": " << r.threads
+             << ", \"operations\": " << r.operations << ", \"seconds\": " << r.seconds << ", \"ns_per_op\": " << r.nsPerOp()
+             << ", \"ops_per_second\": " << r.opsPerSecond() << ", \"allocations_per_op\": " << r.allocationsPerOp()
+             << ", \"bytes\": " << r.bytes << "}";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+
+////////////////
+// Benchmarks //
+////////////////
+
+// Counter update: string-based API (family and series lookups, with labels map or label set) versus pre-resolved series
+void counters(const std::vector<unsigned> &threads, std::uint64_t iterations)
+{
+    ert::metrics::Metrics metrics;
+    ert::metrics::counter_family_t &family = metrics.addCounterFamily("bench_counter_total", "Benchmark counter");
+    const std::string name = "bench_counter_total";
+    const ert::metrics::labels_t labels = {{"method", "POST"}, {"status_code", "200"}, {"uri", "/the/uri"}};
+    const ert::metrics::LabelSet staticLabels = {{"method", "POST"}, {"uri", "/the/uri"}};
+    ert::metrics::counter_t *counter = &family.Add(labels);
+
+    for (unsigned t: threads) {
+        report(run("increaseCounter", "labels_t", t, iterations, [&](unsigned, std::uint64_t) {
+            metrics.increaseCounter(name, labels);
+        }));
+        report(run("increaseCounter", "LabelSet", t, iterations, [&](unsigned, std::uint64_t) {
+            metrics.increaseCounter(name, staticLabels.with("status_code", "200"));
+        }));
+        report(run("counter_t", "", t, iterations, [&](unsigned, std::uint64_t) {
+            counter->Increment();
+        }));
+    }
+}
+
+// Histogram observation with growing bucket counts (prometheus histogram and layout histogram)
+void histograms(const std::vector<unsigned> &threads, std::uint64_t iterations)
+{
+    ert::metrics::Metrics metrics;
+    const ert::metrics::labels_t labels = {{"method", "POST"}};
+
+    // Precomputed observed values (no random generation within the measure):
+    std::vector<double> values(4096);
+    for (std::size_t k = 0; k < values.size(); k++) values[k] = double((k * 2654435761u) % 10000) / 10000.0;
+
+    for (std::size_t buckets: {8, 32, 128, 512}) {
+        ert::metrics::bucket_boundaries_t boundaries;
+        for (std::size_t k = 1; k <= buckets; k++) boundaries.push_back(double(k) / buckets);
+
+        std::string name = "bench_histogram_" + std::to_string(buckets);
+        ert::metrics::histogram_family_t &family = metrics.addHistogramFamily(name, "Benchmark histogram");
+        ert::metrics::histogram_t *histogram = &family.Add(labels, boundaries);
+        std::string parameter = "buckets=" + std::to_string(buckets);
+
+        ert::metrics::bucket_layout_t layout = metrics.registerBucketLayout(name, boundaries);
+        ert::metrics::layout_histogram_t *layoutHistogram = &metrics.addLayoutHistogramFamily(name + "_layout", "Benchmark layout histogram", layout).Add(labels);
+        std::string layoutParameter = parameter + ",kernel=" + layout->kernel();
+
+        for (unsigned t: threads) {
+            report(run("observeHistogram", parameter, t, iterations, [&](unsigned, std::uint64_t i) {
+                metrics.observeHistogram(name, labels, values[i & 4095], boundaries);
+            }));
+            report(run("histogram_t", parameter, t, iterations, [&](unsigned, std::uint64_t i) {
+                histogram->Observe(values[i & 4095]);
+            }));
+            report(run("layout_histogram_t", layoutParameter, t, iterations, [&](unsigned, std::uint64_t i) {
+                layoutHistogram->Observe(values[i & 4095]);
+            }));
+        }
+    }
+}
+
+// Latency measurement: steady clock reads plus observation versus timers (calibrated clock, sampling)
+void timers(const std::vector<unsigned> &threads, std::uint64_t iterations)
+{
+    ert::metrics::Metrics metrics;
+    ert::metrics::bucket_boundaries_t boundaries = {1e-7, 1e-6, 1e-5, 1e-4, 1e-3};
+    metrics.addHistogramFamily("bench_timer_seconds", "Benchmark timer");
+    ert::metrics::HistogramHandle handle = metrics.histogramHandle("bench_timer_seconds", {}, boundaries);
+    ert::metrics::histogram_t *histogram = handle.get();
+    std::string clock = (ert::metrics::TimerClock::source() == ert::metrics::TimerClock::Source::Tsc) ? "tsc" : "coarse";
+
+    for (unsigned t: threads) {
+        report(run("steady_clock", "", t, iterations, [&](unsigned, std::uint64_t) {
+            auto begin = std::chrono::steady_clock::now();
+            histogram->Observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        }));
+        for (std::uint32_t sampling: {1, 16}) {
+            report(run("ScopedTimer", "clock=" + clock + ",sampling=" + std::to_string(sampling), t, iterations, [&](unsigned, std::uint64_t) {
+                ert::metrics::ScopedTimer timer(handle, sampling);
+            }));
+        }
+    }
+}
+
+// Series creation (dynamic labels) with growing cardinality: every operation adds a new series
+void familyAdd(const std::vector<unsigned> &threads)
+{
+    for (std::uint64_t cardinality: {1000, 10000, 100000}) {
+        std::string parameter = "cardinality=" + std::to_string(cardinality);
+
+        for (unsigned t: threads) {
+            ert::metrics::Metrics metrics;
+            ert::metrics::counter_family_t &family = metrics.addCounterFamily("bench_dynamic_total", "Benchmark dynamic series");
+
+            // Label sets built in advance, disjoint between threads:
+            std::uint64_t perThread = std::max<std::uint64_t>(cardinality / t, 1);
+            std::vector<ert::metrics::labels_t> labels(perThread * t);
+            for (std::size_t k = 0; k < labels.size(); k++) labels[k] = {{"id", std::to_string(k)}};
+
+            report(run("Family::Add", parameter, t, perThread, [&](unsigned thread, std::uint64_t i) {
+                family.Add(labels[thread * perThread + i]);
+            }));
+        }
+    }
+}
+
+// Series storage with 100k series: heap (prometheus counters) against compact counters in packed and padded
+// slabs. Consecutive threads update neighbour series (false sharing shows up on packed storage), and family
+// collections measure the scrape walk over every series.
+void storage(const std::vector<unsigned> &threads, std::uint64_t iterations)
+{
+    const std::size_t series = 100000;
+    ert::metrics::Metrics metrics;
+
+    ert::metrics::counter_family_t &heapFamily = metrics.addCounterFamily("bench_heap_total", "Benchmark heap series");
+    ert::metrics::compact_counter_family_t &packedFamily = metrics.addCompactCounterFamily("bench_packed_total", "Benchmark packed series", {}, ert::metrics::series_storage_t::Packed);
+    ert::metrics::compact_counter_family_t &paddedFamily = metrics.addCompactCounterFamily("bench_padded_total", "Benchmark padded series", {}, ert::metrics::series_storage_t::Padded);
+
+    std::vector<ert::metrics::counter_t*> heap;
+    std::vector<ert::metrics::compact_counter_t*> packed, padded;
+    for (std::size_t k = 0; k < series; k++) {
+        ert::metrics::labels_t labels = {{"id", std::to_string(k)}};
+        heap.push_back(&heapFamily.Add(labels));
+        packed.push_back(&packedFamily.Add(labels));
+        padded.push_back(&paddedFamily.Add(labels));
+    }
+
+    std::string parameter = "series=" + std::to_string(series);
+    for (unsigned t: threads) {
+        report(run("heap_update", parameter, t, iterations, [&](unsigned thread, std::uint64_t i) {
+            heap[(i * t + thread) % series]->Increment();
+        }));
+        report(run("packed_update", parameter, t, iterations, [&](unsigned thread, std::uint64_t i) {
+            packed[(i * t + thread) % series]->Increment();
+        }));
+        report(run("padded_update", parameter, t, iterations, [&](unsigned thread, std::uint64_t i) {
+            padded[(i * t + thread) % series]->Increment();
+        }));
+    }
+
+    const std::uint64_t collections = 20;
+    report(run("heap_collect", parameter, 1, collections, [&](unsigned, std::uint64_t) {
+        heapFamily.Collect();
+    }));
+    report(run("packed_collect", parameter, 1, collections, [&](unsigned, std::uint64_t) {
+        packedFamily.Collect();
+    }));
+    report(run("padded_collect", parameter, 1, collections, [&](unsigned, std::uint64_t) {
+        paddedFamily.Collect();
+    }));
+}
+
+// Minimal HTTP/1.1 client (keep-alive) returning the body size
+class ScrapeClient {
+    int fd_{-1};
+    std::string buffer_;
+    std::string request_;
+
+public:
+    explicit ScrapeClient(int port, const std::string &headers = "") {
+        request_ = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n";
+        fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd_, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    ~ScrapeClient() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool connected() const {
+        return fd_ >= 0;
+    }
+
+    std::size_t scrape() {
+        if (::send(fd_, request_.data(), request_.size(), MSG_NOSIGNAL) != (ssize_t)request_.size()) return 0;
+
+        buffer_.clear();
+        std::size_t headerEnd = std::string::npos, contentLength = 0;
+        char chunk[65536];
+        while (true) {
+            ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (n <= 0) return 0;
+            buffer_.append(chunk, n);
+
+            if (headerEnd == std::string::npos) {
+                headerEnd = buffer_.find("\r\n\r\n");
+                if (headerEnd == std::string::npos) continue;
+                auto pos = buffer_.find("Content-Length: ");
+                if (pos == std::string::npos || pos > headerEnd) return 0;
+                contentLength = std::strtoull(buffer_.c_str() + pos + 16, nullptr, 10);
+            }
+            if (buffer_.size() >= headerEnd + 4 + contentLength) return contentLength;
+        }
+    }
+};
+
+// Scrape latency (end to end, loopback) and payload size with growing number of series
+void scrapes(std::uint64_t iterations)
+{
+    for (std::size_t series: {1000, 10000, 100000}) {
+        auto registry = std::make_shared<prometheus::Registry>();
+        auto &family = prometheus::BuildCounter().Name("bench_scrape_total").Help("Benchmark scrape").Register(*registry);
+        std::vector<prometheus::Counter*> counters;
+        for (std::size_t k = 0; k < series; k++) counters.push_back(&family.Add({{"id", std::to_string(k)}, {"method", "POST"}}));
+
+        ert::metrics::Exposer exposer("127.0.0.1:0", 1);
+        exposer.RegisterCollectable(registry);
+        ScrapeClient client(exposer.GetListeningPorts().front());
+        if (!client.connected()) {
+            ert::tracing::Logger::error("Cannot connect to exposer", ERT_FILE_LOCATION);
+            return;
+        }
+
+        std::string parameter = "series=" + std::to_string(series);
+        std::size_t bytes = client.scrape(); // warm up (encoder caches)
+
+        // Unchanged values between scrapes, and every value changed between scrapes (updates included):
+        G_processWide = true;
+        std::uint64_t before = G_allocations;
+        Result result = run("scrape_unchanged", parameter, 1, iterations, [&](unsigned, std::uint64_t) {
+            client.scrape();
+        });
+        result.allocations = G_allocations - before;
+        result.bytes = bytes;
+        report(result);
+
+        before = G_allocations;
+        result = run("scrape_changed", parameter, 1, iterations, [&](unsigned, std::uint64_t) {
+            for (auto counter: counters) counter->Increment();
+            client.scrape();
+        });
+        result.allocations = G_allocations - before;
+        result.bytes = bytes;
+        report(result);
+
+        // Compressed payload (gzip, default level):
+        ScrapeClient gzipClient(exposer.GetListeningPorts().front(), "Accept-Encoding: gzip\r\n");
+        bytes = gzipClient.scrape();
+        before = G_allocations;
+        result = run("scrape_gzip", parameter, 1, iterations, [&](unsigned, std::uint64_t) {
+            gzipClient.scrape();
+        });
+        result.allocations = G_allocations - before;
+        result.bytes = bytes;
+        report(result);
+        G_processWide = false;
+    }
+}
+
+
+//////////
+// Main //
+//////////
+
+void usage(int rc)
+{
+    std::cerr << "Usage: " << progname << " [-t <max threads>] [-n <iterations>] [-s <scrapes>] [-o <json file>] [-f <filter>]\n\n"
+              << "  -t  Maximum number of threads (1, 2, 4 ... up to this value). Defaults to 64.\n"
+              << "  -n  Iterations per thread for update benchmarks. Defaults to 1000000.\n"
+              << "  -s  Scrapes per scrape benchmark. Defaults to 20.\n"
+              << "  -o  JSON report file. Defaults to standard output.\n"
+              << "  -f  Run only benchmark groups containing this text: counter, histogram, timer, family, storage, scrape.\n";
+    exit(rc);
+}
+
+int main(int argc, char* argv[]) {
+
+    progname = basename(argv[0]);
+    ert::tracing::Logger::initialize(progname);
+
+    unsigned maxThreads = 64;
+    std::uint64_t iterations = 1000000, scrapeIterations = 20;
+    std::string output, filter;
+
+    for (int k = 1; k < argc; k++) {
+        std::string option = argv[k];
+        if (option == "-h" || option == "--help") usage(0);
+        if (k + 1 >= argc) usage(1);
+        std::string value = argv[++k];
+
+        if (option == "-t") maxThreads = std::max(1, std::atoi(value.c_str()));
+        else if (option == "-n") iterations = std::max(1ULL, std::strtoull(value.c_str(), nullptr, 10));
+        else if (option == "-s") scrapeIterations = std::max(1ULL, std::strtoull(value.c_str(), nullptr, 10));
+        else if (option == "-o") output = value;
+        else if (option == "-f") filter = value;
+        else usage(1);
+    }
+
+    std::vector<unsigned> threads;
+    for (unsigned t = 1; t <= maxThreads; t *= 2) threads.push_back(t);
+
+    auto selected = [&](const std::string &group) {
+        return filter.empty() || group.find(filter) != std::string::npos;
+    };
+
+    if (selected("counter")) counters(threads, iterations);
+    if (selected("histogram")) histograms(threads, iterations);
+    if (selected("timer")) timers(threads, iterations);
+    if (selected("family")) familyAdd(threads);
+    if (selected("storage")) storage(threads, iterations);
+    if (selected("scrape")) scrapes(scrapeIterations);
+
+    if (output.empty()) {
+        std::cout << toJson();
+    }
+    else {
+        std::ofstream file(output);
+        file << toJson();
+        if (!file) {
+            std::cerr << "Cannot write " << output << std::endl;
+            return 1;
+        }
+        std::cout << "JSON report written to " << output << std::endl;
+    }
+
+    return 0;
+}
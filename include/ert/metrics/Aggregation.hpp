@@ -0,0 +1,163 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <ert/metrics/ReadMostly.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Aggregation rule for a family (@see Metrics::aggregateFamily()): series are rolled up in-process before
+ * encoding, so scrapes ship (and the server stores) only the reduced output.
+ *
+ * Counters, gauges and untyped values are summed. Histograms sum counts, sums and buckets (series must share
+ * bucket boundaries). Summaries sum counts and sums, and their quantiles are dropped (they cannot be merged).
+ *
+ * Counters, histograms and summaries are aggregated from the increases of each series between scrapes, so
+ * aggregates never decrease when series disappear (i.e. evicted) or are reset, nor when ranked values move in
+ * or out of the top.
+ */
+struct aggregation_rule_t {
+    /** Labels removed: series left with the same labels are summed */
+    std::vector<std::string> drop_labels;
+    /**
+     * Label whose values are ranked, keeping the 'top_k' larger ones and folding the rest into 'other_value'.
+     * Empty means no ranking. Gauges and untyped values are ranked by value. Counters, histograms and summaries
+     * are ranked by recent increases (value or observations count, decayed between scrapes), so values ranked
+     * once do not hold the top forever: the folded series only gets the increases of values while folded.
+     */
+    std::string top_label;
+    std::size_t top_k = 0;
+    std::string other_value = "other";
+    /**
+     * Aggregated family name. Empty means that only the aggregate is exposed (it replaces the family series).
+     * Otherwise, the aggregate is exposed as a new family together with the original series.
+     */
+    std::string name;
+};
+
+/**
+ * Aggregation rules by family name, applied to collected families.
+ *
+ * Aggregated groups are kept between scrapes: label keys are built into a reused buffer and only new groups
+ * allocate, so steady scrapes only accumulate values. Rules are read-mostly (added at startup), and families
+ * without rule cost a wait-free lookup.
+ */
+class Aggregator {
+
+    struct Group {
+        prometheus::ClientMetric metric;
+        prometheus::ClientMetric increase; // since last scrape (counters, histograms and summaries)
+        bool seen{};
+    };
+
+    struct State {
+        aggregation_rule_t rule;
+        std::mutex mutex; // protects everything below (scrapes of different endpoints)
+        std::map<std::string, Group> sources; // last values by series labels (counters, histograms and summaries)
+        std::map<std::string, Group> groups; // by dropped labels
+        std::map<std::string, Group> folded; // by ranked labels
+        std::map<std::string, double> scores; // by ranked label value
+        std::unordered_set<std::string> kept;
+        std::string key;
+        bool mismatch_logged{};
+    };
+
+    ReadMostlyMap<State> states_;
+    std::atomic<bool> empty_{true};
+
+    void aggregate(State &state, prometheus::MetricFamily &family, std::vector<prometheus::ClientMetric> &out);
+
+public:
+
+    /**
+     * Add rule
+     *
+     * @param familyName Family name
+     * @param rule Aggregation rule
+     *
+     * @return False if the rule is not valid or the family already has one
+     */
+    bool add(const std::string &familyName, const aggregation_rule_t &rule);
+
+    /**
+     * Apply rules to collected families
+     *
+     * @param families Collected families, updated in place
+     */
+    void apply(std::vector<prometheus::MetricFamily> &families);
+};
+
+/**
+ * Collectable decorator applying aggregation rules to the families collected from the source.
+ */
+class AggregatedCollectable : public prometheus::Collectable {
+    std::shared_ptr<prometheus::Collectable> source_;
+    std::shared_ptr<Aggregator> aggregator_;
+
+public:
+    AggregatedCollectable(std::shared_ptr<prometheus::Collectable> source, std::shared_ptr<Aggregator> aggregator)
+        : source_(std::move(source)), aggregator_(std::move(aggregator)) {}
+
+    /** Source collectable */
+    const std::shared_ptr<prometheus::Collectable> &source() const {
+        return source_;
+    }
+
+    std::vector<prometheus::MetricFamily> Collect() const override {
+        std::vector<prometheus::MetricFamily> families = source_->Collect();
+        aggregator_->apply(families);
+        return families;
+    }
+};
+
+}
+}
+
@@ -0,0 +1,170 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include <ert/metrics/Sharded.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Bounded lock-free queue (ring of cells with sequence numbers, D. Vyukov's algorithm). Safe for multiple
+ * producers and consumers; used here as MPSC queue. Elements are moved in and out preallocated cells, so
+ * pushing types like maps does not allocate.
+ */
+template <typename T>
+class BoundedQueue {
+
+    struct alignas(cache_line_size) Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_;
+
+    alignas(cache_line_size) std::atomic<std::size_t> enqueue_position_;
+    alignas(cache_line_size) std::atomic<std::size_t> dequeue_position_;
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param capacity Queue capacity, rounded up to a power of two
+     */
+    explicit BoundedQueue(std::size_t capacity) : enqueue_position_(0), dequeue_position_(0) {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+
+        cells_.reset(new Cell[size]);
+        mask_ = size - 1;
+        for (std::size_t k = 0; k < size; k++) {
+            cells_[k].sequence.store(k, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /** Queue capacity */
+    std::size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    /**
+     * Push element
+     *
+     * @param value Element to move into the queue (untouched when full)
+     *
+     * @return false if queue is full
+     */
+    bool tryPush(T &value) {
+        std::size_t position = enqueue_position_.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells_[position & mask_];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (difference == 0) {
+                if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = enqueue_position_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Pop element
+     *
+     * @param value Destination for the element
+     *
+     * @return false if queue is empty
+     */
+    bool tryPop(T &value) {
+        std::size_t position = dequeue_position_.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells_[position & mask_];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+            if (difference == 0) {
+                if (dequeue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = dequeue_position_.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->data);
+        cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Number of elements pushed since construction */
+    std::size_t pushed() const {
+        return enqueue_position_.load(std::memory_order_acquire);
+    }
+
+    /** Approximate number of queued elements */
+    std::size_t size() const {
+        const std::size_t enqueued = enqueue_position_.load(std::memory_order_relaxed);
+        const std::size_t dequeued = dequeue_position_.load(std::memory_order_relaxed);
+        return (enqueued > dequeued) ? (enqueued - dequeued) : 0;
+    }
+};
+
+}
+}
+
@@ -0,0 +1,115 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Bucket layout: validated bucket boundaries, shared by reference among histogram series (@see LayoutHistogram,
+ * LocalHistogram), so high-cardinality families keep a single copy.
+ *
+ * Bucket search is branchless: boundaries below the value are counted with SIMD comparisons (AVX2 or SSE2,
+ * selected at runtime) for up to 64 boundaries, and larger layouts use a branchless binary search.
+ */
+class BucketLayout {
+
+    std::string name_;
+    bucket_boundaries_t boundaries_;
+    std::vector<double> padded_; // padded with '+Inf' up to a multiple of 8
+    std::size_t (*search_)(const double *bounds, std::size_t size, double value);
+
+public:
+
+    /** Layouts up to this number of boundaries are searched by SIMD counting */
+    static constexpr std::size_t simd_max_boundaries = 64;
+
+    /**
+     * Constructor
+     *
+     * @param name Layout name (informative)
+     * @param boundaries Bucket boundaries (upper inclusive bounds, '+Inf' bucket is implicit)
+     *
+     * @throw std::invalid_argument if boundaries are not finite and strictly increasing
+     */
+    BucketLayout(const std::string &name, const bucket_boundaries_t &boundaries);
+
+    BucketLayout(const BucketLayout&) = delete;
+    BucketLayout& operator=(const BucketLayout&) = delete;
+
+    /** Layout name */
+    const std::string &name() const {
+        return name_;
+    }
+
+    /** Bucket boundaries */
+    const bucket_boundaries_t &boundaries() const {
+        return boundaries_;
+    }
+
+    /** Number of buckets (boundaries plus '+Inf') */
+    std::size_t buckets() const {
+        return boundaries_.size() + 1;
+    }
+
+    /**
+     * Bucket index for a value: first boundary greater or equal than value ('+Inf' bucket if none).
+     * NaN goes to the first bucket.
+     */
+    std::size_t index(double value) const {
+        return search_(padded_.data(), padded_.size(), value);
+    }
+
+    /** Search kernel in use: "avx2", "sse2" or "binary" */
+    const char *kernel() const;
+};
+
+/** Bucket layout shared by series */
+typedef std::shared_ptr<const BucketLayout> bucket_layout_t;
+
+}
+}
+
@@ -0,0 +1,190 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Gauge callback: returns current value, evaluated on scrape */
+typedef std::function<double()> gauge_callback_t;
+
+class CallbackGaugeFamily;
+
+/**
+ * Callback registration (RAII): the series is removed when the registration is destroyed or reset, so objects
+ * owning their registration never get their callback called after destruction. Movable, not copyable.
+ */
+class CallbackGaugeRegistration {
+    std::weak_ptr<CallbackGaugeFamily> family_;
+    std::uint64_t id_{};
+
+public:
+    CallbackGaugeRegistration() = default;
+    CallbackGaugeRegistration(std::weak_ptr<CallbackGaugeFamily> family, std::uint64_t id) : family_(std::move(family)), id_(id) {}
+    ~CallbackGaugeRegistration() {
+        reset();
+    }
+
+    CallbackGaugeRegistration(const CallbackGaugeRegistration&) = delete;
+    CallbackGaugeRegistration& operator=(const CallbackGaugeRegistration&) = delete;
+
+    CallbackGaugeRegistration(CallbackGaugeRegistration &&other) noexcept : family_(std::move(other.family_)), id_(other.id_) {
+        other.id_ = 0;
+    }
+    CallbackGaugeRegistration& operator=(CallbackGaugeRegistration &&other) noexcept {
+        if (this != &other) {
+            reset();
+            family_ = std::move(other.family_);
+            id_ = other.id_;
+            other.id_ = 0;
+        }
+        return *this;
+    }
+
+    /** Returns true if the callback is registered */
+    bool valid() const {
+        return (id_ != 0);
+    }
+
+    /**
+     * Remove the series. Waits for an ongoing evaluation of the callback (scrape) to finish, so it must not be
+     * called from the callback itself.
+     */
+    void reset();
+};
+
+/**
+ * Gauge family whose series values are computed by callbacks only when the family is collected (scrape),
+ * instead of being updated on every change (i.e. queue depths or pool sizes).
+ *
+ * Callbacks are evaluated sequentially under the family lock, which also serializes removals: once a
+ * registration is reset, its callback is not running and will never be called again. Callbacks must be
+ * fast and must not register or remove series of the same family. A callback throwing an exception skips
+ * its series on that scrape.
+ *
+ * Values may be cached for a short time (cache TTL), so concurrent scrapers do not evaluate every callback
+ * again.
+ *
+ * Family must be owned by a std::shared_ptr (as Metrics class does), so registrations can outlive it.
+ */
+class CallbackGaugeFamily : public prometheus::Collectable, public std::enable_shared_from_this<CallbackGaugeFamily> {
+
+    struct Series {
+        labels_t labels;
+        gauge_callback_t callback;
+        double value{};
+        bool valid{}; // value was evaluated
+    };
+
+    std::string name_;
+    std::string help_;
+    labels_t constant_labels_;
+    std::chrono::steady_clock::duration cache_ttl_;
+
+    mutable std::mutex mutex_;
+    mutable std::map<std::uint64_t, Series> series_; // registration order
+    mutable std::chrono::steady_clock::time_point evaluated_;
+    std::uint64_t next_id_;
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     * @param cacheTtl Time during which evaluated values are reused by later scrapes. Zero (default) evaluates
+     * callbacks on every scrape.
+     *
+     * @throw std::invalid_argument on invalid family or label names
+     */
+    CallbackGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels = {}, std::chrono::milliseconds cacheTtl = std::chrono::milliseconds(0));
+
+    /**
+     * Register series callback
+     *
+     * @param labels Additional labels
+     * @param callback Function returning the series value
+     *
+     * @return Registration, which removes the series on destruction. Invalid (logged) if the labels are already
+     * registered or the callback is empty.
+     *
+     * @throw std::invalid_argument on invalid label names
+     */
+    CallbackGaugeRegistration Add(const labels_t &labels, gauge_callback_t callback);
+
+    /**
+     * Remove series (@see CallbackGaugeRegistration::reset())
+     *
+     * @param id Registration identifier
+     */
+    void Remove(std::uint64_t id);
+
+    /** Family name */
+    const std::string &name() const {
+        return name_;
+    }
+
+    /** Number of series */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return series_.size();
+    }
+
+    /** Collect family for scrape: evaluates callbacks (unless cached values are still valid) */
+    std::vector<prometheus::MetricFamily> Collect() const override;
+};
+
+typedef CallbackGaugeFamily callback_gauge_family_t;
+
+}
+}
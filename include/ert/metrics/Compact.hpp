@@ -0,0 +1,122 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <atomic>
+
+#include <ert/metrics/SeriesFamily.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Compact counter: a single atomic value (8 bytes), intended for slab storage (@see series_storage_t) on
+ * families with many series. Same interface than prometheus counter.
+ */
+class CompactCounter {
+    std::atomic<double> value_{0.0};
+
+public:
+
+    /** Increase counter (negative values are ignored) */
+    void Increment(double value = 1.0) {
+        if (value < 0.0) return;
+        double current = value_.load(std::memory_order_relaxed);
+        while (!value_.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+    }
+
+    /** Current value */
+    double Value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+    /** Collect for scrape */
+    prometheus::ClientMetric Collect() const;
+};
+
+/**
+ * Compact gauge: a single atomic value (8 bytes), intended for slab storage (@see series_storage_t) on
+ * families with many series. Same interface than prometheus gauge.
+ */
+class CompactGauge {
+    std::atomic<double> value_{0.0};
+
+public:
+
+    /** Set value */
+    void Set(double value) {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    /** Increase gauge */
+    void Increment(double value = 1.0) {
+        double current = value_.load(std::memory_order_relaxed);
+        while (!value_.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+    }
+
+    /** Decrease gauge */
+    void Decrement(double value = 1.0) {
+        Increment(-value);
+    }
+
+    /** Current value */
+    double Value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+    /** Collect for scrape */
+    prometheus::ClientMetric Collect() const;
+};
+
+/** Compact counter type */
+typedef CompactCounter compact_counter_t;
+
+/** Compact gauge type */
+typedef CompactGauge compact_gauge_t;
+
+/** Compact counters family */
+typedef SeriesFamily<CompactCounter> compact_counter_family_t;
+
+/** Compact gauges family */
+typedef SeriesFamily<CompactGauge> compact_gauge_family_t;
+
+}
+}
+
@@ -0,0 +1,114 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct z_stream_s;
+struct ZSTD_CCtx_s;
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Scrape compression, negotiated through 'Accept-Encoding' (@see Exposer::SetCompression()) */
+struct compression_config_t {
+    /** Enable gzip */
+    bool gzip = true;
+    /** Gzip level, from 1 (faster) to 9 (smaller) */
+    int gzip_level = 6;
+    /** Enable zstd (only available when the library is built with 'ERT_METRICS_ZSTD') */
+    bool zstd = true;
+    /** Zstd level, from 1 (faster) to 19 (smaller) */
+    int zstd_level = 3;
+    /** Smaller payloads are sent uncompressed */
+    std::size_t min_size = 4096;
+};
+
+/** Content encoding */
+enum class content_encoding_t { Identity, Gzip, Zstd };
+
+/**
+ * Compressor: payload pieces are streamed into a reused output buffer, and compression contexts are reset
+ * (not rebuilt) between payloads, so steady scrapes do not allocate.
+ *
+ * Not thread-safe: each instance must be used by one scrape at a time.
+ */
+class Compressor {
+
+    std::unique_ptr<z_stream_s> gzip_;
+    int gzip_level_{};
+    ZSTD_CCtx_s *zstd_{};
+
+    bool gzip(int level, const std::vector<std::string_view> &pieces, std::string &out);
+    bool zstd(int level, const std::vector<std::string_view> &pieces, std::string &out);
+
+public:
+
+    Compressor();
+    ~Compressor();
+
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    /** Encodings supported by this build (identity and gzip always, zstd with 'ERT_METRICS_ZSTD') */
+    static bool supported(content_encoding_t encoding);
+
+    /** Content encoding header value ('gzip' or 'zstd'), empty for identity */
+    static const char *name(content_encoding_t encoding);
+
+    /**
+     * Compress payload
+     *
+     * @param encoding Content encoding (identity just joins the pieces)
+     * @param level Compression level
+     * @param pieces Payload pieces, in order
+     * @param out Output buffer (replaced, capacity is kept)
+     *
+     * @return False on compression error or unsupported encoding
+     */
+    bool compress(content_encoding_t encoding, int level, const std::vector<std::string_view> &pieces, std::string &out);
+};
+
+}
+}
+
@@ -0,0 +1,216 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ert/metrics/SeriesFamily.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Exponential histogram configuration */
+struct exponential_histogram_config_t {
+    /** Resolution: bucket boundaries are powers of base = 2^(2^-schema). From -4 (base 65536) to 8 (base ~1.0027). */
+    int schema = 3;
+    /** Absolute values up to this threshold are counted in the zero bucket */
+    double zero_threshold = 2.938735877055719e-39; // 2^-128
+    /** Maximum number of populated buckets: when exceeded, schema is decreased (resolution halved). Zero means unlimited. */
+    std::size_t max_buckets = 160;
+};
+
+/**
+ * Native histogram representation (Prometheus sparse histograms data model): populated buckets described by
+ * spans (offset from the previous span end, length) and count deltas between consecutive buckets.
+ */
+struct native_histogram_t {
+    struct Span {
+        std::int32_t offset;
+        std::uint32_t length;
+    };
+
+    int schema{};
+    double zero_threshold{};
+    std::uint64_t zero_count{};
+    std::uint64_t count{};
+    double sum{};
+    std::vector<Span> positive_spans;
+    std::vector<std::int64_t> positive_deltas;
+    std::vector<Span> negative_spans;
+    std::vector<std::int64_t> negative_deltas;
+};
+
+/**
+ * Exponential (sparse) histogram: base-2 exponential buckets whose index is computed in constant time from
+ * the floating point exponent and mantissa bits. Bucket 'i' covers (base^(i-1), base^i]. Only populated
+ * buckets take memory (chunked sparse storage), so no boundaries have to be configured.
+ */
+class ExponentialHistogram {
+
+    static constexpr int chunk_bits = 6;
+    typedef std::array<std::uint64_t, 1 << chunk_bits> chunk_t;
+
+    /** Sparse buckets: chunks of consecutive counters indexed by 'index >> chunk_bits' */
+    struct Buckets {
+        std::unordered_map<std::int32_t, std::unique_ptr<chunk_t>> chunks;
+        std::size_t populated{};
+
+        void add(std::int32_t index, std::uint64_t count);
+        std::map<std::int32_t, std::uint64_t> sorted() const;
+    };
+
+    int schema_;
+    double zero_threshold_;
+    std::size_t max_buckets_;
+
+    mutable std::mutex mutex_;
+    Buckets positive_;
+    Buckets negative_;
+    std::uint64_t zero_count_{};
+    std::uint64_t count_{};
+    double sum_{};
+
+    void reduceResolution();
+    prometheus::ClientMetric collect(native_histogram_t *native) const;
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param config Histogram configuration
+     *
+     * @throw std::invalid_argument if schema is out of range
+     */
+    explicit ExponentialHistogram(const exponential_histogram_config_t &config = {});
+
+    /**
+     * Bucket index for a positive value and schema
+     *
+     * @param value Positive finite value
+     * @param schema Resolution schema
+     */
+    static std::int32_t bucketIndex(double value, int schema);
+
+    /** Upper bound for bucket index and schema */
+    static double upperBound(std::int32_t index, int schema);
+
+    /** Observe value (NaN values are ignored) */
+    void Observe(double value);
+
+    /** Current schema (may be lower than configured after resolution reductions) */
+    int schema() const;
+
+    /** Native histogram representation (spans and deltas) */
+    native_histogram_t native() const;
+
+    /**
+     * Collect for scrape, as conventional histogram: one 'le' bucket for every populated bucket (plus zero
+     * bucket and '+Inf').
+     */
+    prometheus::ClientMetric Collect() const;
+
+    /**
+     * Collect for scrape, as conventional histogram and native representation (same snapshot)
+     *
+     * @param native Native representation (output)
+     */
+    prometheus::ClientMetric Collect(native_histogram_t &native) const;
+};
+
+/**
+ * Native histograms captured on the current thread: while an instance is alive, exponential histogram families
+ * collected by that thread also record the native representation of their series, keyed by family name and
+ * labels, so encoders supporting native histograms can expose them (@see ProtobufEncoder). Captures may be
+ * nested (the innermost one is current).
+ */
+class NativeHistogramCapture {
+    NativeHistogramCapture *previous_;
+    std::unordered_map<std::string, std::unordered_map<std::string, native_histogram_t>> families_;
+
+public:
+
+    NativeHistogramCapture();
+    ~NativeHistogramCapture();
+
+    NativeHistogramCapture(const NativeHistogramCapture&) = delete;
+    NativeHistogramCapture& operator=(const NativeHistogramCapture&) = delete;
+
+    /** Capture of the current thread, null if none */
+    static NativeHistogramCapture *current();
+
+    /** Record native representation of a series */
+    void add(const std::string &family, const std::vector<prometheus::ClientMetric::Label> &labels, native_histogram_t &&native);
+
+    /**
+     * Forget the series of a family, i.e. when collected series are transformed (aggregation rules), so they
+     * no longer match their native representation
+     */
+    void discard(const std::string &family);
+
+    /**
+     * Native representation of a series
+     *
+     * @return Null if not captured
+     */
+    const native_histogram_t *find(const std::string &family, const std::vector<prometheus::ClientMetric::Label> &labels) const;
+};
+
+/** Exponential histograms are also captured as native histograms (@see NativeHistogramCapture) */
+template <>
+struct series_collector_t<ExponentialHistogram> {
+    static prometheus::ClientMetric collect(const ExponentialHistogram &series, const std::string &family, std::vector<prometheus::ClientMetric::Label> &&labels);
+};
+
+/** Exponential histogram type */
+typedef ExponentialHistogram exponential_histogram_t;
+
+/** Exponential histograms family */
+typedef SeriesFamily<ExponentialHistogram> exponential_histogram_family_t;
+
+}
+}
+
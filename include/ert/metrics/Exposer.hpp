@@ -0,0 +1,193 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ert/metrics/Compression.hpp>
+#include <ert/metrics/ProtobufEncoder.hpp>
+#include <ert/metrics/TextEncoder.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Metrics exposer: minimal HTTP/1.1 server for scrapes, owned by this library so the exposition path can keep
+ * state between scrapes (@see TextEncoder) and reuse buffers.
+ *
+ * Interface mimics prometheus::Exposer: collectables are registered for an uri ('/metrics' by default).
+ * A poller thread accepts connections and watches the idle ones, handing only connections ready to read to
+ * a pool of worker threads, so kept alive connections (scrapers reuse them on every interval) do not hold
+ * workers between scrapes. Idle connections are closed after idle timeout, and sockets have send/receive
+ * timeouts, so stalled scrapers cannot hold workers either. Scrapes for the same uri are serialized while
+ * encoding, as they share the encoders, and responses are sent from per-connection buffers once released.
+ *
+ * Exposition format is negotiated through 'Accept': Prometheus text 0.0.4 (default), OpenMetrics text 1.0.0
+ * or protobuf delimited. Payloads are compressed with gzip (or zstd, @see compression_config_t) when requested
+ * through 'Accept-Encoding' and large enough.
+ */
+class Exposer {
+
+    struct Endpoint {
+        std::mutex collectables_mutex; // protects collectables
+        std::vector<std::weak_ptr<prometheus::Collectable>> collectables;
+
+        std::mutex mutex; // protects everything below
+        TextEncoder text{TextEncoder::Format::Text};
+        TextEncoder open_metrics{TextEncoder::Format::OpenMetrics};
+        ProtobufEncoder protobuf;
+        Compressor compressor;
+        std::string encoded; // protobuf payload
+        std::string body; // response payload (joined or compressed)
+    };
+
+    struct Connection {
+        int fd;
+        std::string input; // received and not processed yet (partial or pipelined requests)
+        std::string output; // response being sent
+        std::chrono::steady_clock::time_point idle_since;
+    };
+
+    int listen_fd_;
+    int wake_fd_; // wakes the poller up (connections returned, stop)
+    int port_;
+    std::atomic<bool> stopping_;
+
+    std::mutex endpoints_mutex_;
+    std::map<std::string, std::shared_ptr<Endpoint>> endpoints_;
+
+    std::mutex queue_mutex_; // protects queue, returned and busy connections
+    std::condition_variable queue_cv_;
+    std::deque<std::unique_ptr<Connection>> queue_; // ready to read, for workers
+    std::vector<std::unique_ptr<Connection>> returned_; // served and kept alive, for the poller
+    std::set<int> busy_; // being served by workers
+
+    std::thread poller_;
+    std::vector<std::thread> workers_;
+
+    std::mutex observer_mutex_;
+    std::function<void(const std::string &uri, double seconds, std::size_t bytes)> observer_;
+
+    std::mutex compression_mutex_;
+    compression_config_t compression_;
+
+    void pollLoop();
+    void accept(std::vector<std::unique_ptr<Connection>> &idle);
+    void wake();
+    void workLoop();
+    bool serve(Connection &connection);
+    bool respond(Connection &connection, const std::string &method, const std::string &uri, bool keepAlive, const std::string &accept, const std::string &acceptEncoding);
+    std::shared_ptr<Endpoint> endpoint(const std::string &uri);
+
+public:
+
+    /** Idle time after which kept alive connections are closed */
+    static constexpr int idle_timeout_ms = 30000;
+
+    /** Send and receive timeout (stalled scrapers) */
+    static constexpr int io_timeout_ms = 10000;
+
+    /**
+     * Constructor: binds the address and starts serving
+     *
+     * @param bindAddress Address to bind, i.e. '0.0.0.0:8080', '[::]:8080' or ':8080'. Port 0 binds an ephemeral port.
+     * @param numThreads Number of worker threads (at least one)
+     * @param backlog Listen backlog (pending connections). Zero means system maximum (SOMAXCONN)
+     *
+     * @throw std::runtime_error if address cannot be resolved or bound
+     */
+    explicit Exposer(const std::string &bindAddress, std::size_t numThreads = 2, int backlog = 0);
+
+    /** Destructor: stops serving, closing every connection */
+    ~Exposer();
+
+    Exposer(const Exposer&) = delete;
+    Exposer& operator=(const Exposer&) = delete;
+
+    /**
+     * Register collectable
+     *
+     * @param collectable Collectable to scrape (expired ones are ignored)
+     * @param uri Scrape path
+     */
+    void RegisterCollectable(const std::weak_ptr<prometheus::Collectable> &collectable, const std::string &uri = "/metrics");
+
+    /**
+     * Remove collectable
+     *
+     * @param collectable Collectable previously registered
+     * @param uri Scrape path
+     */
+    void RemoveCollectable(const std::weak_ptr<prometheus::Collectable> &collectable, const std::string &uri = "/metrics");
+
+    /**
+     * Set scrape observer, called after every successful scrape from the worker thread which served it
+     *
+     * @param observer Callback receiving the scrape uri, duration in seconds (collection, encoding and sending)
+     * and payload size in bytes. Empty function to remove it.
+     */
+    void SetScrapeObserver(std::function<void(const std::string &uri, double seconds, std::size_t bytes)> observer);
+
+    /**
+     * Set scrape compression (gzip enabled by default for payloads from 4 KiB)
+     *
+     * @param config Compression configuration
+     */
+    void SetCompression(const compression_config_t &config);
+
+    /** Listening ports (the bound one, useful for ephemeral ports) */
+    std::vector<int> GetListeningPorts() const {
+        return {port_};
+    }
+};
+
+}
+}
+
@@ -0,0 +1,216 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Maximum number of labels in a label set */
+constexpr std::size_t label_set_capacity = 8;
+
+/** Inline storage for label values in a label set (longer values are stored on the heap) */
+constexpr std::size_t label_set_storage = 128;
+
+/**
+ * Compact label set: inline array of key-value views, sorted by key, with a precomputed hash.
+ *
+ * Keys are interned on construction (process-wide storage which is never released, so they must be a bounded
+ * set of label names). Values are copied into storage owned by the set (inline up to @see label_set_storage
+ * bytes), so dynamic values (i.e. from client requests) never grow process memory: label sets never allocate
+ * unless their values exceed the inline storage, and keys compare by pointer.
+ * Use them instead of 'labels_t' on hot paths:
+ *
+ * <pre>
+ * const ert::metrics::LabelSet static_ = {{"method", "POST"}, {"uri", "/the/uri"}}; // constructor
+ * ...
+ * metrics->increaseCounter("requests_total", static_.with("status_code", statusCode)); // no heap allocation
+ * </pre>
+ *
+ * Memory held by series still follows the labels cardinality (@see Metrics::limitFamily()).
+ */
+class LabelSet {
+
+public:
+
+    /** Label (key view on interned storage and value view on the set storage, or both on a labels map: @see view()) */
+    typedef std::pair<std::string_view, std::string_view> label_t;
+
+private:
+
+    std::array<label_t, label_set_capacity> labels_{};
+    std::size_t size_{};
+    std::size_t hash_{};
+    bool owned_{}; // values are viewed on the storage below (otherwise, on external strings)
+    std::array<char, label_set_storage> inline_;
+    std::string heap_; // used instead of inline storage by longer values
+
+    // Add or replace label (value is viewed until 'own()' is called), keeping key order:
+    void put(std::string_view key, std::string_view value);
+    // Copy viewed values into our storage:
+    void own();
+    // Copy labels and storage, rebasing owned values:
+    void assign(const LabelSet &other);
+    void rehash();
+
+    const char *storage() const {
+        return heap_.empty() ? inline_.data() : heap_.data();
+    }
+
+public:
+
+    LabelSet() {
+        rehash();
+    }
+
+    LabelSet(const LabelSet &other) {
+        assign(other);
+    }
+
+    LabelSet &operator=(const LabelSet &other) {
+        if (this != &other) assign(other);
+        return *this;
+    }
+
+    /**
+     * Constructor
+     *
+     * @param labels Key-value pairs (last value wins on repeated keys)
+     *
+     * @throw std::invalid_argument when the number of labels exceeds @see label_set_capacity
+     */
+    LabelSet(std::initializer_list<std::pair<std::string_view, std::string_view>> labels);
+
+    /**
+     * Constructor from labels map
+     *
+     * @throw std::invalid_argument when the number of labels exceeds @see label_set_capacity
+     */
+    explicit LabelSet(const labels_t &labels);
+
+    /**
+     * Label set viewing the strings of a labels map, which are not interned: only valid while the map is
+     * alive and unchanged. Used to look up series for 'labels_t' updates without growing interned storage.
+     *
+     * @throw std::invalid_argument when the number of labels exceeds @see label_set_capacity
+     */
+    static LabelSet view(const labels_t &labels);
+
+    /**
+     * Intern string (process-wide storage, never released): used for label keys
+     *
+     * @param value String to intern
+     *
+     * @return Stable view: same pointer for equal strings
+     */
+    static std::string_view intern(std::string_view value);
+
+    /**
+     * Copy with a label added (or replaced). The key is only interned when it is not in the set already.
+     *
+     * @throw std::invalid_argument when the number of labels exceeds @see label_set_capacity
+     */
+    LabelSet with(std::string_view key, std::string_view value) const;
+
+    /**
+     * Merge label sets (i.e. static and dynamic labels). Labels from 'other' replace ours with the same key.
+     * Keys are already interned, so this is a linear merge without lookups.
+     *
+     * @throw std::invalid_argument when the number of labels exceeds @see label_set_capacity
+     */
+    LabelSet merge(const LabelSet &other) const;
+
+    /** Labels map (allocates: only needed to create series) */
+    labels_t labels() const;
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const label_t *begin() const {
+        return labels_.data();
+    }
+
+    const label_t *end() const {
+        return labels_.data() + size_;
+    }
+
+    /** Precomputed hash (of the strings, so owned and viewed sets with the same labels are equal) */
+    std::size_t hash() const {
+        return hash_;
+    }
+
+    bool operator==(const LabelSet &other) const;
+
+    bool operator!=(const LabelSet &other) const {
+        return !(*this == other);
+    }
+};
+
+/** Label set hash (precomputed) */
+struct label_set_hash_t {
+    std::size_t operator()(const LabelSet &labels) const {
+        return labels.hash();
+    }
+};
+
+/**
+ * Enables overloads only for label sets: braced initializers ('{}', '{{"key", "value"}}') keep selecting
+ * the 'labels_t' overloads without ambiguity.
+ */
+template <typename L>
+using if_label_set_t = std::enable_if_t<std::is_same<L, LabelSet>::value, int>;
+
+}
+}
+
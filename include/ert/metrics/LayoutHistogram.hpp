@@ -0,0 +1,96 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <ert/metrics/BucketLayout.hpp>
+#include <ert/metrics/SeriesFamily.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Histogram over a shared bucket layout: series only own their counts (no boundaries copy), and bucket
+ * search uses the layout kernel (@see BucketLayout). Counts are atomic, so any thread may observe.
+ */
+class LayoutHistogram {
+    bucket_layout_t layout_;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> counts_;
+    std::atomic<double> sum_{0.0};
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param layout Bucket layout (@see Metrics::registerBucketLayout())
+     *
+     * @throw std::invalid_argument if layout is missing
+     */
+    explicit LayoutHistogram(bucket_layout_t layout);
+
+    /** Observe value */
+    void Observe(double value) {
+        counts_[layout_->index(value)].fetch_add(1, std::memory_order_relaxed);
+        double sum = sum_.load(std::memory_order_relaxed);
+        while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {}
+    }
+
+    /** Bucket layout */
+    const BucketLayout &layout() const {
+        return *layout_;
+    }
+
+    /** Collect for scrape */
+    prometheus::ClientMetric Collect() const;
+};
+
+/** Layout histogram type */
+typedef LayoutHistogram layout_histogram_t;
+
+/** Layout histograms family */
+typedef SeriesFamily<LayoutHistogram> layout_histogram_family_t;
+
+}
+}
+
@@ -0,0 +1,112 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <ert/metrics/BucketLayout.hpp>
+#include <ert/metrics/SeriesFamily.hpp>
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Thread-local histogram: each thread observes into its own private bucket array (no locks, no atomic
+ * read-modify-write operations), and arrays are merged when scraped.
+ *
+ * Threads register their private arrays on their first observation. When a thread finishes, its arrays are
+ * folded into the histogram on next scrape, so counts are never lost. Arrays are owned by the histogram, and
+ * its index on threads tables is recycled on destruction, so those tables are bounded by live histograms.
+ */
+class LocalHistogram {
+
+public:
+    struct Shard;
+
+private:
+    const bucket_layout_t layout_;
+    std::size_t id_; // index on threads shards tables (recycled)
+    std::uint64_t serial_; // never reused: tells our shards from those of previous owners of the index
+
+    mutable std::mutex mutex_; // protects shards list and retired counts
+    mutable std::vector<std::unique_ptr<Shard>> shards_;
+    mutable std::vector<std::uint64_t> retired_counts_;
+    mutable double retired_sum_;
+
+    Shard &localShard();
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param boundaries Bucket boundaries (upper inclusive bounds, '+Inf' bucket is implicit)
+     *
+     * @throw std::invalid_argument if boundaries are not finite and strictly sorted
+     */
+    explicit LocalHistogram(const bucket_boundaries_t &boundaries);
+
+    /**
+     * Constructor with shared bucket layout (@see Metrics::registerBucketLayout())
+     *
+     * @throw std::invalid_argument if layout is missing
+     */
+    explicit LocalHistogram(bucket_layout_t layout);
+    ~LocalHistogram();
+
+    /** Observe value */
+    void Observe(double value);
+
+    /** Collect for scrape (merges all threads arrays) */
+    prometheus::ClientMetric Collect() const;
+};
+
+/** Thread-local histogram type */
+typedef LocalHistogram local_histogram_t;
+
+/** Thread-local histograms family */
+typedef SeriesFamily<LocalHistogram> local_histogram_family_t;
+
+}
+}
+
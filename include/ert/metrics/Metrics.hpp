@@ -33,15 +33,35 @@ SOFTWARE.
 
 #pragma once
 
-#include <prometheus/counter.h>
-#include <prometheus/gauge.h>
-#include <prometheus/histogram.h>
-#include <prometheus/exposer.h>
 #include <prometheus/registry.h>
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
+
+#include <ert/metrics/Types.hpp>
+#include <ert/metrics/LabelSet.hpp>
+#include <ert/metrics/Exposer.hpp>
+#include <ert/metrics/Sharded.hpp>
+#include <ert/metrics/Compact.hpp>
+#include <ert/metrics/Aggregation.hpp>
+#include <ert/metrics/LocalHistogram.hpp>
+#include <ert/metrics/LayoutHistogram.hpp>
+#include <ert/metrics/TypedFamily.hpp>
+#include <ert/metrics/ExponentialHistogram.hpp>
+#include <ert/metrics/Summary.hpp>
+#include <ert/metrics/ReadMostly.hpp>
+#include <ert/metrics/BoundedQueue.hpp>
+#include <ert/metrics/SharedSegment.hpp>
+#include <ert/metrics/Persistence.hpp>
+#include <ert/metrics/CallbackGauge.hpp>
 
 //#include <exception>
 
@@ -52,82 +72,629 @@ namespace metrics
 {
 
 /**
- * Labels: key-value pairs map to enable Prometheus's dimensional data model.
- * Any combination of labels for the same metric identifies a particular dimensional instance of the metric.
- * For example: all HTTP requests that used the method POST to the uri '/the/uri': {"method", "POST"}, {"uri", "/the/uri"}
+ * Counter handle: pre-resolved counter series (family + labels).
+ *
+ * It is a cheap copyable object which updates the series directly (no family lookup, no labels hashing),
+ * and remains valid for the whole registry life (metrics instance).
+ * A default constructed handle (or the one returned for a failed resolution) is invalid and ignores updates.
  */
-typedef std::map<std::string, std::string> labels_t;
+class CounterHandle {
+    counter_t *counter_{};
+
+public:
+    CounterHandle() = default;
+    explicit CounterHandle(counter_t *counter) : counter_(counter) {}
 
-/** Prometheus counter type: cumulative metric that represents a single monotonically increasing counter (i.e.: requests sent, errors, etc.). */
-typedef prometheus::Counter counter_t;
+    /** Returns true if the handle refers to a series */
+    bool valid() const {
+        return (counter_ != nullptr);
+    }
 
-/** Prometheus gauge type: single numerical value that can go up and down arbitrarily (i.e.: temperatures, memory usage, concurrent requests, etc.). */
-typedef prometheus::Gauge gauge_t;
+    /** Underlying prometheus counter (nullptr for invalid handle) */
+    counter_t *get() const {
+        return counter_;
+    }
+
+    /** Increase counter (negative values are ignored by prometheus-cpp) */
+    void increment(double value = 1.0) const {
+        if (counter_) counter_->Increment(value);
+    }
+};
 
 /**
- * Prometheus histogram type: samples observations within buckets of specific ranges (i.e.: requests durations, message sizes, etc.).
- * Scrape exposes multiple time series:
- * > cumulative counters (*_bucket{le="<upper inclusive bound>"})
- * > total sum of observed values (*_sum)
- * > count of events observed (*_count). Equals to *_bucket{le="+Inf"}.
+ * Gauge handle: pre-resolved gauge series (family + labels).
+ *
+ * @see CounterHandle
  */
-typedef prometheus::Histogram histogram_t;
+class GaugeHandle {
+    gauge_t *gauge_{};
 
-/** Bucket boundaries for histogram */
-typedef std::vector<double> bucket_boundaries_t;
+public:
+    GaugeHandle() = default;
+    explicit GaugeHandle(gauge_t *gauge) : gauge_(gauge) {}
 
-/** Counters family */
-typedef prometheus::Family<prometheus::Counter> counter_family_t;
+    /** Returns true if the handle refers to a series */
+    bool valid() const {
+        return (gauge_ != nullptr);
+    }
 
-/** Gauges family */
-typedef prometheus::Family<prometheus::Gauge> gauge_family_t;
+    /** Underlying prometheus gauge (nullptr for invalid handle) */
+    gauge_t *get() const {
+        return gauge_;
+    }
 
-/** Histograms family */
-typedef prometheus::Family<prometheus::Histogram> histogram_family_t;
+    /** Set gauge instant value */
+    void set(double value) const {
+        if (gauge_) gauge_->Set(value);
+    }
 
-/** Map of counters family (indexed by counter name) */
-typedef std::unordered_map<std::string, counter_family_t&> counter_family_map_t;
+    /** Increase gauge */
+    void increment(double value = 1.0) const {
+        if (gauge_) gauge_->Increment(value);
+    }
 
-/** Map of gauges family (indexed by gauge name) */
-typedef std::unordered_map<std::string, gauge_family_t&> gauge_family_map_t;
+    /** Decrease gauge */
+    void decrement(double value = 1.0) const {
+        if (gauge_) gauge_->Decrement(value);
+    }
+};
+
+/**
+ * Histogram handle: pre-resolved histogram series (family + labels, and bucket boundaries used on creation).
+ *
+ * @see CounterHandle
+ */
+class HistogramHandle {
+    histogram_t *histogram_{};
+
+public:
+    HistogramHandle() = default;
+    explicit HistogramHandle(histogram_t *histogram) : histogram_(histogram) {}
+
+    /** Returns true if the handle refers to a series */
+    bool valid() const {
+        return (histogram_ != nullptr);
+    }
+
+    /** Underlying prometheus histogram (nullptr for invalid handle) */
+    histogram_t *get() const {
+        return histogram_;
+    }
+
+    /** Observe value */
+    void observe(double value) const {
+        if (histogram_) histogram_->Observe(value);
+    }
+};
 
-/** Map of histograms family (indexed by histogram name) */
-typedef std::unordered_map<std::string, histogram_family_t&> histogram_family_map_t;
+/** Asynchronous updates configuration (@see Metrics::enableAsync()) */
+struct async_config_t {
+    /** Policy when the queue is full: drop the update (counted), or block the caller until there is room */
+    enum class Overflow { Drop, Block };
+
+    /** Queue capacity (rounded up to a power of two) */
+    std::size_t capacity = 65536;
+    /** Overflow policy */
+    Overflow overflow = Overflow::Drop;
+    /** Maximum number of updates applied on each aggregator iteration */
+    std::size_t batch = 1024;
+};
+
+/** Series limits for a family (@see Metrics::limitFamily()) */
+struct series_limits_t {
+    /**
+     * Maximum number of series created through metrics instance (string API, handles, batches, asynchronous
+     * updates). Once reached, updates for new labels go to the overflow series. Zero means unlimited.
+     */
+    std::size_t max_series = 0;
+    /** Labels of the overflow series */
+    labels_t overflow_labels = {{"overflow", "true"}};
+    /**
+     * Series created by transient updates (string API, batches, asynchronous updates) and not updated within
+     * this time are removed. Zero means never.
+     */
+    std::chrono::milliseconds ttl{0};
+};
+
+/** Scrape path (@see serve_options_t) */
+struct scrape_path_t {
+    /** Uri path */
+    std::string path = "/metrics";
+    /**
+     * Families exposed, by name: counter, gauge, histogram and library families added through metrics instance
+     * (resolved once added). Only these families are collected and encoded on the path.
+     */
+    std::vector<std::string> families;
+    /** Additional collectables exposed on the path (i.e. a separate registry) */
+    std::vector<std::shared_ptr<prometheus::Collectable>> collectables;
+};
+
+/** Exposer options (@see Metrics::serve()) */
+struct serve_options_t {
+    /** Scrape endpoint */
+    std::string endpoint = "0.0.0.0:8080";
+    /** Worker threads serving scrapes (at least one) */
+    std::size_t threads = 2;
+    /** Listen backlog (pending connections). Zero means system maximum */
+    int backlog = 0;
+    /** Scrape compression */
+    compression_config_t compression;
+    /**
+     * Scrape paths. A path without families nor collectables exposes everything: registry, library families,
+     * self-metrics and collectables registered (@see registerCollectable()). Empty means everything on '/metrics'.
+     */
+    std::vector<scrape_path_t> paths;
+};
+
+/** Family resolved for asynchronous updates (@see Metrics::asyncCounterFamily()) */
+struct async_family_t {
+    enum class Kind { Counter, Gauge, Histogram };
+
+    Kind kind{};
+    void *entry{}; // family entry within metrics instance
+    const bucket_boundaries_t *boundaries{}; // for histograms
+
+    /** Returns true if the family was resolved */
+    bool valid() const {
+        return (entry != nullptr);
+    }
+};
 
 class Metrics {
 
+    /**
+     * Series resolved through this class.
+     * Pinned series are never evicted: they were returned to the caller (handles), or they were not created by
+     * this class (the caller may hold references from 'Family::Add()').
+     */
+    template <typename T>
+    struct SeriesEntry {
+        T *series{};
+        std::atomic<bool> pinned{false};
+        std::atomic<std::int64_t> updated{0}; // last update (coarse monotonic nanoseconds), when eviction is enabled
+        std::unique_ptr<const labels_t> labels; // strings viewed by the cache key (released on eviction)
+    };
+
+    /**
+     * Family entry: prometheus family plus the cache of series already resolved through this class.
+     * Entries are never removed, so references to them are stable.
+     * Cache keys view strings owned by their series entry, so dynamic label values are not interned.
+     * Series cache is protected by a striped shared mutex, so hits from different threads do not contend.
+     * Transient updates (string API, batches, asynchronous updates) are applied while holding it, so series
+     * can be evicted safely. It is never held exclusively while adding or removing series on the prometheus
+     * family, as scrapes lock the family while collecting it: evicted series are unlinked from the cache, and
+     * removed from the family out of the lock (creations wait for pending removals, @see Metrics::create()).
+     */
+    template <typename T>
+    struct FamilyEntry {
+        explicit FamilyEntry(prometheus::Family<T> &f) : family(f) {}
+
+        prometheus::Family<T> &family;
+        mutable StripedSharedMutex mutex; // protects series cache and limits
+        std::unordered_map<LabelSet, SeriesEntry<T>, label_set_hash_t> series;
+
+        // Limits (@see Metrics::limitFamily()):
+        std::size_t max_series{};
+        labels_t overflow_labels;
+        T *overflow{};
+        counter_t *dropped{};
+        counter_t *evicted{};
+        std::atomic<std::int64_t> ttl_ns{0};
+
+        // Eviction (@see Metrics::evict()):
+        bool removing{}; // series unlinked from cache and not removed from family yet
+        std::uint64_t removals{}; // unlinked series batches
+        std::mutex removal_mutex; // held while removing series from family
+
+        // Self-metrics (@see Metrics::enableSelfMetrics()):
+        std::atomic<std::uint64_t> lock_wait_ns{0}; // estimated from sampled acquisitions
+        std::atomic<std::uint64_t> series_created{0};
+    };
+
+    // Families registry: read-mostly maps, so lookups are wait-free:
+    template <typename T>
+    using family_entries_t = ReadMostlyMap<FamilyEntry<T>>;
+
     std::shared_ptr<prometheus::Registry> registry_;
-    prometheus::Exposer *exposer_;
 
-    counter_family_map_t counter_families_;
-    gauge_family_map_t gauge_families_;
-    histogram_family_map_t histogram_families_;
+    family_entries_t<counter_t> counter_families_;
+    family_entries_t<gauge_t> gauge_families_;
+    family_entries_t<histogram_t> histogram_families_;
+
+    // Families implemented by this library (registered as additional collectables):
+    template <typename F>
+    using series_families_t = std::unordered_map<std::string, std::shared_ptr<F>>;
+
+    series_families_t<sharded_counter_family_t> sharded_counter_families_;
+    series_families_t<sharded_gauge_family_t> sharded_gauge_families_;
+    series_families_t<compact_counter_family_t> compact_counter_families_;
+    series_families_t<compact_gauge_family_t> compact_gauge_families_;
+    series_families_t<local_histogram_family_t> local_histogram_families_;
+    series_families_t<layout_histogram_family_t> layout_histogram_families_;
+    series_families_t<exponential_histogram_family_t> exponential_histogram_families_;
+    series_families_t<summary_family_t> summary_families_;
+    series_families_t<callback_gauge_family_t> callback_gauge_families_;
+    mutable std::mutex series_families_mutex_;
+
+    std::map<std::string, bucket_layout_t> bucket_layouts_;
+    mutable std::mutex bucket_layouts_mutex_;
+
+    std::shared_ptr<Aggregator> aggregator_;
+    std::shared_ptr<prometheus::Collectable> exposed_registry_; // registry with aggregation rules
+    std::vector<std::shared_ptr<prometheus::Collectable>> collectables_; // with aggregation rules
+
+    // Exposers (@see serve()), which keep weak references to collectables:
+    class FamiliesCollectable;
+
+    std::vector<std::unique_ptr<Exposer>> exposers_;
+    std::vector<std::pair<Exposer*, std::string>> full_paths_; // paths exposing everything
+    std::vector<std::shared_ptr<prometheus::Collectable>> path_collectables_;
+    mutable std::mutex exposer_mutex_; // protects exposers and collectables
+
+    std::shared_ptr<prometheus::Collectable> familyCollectable(const std::string &name) const;
+
+    template <typename F, typename... Args>
+    F &addSeriesFamily(series_families_t<F> &families, const char *kind, const std::string &name, Args&&... args);
+
+    template <typename T, typename B>
+    prometheus::Family<T> &addFamily(family_entries_t<T> &families, const char *kind, B builder, const std::string &name, const std::string &help, const labels_t &labels);
+
+    template <typename T>
+    FamilyEntry<T> *findFamily(const family_entries_t<T> &families, const std::string &familyName, const char *kind) const;
+
+    template <typename T>
+    T *lookup(FamilyEntry<T> &entry, const LabelSet &labels, bool pin);
+
+    template <typename T>
+    T *find(FamilyEntry<T> &entry, const LabelSet &labels, bool pin, bool &overflowed);
+
+    template <typename T, typename... Args>
+    void create(FamilyEntry<T> &entry, const LabelSet &labels, bool pin, Args&&... args);
+
+    template <typename T, typename... Args>
+    T *resolve(FamilyEntry<T> &entry, const LabelSet &labels, Args&&... args);
+
+    template <typename T, typename... Args>
+    T *resolve(FamilyEntry<T> &entry, const labels_t &labels, Args&&... args);
+
+    template <typename T, typename U, typename... Args>
+    void update(FamilyEntry<T> &entry, const LabelSet &labels, U &&apply, Args&&... args);
+
+    template <typename T, typename U, typename... Args>
+    void update(FamilyEntry<T> &entry, const labels_t &labels, U &&apply, Args&&... args);
+
+    // Implementations of the public API, for label sets and labels maps:
+    template <typename L>
+    void updateCounter(const std::string &familyName, const L &labels, double value);
+    template <typename L>
+    void updateGauge(const std::string &familyName, const L &labels, double value);
+    template <typename L>
+    void updateHistogram(const std::string &familyName, const L &labels, double value, const bucket_boundaries_t &bucketBoundaries);
+    template <typename L>
+    CounterHandle resolveCounter(const std::string &familyName, const L &labels);
+    template <typename L>
+    GaugeHandle resolveGauge(const std::string &familyName, const L &labels);
+    template <typename L>
+    HistogramHandle resolveHistogram(const std::string &familyName, const L &labels, const bucket_boundaries_t &bucketBoundaries);
+
+    // Idle series eviction:
+    std::thread eviction_thread_;
+    std::condition_variable eviction_cv_;
+    bool eviction_stopping_{false};
+    std::mutex eviction_mutex_; // protects eviction thread and limits configuration
+
+    template <typename T>
+    void evict(FamilyEntry<T> &entry, std::int64_t now);
+    void evictionLoop();
+    void stopEviction();
 
-    mutable std::mutex counter_mutex_;
-    mutable std::mutex gauge_mutex_;
-    mutable std::mutex histogram_mutex_;
+    // Self-metrics:
+    class SelfCollectable;
+
+    std::atomic<bool> self_metrics_{false};
+    std::atomic<std::uint32_t> self_sampling_mask_{63};
+    mutable std::array<std::atomic<std::uint64_t>, 3> lookup_misses_{}; // counter, gauge and histogram families
+    std::shared_ptr<SelfCollectable> self_collectable_;
+    std::unique_ptr<histogram_t> scrape_duration_;
+    std::unique_ptr<histogram_t> scrape_size_;
+    std::mutex self_mutex_; // protects self-metrics creation
+
+    // Persistence:
+    std::unique_ptr<CheckpointStore> checkpoint_store_;
+    std::unordered_map<std::string, persisted_family_t> restored_; // restored families not added yet
+    std::thread checkpoint_thread_;
+    std::condition_variable checkpoint_cv_;
+    bool checkpoint_stopping_{false};
+    std::mutex persistence_mutex_; // protects everything above
+    std::mutex checkpoint_mutex_; // serializes checkpoints (families are collected out of the persistence lock)
+
+    template <typename T>
+    void restore(prometheus::Family<T> &family);
+    void checkpointLoop(std::chrono::milliseconds period);
+    bool saveCheckpoint();
+    void stopPersistence();
+
+    template <typename Lock, typename T>
+    Lock lockSeries(FamilyEntry<T> &entry);
+    void observeScrape(double seconds, std::size_t bytes);
+    std::vector<prometheus::MetricFamily> collectSelf() const;
+
+    // Asynchronous updates (records also hold batch updates):
+    struct AsyncRecord {
+        async_family_t family;
+        LabelSet labels;
+        labels_t owned; // labels map updates (not interned), used instead of 'labels' when not empty
+        double value{};
+    };
+
+    async_config_t async_config_;
+    std::unique_ptr<BoundedQueue<AsyncRecord>> async_queue_storage_; // owned queue (configuration, aggregator thread)
+    std::atomic<BoundedQueue<AsyncRecord>*> async_queue_{nullptr}; // published for pushes once the aggregator runs
+    std::atomic<std::size_t> async_applied_{0};
+    std::atomic<bool> async_stopping_{false};
+    std::thread async_thread_;
+    counter_t *async_dropped_{};
+    std::vector<std::unique_ptr<bucket_boundaries_t>> async_boundaries_;
+    std::mutex async_mutex_; // protects configuration (enable) and boundaries
+
+    async_family_t resolveFamily(async_family_t::Kind kind, const std::string &familyName);
+
+    // Calls 'f' with the family entry of a resolved family:
+    template <typename F>
+    static void visit(const async_family_t &family, F &&f);
+
+    void apply(AsyncRecord &record);
+    bool enqueue(AsyncRecord &record);
+    void asyncLoop();
+    void stopAsync();
 
 public:
 
+    /**
+     * Batch of updates: collects counter, gauge and histogram updates and commits them together.
+     *
+     * Families are looked up when updates are added. On commit, the series cache of every family in the batch is
+     * locked once (twice only if some series has to be created), and updates are applied in insertion order while
+     * holding those locks:
+     *
+     * <pre>
+     * ert::metrics::Metrics::Batch batch(*metrics);
+     * batch.increaseCounter("responses_total", {{"status_code", "200"}})
+     *      .setGauge("in_flight", {}, inFlight)
+     *      .observeHistogram("latency_seconds", {{"method", "POST"}}, elapsed, boundaries)
+     *      .commit();
+     * </pre>
+     *
+     * A batch may be reused after commit (it is cleared, keeping its capacity).
+     */
+    class Batch {
+
+        Metrics &metrics_;
+        std::vector<AsyncRecord> updates_; // resolved families (updates of missing families are discarded)
+
+        template <typename L>
+        Batch &add(async_family_t::Kind kind, const std::string &familyName, const L &labels, double value, const bucket_boundaries_t *boundaries) {
+            AsyncRecord update{metrics_.resolveFamily(kind, familyName), {}, {}, value};
+            if (!update.family.valid()) return *this;
+
+            update.family.boundaries = boundaries;
+            if constexpr (std::is_same<L, LabelSet>::value) update.labels = labels;
+            else update.owned = labels;
+            updates_.push_back(std::move(update));
+            return *this;
+        }
+
+    public:
+
+        /**
+         * Constructor
+         *
+         * @param metrics Metrics instance where updates are committed
+         */
+        explicit Batch(Metrics &metrics) : metrics_(metrics) {}
+
+        /** Add counter increase (@see Metrics::increaseCounter()) */
+        Batch &increaseCounter(const std::string &familyName, const labels_t &labels, double value = 1.0) {
+            return add(async_family_t::Kind::Counter, familyName, labels, value, nullptr);
+        }
+
+        template <typename L, if_label_set_t<L> = 0>
+        Batch &increaseCounter(const std::string &familyName, const L &labels, double value = 1.0) {
+            return add(async_family_t::Kind::Counter, familyName, labels, value, nullptr);
+        }
+
+        /** Add gauge update (@see Metrics::setGauge()) */
+        Batch &setGauge(const std::string &familyName, const labels_t &labels, double value) {
+            return add(async_family_t::Kind::Gauge, familyName, labels, value, nullptr);
+        }
+
+        template <typename L, if_label_set_t<L> = 0>
+        Batch &setGauge(const std::string &familyName, const L &labels, double value) {
+            return add(async_family_t::Kind::Gauge, familyName, labels, value, nullptr);
+        }
+
+        /**
+         * Add histogram observation (@see Metrics::observeHistogram())
+         * Bucket boundaries must remain valid until commit.
+         */
+        Batch &observeHistogram(const std::string &familyName, const labels_t &labels, double value, const bucket_boundaries_t &bucketBoundaries) {
+            return add(async_family_t::Kind::Histogram, familyName, labels, value, &bucketBoundaries);
+        }
+
+        template <typename L, if_label_set_t<L> = 0>
+        Batch &observeHistogram(const std::string &familyName, const L &labels, double value, const bucket_boundaries_t &bucketBoundaries) {
+            return add(async_family_t::Kind::Histogram, familyName, labels, value, &bucketBoundaries);
+        }
+
+        /** Number of pending updates */
+        std::size_t size() const {
+            return updates_.size();
+        }
+
+        /** Discard pending updates */
+        void clear() {
+            updates_.clear();
+        }
+
+        /** Apply pending updates in order, and clear the batch */
+        void commit();
+    };
+
     /** Default constructor */
     Metrics() {
         registry_ = std::make_shared<prometheus::Registry>();
-        exposer_ = nullptr;
+        aggregator_ = std::make_shared<Aggregator>();
+        exposed_registry_ = std::make_shared<AggregatedCollectable>(registry_, aggregator_);
     }
 
     /** Default destructor */
     ~Metrics() {
-        if (exposer_) {
-            delete exposer_;
-        }
+        stopEviction();
+        stopAsync();
+        stopPersistence();
+        exposers_.clear();
     }
 
     /**
      * Serves metrics exposer
      *
+     * Scrapes are served on '/metrics' by the library exposer (@see Exposer), which caches rendered series
+     * between scrapes and only formats values. Text, OpenMetrics and protobuf formats are negotiated, and
+     * payloads are compressed when the scraper accepts it.
+     *
      * @param endpoint Scrape endpoint, '0.0.0.0:8080' by default.
+     * @param compression Scrape compression, gzip for payloads from 4 KiB by default.
+     */
+    bool serve(const std::string & endpoint = "0.0.0.0:8080", const compression_config_t &compression = {});
+
+    /**
+     * Serves metrics exposer with options: worker threads, listen backlog and scrape paths.
+     *
+     * Each path exposes everything, or a set of families and collectables, so frequent scrapes only collect and
+     * encode a small set of families. Paths are served independently (scrapes for different paths do not wait
+     * for each other). It may be called again for other endpoints.
+     *
+     * <pre>
+     * ert::metrics::serve_options_t options;
+     * options.threads = 4;
+     * options.paths.push_back({"/metrics/slo", {"requests_total", "latency_seconds"}, {}});
+     * options.paths.push_back({"/metrics", {}, {}}); // everything
+     * metrics->serve(options);
+     * </pre>
+     *
+     * @param options Exposer options
+     *
+     * @return False if the endpoint cannot be bound or some path is not valid
+     */
+    bool serve(const serve_options_t &options);
+
+    /**
+     * Limit series of a counter, gauge or histogram family, so dynamic labels (i.e. from client requests)
+     * cannot grow memory and scrape size without bound:
+     *
+     * > Cardinality cap: once the family has 'max_series' series created through this class, updates for
+     *   new labels go to a single overflow series (@see series_limits_t::overflow_labels).
+     * > Idle eviction: series created by transient updates ('increaseCounter()', 'setGauge()',
+     *   'observeHistogram()', batches and asynchronous updates) which are not updated within 'ttl' are
+     *   removed from the family by a background thread.
+     *
+     * Series returned by handles ('counterHandle()' and so on), and series not created by this class (i.e.
+     * by 'Family::Add()' directly), are never evicted, so references already held remain valid.
+     * Calls to 'Family::Add()' cannot be tracked by this class: on a family with time to live, a reference to a
+     * series which is also updated through the string API must be taken with a handle (which pins it), never
+     * with 'Family::Add()', as the series may be evicted while referenced.
+     *
+     * Counters 'ert_metrics_series_dropped_total{family}' (updates redirected to the overflow series) and
+     * 'ert_metrics_series_evicted_total{family}' are exported.
+     *
+     * @param familyName Counter, gauge or histogram family name
+     * @param limits Limits
+     *
+     * @return False if the family is not found
+     */
+    bool limitFamily(const std::string &familyName, const series_limits_t &limits);
+
+    /**
+     * Aggregate family series in-process, so fine-grained labels (i.e. uri or peer) are rolled up before
+     * scrapes instead of being shipped and stored (@see aggregation_rule_t):
+     *
+     * > Drop labels and sum: series differing only on dropped labels (i.e. 'peer') are exposed as one.
+     * > Keep top-K label values and fold the rest: ranking 'uri' with 'top_k' 20 exposes the 20 busiest uris
+     *   and 'uri="other"' for the rest.
+     * > Expose only the aggregate (default), or the aggregate as a new family together with the original series.
+     *
+     * Rules apply to any family exposed by this instance (prometheus families and library ones), may be added
+     * before or after the family itself, and only affect exposition: updates, persistence and windowed views
+     * keep working with the original series.
+     *
+     * <pre>
+     * ert::metrics::aggregation_rule_t rule;
+     * rule.drop_labels = {"peer"};
+     * rule.top_label = "uri";
+     * rule.top_k = 20;
+     * metrics->aggregateFamily("requests_total", rule);
+     * </pre>
+     *
+     * @param familyName Family name
+     * @param rule Aggregation rule
+     *
+     * @return False if the rule is not valid or the family already has one
+     */
+    bool aggregateFamily(const std::string &familyName, const aggregation_rule_t &rule);
+
+    /**
+     * Enable (or disable) self-metrics at runtime: library overhead exported together with the rest of metrics.
+     *
+     * > ert_metrics_series_lock_wait_seconds_total{family,kind}: time acquiring the series cache lock of each
+     *   counter/gauge/histogram family, estimated from one acquisition every 'sampling' ones on each thread.
+     * > ert_metrics_family_lookup_misses_total{kind}: updates for unknown families (@see findFamily errors).
+     * > ert_metrics_series{family,kind}: series resolved through this class (string API, handles, batches and
+     *   asynchronous updates) for prometheus families, and every series for library families.
+     * > ert_metrics_series_created_total{family,kind}: series created through this class (use rate()).
+     * > ert_metrics_scrape_duration_seconds and ert_metrics_scrape_size_bytes: histograms for every scrape
+     *   served (@see serve()).
+     *
+     * While disabled, nothing is timed and nothing is exported. Counters keep their values between switches.
+     *
+     * @param enable Enable (true) or disable (false)
+     * @param sampling Lock acquisitions timed: one every 'sampling' (rounded up to a power of two), 64 by default
+     */
+    void enableSelfMetrics(bool enable = true, std::uint32_t sampling = 64);
+
+    /**
+     * Enable persistence of counter and histogram families (@see addCounterFamily(), addHistogramFamily()), so
+     * values survive restarts and scrapes do not see counter resets.
+     *
+     * The latest checkpoint is restored first: series of families already added are recreated (or incremented)
+     * with persisted values, and families added later get their series restored when added. Call it before
+     * 'serve()', so restored values are exposed from the first scrape.
+     *
+     * Checkpoints are written by a background thread every period (and on destruction) to two memory-mapped
+     * files used alternately (@see CheckpointStore), so a crash while checkpointing keeps the previous one.
+     * Updates are never delayed: checkpoints only collect families, as scrapes do.
+     *
+     * @param path Checkpoint files path prefix ('<path>.0' and '<path>.1' are used)
+     * @param period Checkpoint period, 10 seconds by default. Zero disables periodic checkpoints (@see checkpoint()).
+     *
+     * @return False if persistence was already enabled or files cannot be opened
      */
-    bool serve(const std::string & endpoint = "0.0.0.0:8080");
+    bool enablePersistence(const std::string &path, std::chrono::milliseconds period = std::chrono::seconds(10));
+
+    /**
+     * Write checkpoint now (i.e. before a planned restart)
+     *
+     * @return False if persistence is not enabled or checkpoint failed
+     */
+    bool checkpoint();
+
+    /**
+     * Register additional collectable to be scraped together with the metrics registry, on every path
+     * exposing everything (@see serve_options_t::paths). It is registered on exposers immediately if already
+     * serving, or when 'serve()' is called.
+     *
+     * @param collectable Collectable to register
+     */
+    void registerCollectable(const std::shared_ptr<prometheus::Collectable> &collectable);
 
     /**
      * Add counter family
@@ -176,45 +743,56 @@ public:
      * counter.Increment();
      * </pre>
      *
-     * Here you can find a smart counter class, which optimizes the combination of static and dynamic labels:
+     * Here you can find a smart counter class, which optimizes the combination of static and dynamic labels with
+     * label sets (merged without allocations, @see LabelSet):
      *
      * <pre>
      * class MyCounter {
      * public:
-     *     MyCounter(counter_family_t& family, const std::map<std::string, std::string>& staticLabels)
-     *         : family_(family), all_labels_(staticLabels) {}
+     *     MyCounter(ert::metrics::Metrics& metrics, const std::string& familyName, const ert::metrics::LabelSet& staticLabels)
+     *         : metrics_(metrics), family_name_(familyName), static_labels_(staticLabels) {}
      *
-     *     void Increment(const std::map<std::string, std::string>& dynamicLabels) {
-     *         all_labels_.insert(dynamicLabels.begin(), dynamicLabels.end()); // join labels
-     *         auto& counter = family_.Add(all_labels_);
-     *         counter.Increment();
+     *     void Increment(const ert::metrics::LabelSet& dynamicLabels) {
+     *         metrics_.increaseCounter(family_name_, static_labels_.merge(dynamicLabels)); // join labels
      *     }
      *
      * private:
-     *     counter_family_t& family_;
-     *     std::map<std::string, std::string> all_labels_;
+     *     ert::metrics::Metrics& metrics_;
+     *     std::string family_name_;
+     *     ert::metrics::LabelSet static_labels_;
      * };
      * </pre>
      *
-     * Note that dynamic labels should override all the possible labels added in the past with corresponding values,
-     * in order to keep coherence. It is good to add a fixed set of dynamic labels (i.e. the status code).
-     * So, you can instantiate a counter with initial labels, and then increment it with additional 'dynamic' ones:
+     * Note that dynamic labels override static ones with the same key. It is good to add a fixed set of dynamic
+     * labels (i.e. the status code). So, you can instantiate a counter with initial labels, and then increment it
+     * with additional 'dynamic' ones:
      *
      * <pre>
-     * std::map<std::string, std::string> staticLabels = {{"method", "post"}};
-     * MyCounter myCounter(observed_requests_counter_family_ref_, staticLabels);
+     * MyCounter myCounter(*metrics, "observed_requests_total", {{"method", "post"}});
      *
      * // source code:
-     * std::map<std::string, std::string> dynamicLabels = {{"status_code", std::to_string(status_code)}};
-     * myCounter.Increment(dynamicLabels);
+     * myCounter.Increment({{"status_code", statusCode}}); // statusCode: string view, i.e. "200"
      * </pre>
      *
+     * Scrapes: this is a prometheus-cpp family, which locks series creation ('Family::Add()') while it is collected.
+     * Updates of existing series never wait for scrapes, and series created through this class (string API, handles,
+     * batches, asynchronous updates) only stall the creating thread. Families which keep creating series while being
+     * scraped should be library families instead (i.e. @see addCompactCounterFamily(), @see addLayoutHistogramFamily()),
+     * whose scrapes never block writers (@see SeriesFamily). In both cases, values are read series by series: a scrape
+     * is not a point-in-time snapshot across series.
+     *
      * @param name Family name
      * @param help Family help description
      * @param labels Family definition labels. Empty by default (a counter generated within this family could add additional labels).
      */
     counter_family_t& addCounterFamily(const std::string &name, const std::string &help, const labels_t &labels = {});
 
+    /** Add counter family (label set) */
+    template <typename L, if_label_set_t<L> = 0>
+    counter_family_t& addCounterFamily(const std::string &name, const std::string &help, const L &labels) {
+        return addCounterFamily(name, help, labels.labels());
+    }
+
     /**
      * Add gauge family
      *
@@ -229,6 +807,12 @@ public:
      */
     gauge_family_t& addGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels = {});
 
+    /** Add gauge family (label set) */
+    template <typename L, if_label_set_t<L> = 0>
+    gauge_family_t& addGaugeFamily(const std::string &name, const std::string &help, const L &labels) {
+        return addGaugeFamily(name, help, labels.labels());
+    }
+
     /**
      * Add histogram family
      *
@@ -243,17 +827,306 @@ public:
      */
     histogram_family_t& addHistogramFamily(const std::string &name, const std::string &help, const labels_t &labels = {});
 
+    /** Add histogram family (label set) */
+    template <typename L, if_label_set_t<L> = 0>
+    histogram_family_t& addHistogramFamily(const std::string &name, const std::string &help, const L &labels) {
+        return addHistogramFamily(name, help, labels.labels());
+    }
+
+    /**
+     * Add sharded counter family
+     *
+     * Sharded counters spread writes among cache-line-padded slots (one per thread, up to the number of shards),
+     * which are only summed when scraped. Use them instead of 'counter_t' when many threads increment the same
+     * series, to avoid cache line contention:
+     *
+     * <pre>
+     * ert::metrics::sharded_counter_t *requests_ = &(metrics->addShardedCounterFamily("requests_total", "Requests received").Add({{"method", "POST"}}));
+     * ...
+     * requests_->Increment();
+     * </pre>
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     *
+     * Number of slots is the hardware concurrency (rounded up to a power of two) unless specified when adding
+     * the series: 'Add(labels, shards)'.
+     *
+     * @see addCounterFamily()
+     */
+    sharded_counter_family_t& addShardedCounterFamily(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+    /**
+     * Add sharded (up/down) gauge family
+     *
+     * Same as sharded counters, for gauges only updated with increments and decrements.
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     *
+     * @see addShardedCounterFamily()
+     */
+    sharded_gauge_family_t& addShardedGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+    /**
+     * Add compact counter family
+     *
+     * Series are a single atomic value allocated from per-family slab pools (removed series are recycled):
+     * > Packed storage (default): contiguous series, for large families mostly read by scrapes.
+     * > Padded storage: one cache line per series, for hot series updated from different threads.
+     *
+     * <pre>
+     * ert::metrics::compact_counter_family_t &family = metrics->addCompactCounterFamily("sessions_total", "Sessions per subscriber");
+     * ert::metrics::compact_counter_t *subscriber_ = &(family.Add({{"subscriber", id}}));
+     * ...
+     * subscriber_->Increment();
+     * </pre>
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     * @param storage Series storage
+     *
+     * @see addCounterFamily()
+     */
+    compact_counter_family_t& addCompactCounterFamily(const std::string &name, const std::string &help, const labels_t &labels = {}, series_storage_t storage = series_storage_t::Packed);
+
+    /**
+     * Add compact gauge family
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     * @param storage Series storage
+     *
+     * @see addCompactCounterFamily()
+     */
+    compact_gauge_family_t& addCompactGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels = {}, series_storage_t storage = series_storage_t::Packed);
+
+    /**
+     * Add thread-local histogram family
+     *
+     * Each thread observes into private bucket arrays without locks, which are merged on scrape (counts from
+     * finished threads are kept). Recommended for histograms observed from many threads at high rates:
+     *
+     * <pre>
+     * ert::metrics::local_histogram_t *latency_ = &(metrics->addLocalHistogramFamily("latency_seconds", "Requests latency").Add({{"method", "POST"}}, bucketBoundaries));
+     * ...
+     * latency_->Observe(elapsed);
+     * </pre>
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     *
+     * @see addHistogramFamily()
+     */
+    local_histogram_family_t& addLocalHistogramFamily(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+    /**
+     * Register bucket layout
+     *
+     * Boundaries are validated once, and the layout is shared by reference by every series using it (layout and
+     * thread-local histograms), with a vectorized bucket search:
+     *
+     * <pre>
+     * // constructor
+     * ert::metrics::bucket_layout_t layout = metrics->registerBucketLayout("latency_ms", {1, 2, 5, 10, 20, 50, 100, 200, 500});
+     * ert::metrics::layout_histogram_family_t &family = metrics->addLayoutHistogramFamily("latency_ms", "Requests latency", layout);
+     * ert::metrics::layout_histogram_t *post_latency_ = &(family.Add({{"method", "POST"}}));
+     * ...
+     * post_latency_->Observe(elapsed);
+     * </pre>
+     *
+     * Registering again with the same boundaries returns the existing layout.
+     *
+     * @param name Layout name
+     * @param boundaries Bucket boundaries (finite and strictly sorted)
+     *
+     * @return Bucket layout, nullptr if boundaries are invalid or the name is registered with other boundaries
+     */
+    bucket_layout_t registerBucketLayout(const std::string &name, const bucket_boundaries_t &boundaries);
+
+    /**
+     * Get registered bucket layout
+     *
+     * @param name Layout name
+     *
+     * @return Bucket layout, nullptr if not registered
+     */
+    bucket_layout_t bucketLayout(const std::string &name) const;
+
+    /**
+     * Add layout histogram family
+     *
+     * Series share the family bucket layout unless another one is given on 'Add(labels, layout)'. Counts are
+     * atomic and there is no per-series boundaries copy, so it suits high-cardinality histogram families.
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param layout Bucket layout (@see registerBucketLayout())
+     * @param labels Family definition labels
+     *
+     * @see addHistogramFamily()
+     */
+    layout_histogram_family_t& addLayoutHistogramFamily(const std::string &name, const std::string &help, const bucket_layout_t &layout, const labels_t &labels = {});
+
+    /**
+     * Add exponential (sparse) histogram family
+     *
+     * No bucket boundaries are needed: buckets are powers of 2^(2^-schema) (i.e. schema 3 means ~9% relative
+     * width), their index is computed in constant time and only populated buckets take memory:
+     *
+     * <pre>
+     * ert::metrics::exponential_histogram_t *latency_ = &(metrics->addExponentialHistogramFamily("latency_seconds", "Requests latency").Add({{"method", "POST"}}));
+     * ...
+     * latency_->Observe(elapsed);
+     * </pre>
+     *
+     * Series are exposed as conventional histograms (one 'le' bucket per populated bucket), and also provide
+     * their native histogram representation (schema, spans and deltas).
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     * @param config Histograms configuration (schema, zero threshold and maximum number of buckets)
+     *
+     * @see addHistogramFamily()
+     */
+    exponential_histogram_family_t& addExponentialHistogramFamily(const std::string &name, const std::string &help, const labels_t &labels = {}, const exponential_histogram_config_t &config = {});
+
+    /**
+     * Add summary family
+     *
+     * Summaries expose configured quantiles over a sliding time window (i.e. p99 for last 60 seconds), computed
+     * from mergeable DDSketch sketches with bounded memory and relative error guarantee. Observation never allocates,
+     * so they may be used on request hot paths:
+     *
+     * <pre>
+     * ert::metrics::summary_config_t config;
+     * config.quantiles = {0.5, 0.99, 0.999};
+     * ert::metrics::summary_t *latency_ = &(metrics->addSummaryFamily("latency_seconds", "Requests latency", {}, config).Add({{"method", "POST"}}));
+     * ...
+     * latency_->Observe(elapsed);
+     * </pre>
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     * @param config Summaries configuration (quantiles, window, accuracy and memory)
+     */
+    summary_family_t& addSummaryFamily(const std::string &name, const std::string &help, const labels_t &labels = {}, const summary_config_t &config = {});
+
+    /**
+     * Add callback gauge family
+     *
+     * Series values are computed by callbacks when metrics are scraped, so sizes which change constantly (queues,
+     * pools) cost nothing between scrapes. Registrations remove their series when destroyed:
+     *
+     * <pre>
+     * metrics->addCallbackGaugeFamily("queue_depth", "Pending jobs", {}, std::chrono::milliseconds(500));
+     * ...
+     * // owner object member (destroyed with it):
+     * ert::metrics::CallbackGaugeRegistration depth_ = metrics->registerGaugeCallback("queue_depth", {{"queue", "io"}}, [this]() { return queue_.size(); });
+     * </pre>
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     * @param cacheTtl Time during which evaluated values are reused by later scrapes (zero: evaluated on every scrape)
+     *
+     * @see CallbackGaugeFamily
+     */
+    callback_gauge_family_t& addCallbackGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels = {}, std::chrono::milliseconds cacheTtl = std::chrono::milliseconds(0));
+
+    /**
+     * Register gauge callback on a callback gauge family (@see addCallbackGaugeFamily())
+     *
+     * @param familyName Family name
+     * @param labels Additional labels
+     * @param callback Function returning the series value (evaluated on scrape)
+     *
+     * @return Registration (keep it while the callback is valid), invalid if family is not found or labels are
+     * not valid or already registered
+     */
+    CallbackGaugeRegistration registerGaugeCallback(const std::string &familyName, const labels_t &labels, gauge_callback_t callback);
+
+    /**
+     * Add typed counter family
+     *
+     * Label dimensions are enumerations with known value sets (@see label_traits), so every series is created here
+     * and then accessed by array index:
+     *
+     * <pre>
+     * auto requests = metrics->addTypedCounterFamily<Method, StatusClass>("requests_total", "Requests processed");
+     * ...
+     * requests.get(Method::POST, StatusClass::Success).Increment();
+     * </pre>
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     *
+     * @see TypedFamily
+     */
+    template <typename... Es>
+    TypedCounterFamily<Es...> addTypedCounterFamily(const std::string &name, const std::string &help, const labels_t &labels = {}) {
+        return TypedCounterFamily<Es...>(addCounterFamily(name, help, labels));
+    }
+
+    /**
+     * Add typed gauge family
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param labels Family definition labels
+     *
+     * @see addTypedCounterFamily()
+     */
+    template <typename... Es>
+    TypedGaugeFamily<Es...> addTypedGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels = {}) {
+        return TypedGaugeFamily<Es...>(addGaugeFamily(name, help, labels));
+    }
+
+    /**
+     * Add typed histogram family
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param bucketBoundaries Bucket boundaries used by every series
+     * @param labels Family definition labels
+     *
+     * @see addTypedCounterFamily()
+     */
+    template <typename... Es>
+    TypedHistogramFamily<Es...> addTypedHistogramFamily(const std::string &name, const std::string &help, const bucket_boundaries_t &bucketBoundaries, const labels_t &labels = {}) {
+        return TypedHistogramFamily<Es...>(addHistogramFamily(name, help, labels), {}, bucketBoundaries);
+    }
+
     /**
      * Increase counter
      *
      * Dynamic labels could be added, but take into account the performance impact doing this. It is better to create all the combinations at the beginning.
      * This must be used only with unpredictable labels, which will be appended to the labels that were used to create the family (static initial labels).
+     * Label values are not interned (@see LabelSet), and sets with more than @see label_set_capacity labels are updated on the family without caching.
      *
      * @param name Family name
      * @param labels Additional labels
      * @param value Increase amount
      */
-    void increaseCounter(const std::string &familyName, const labels_t &labels, double value = 1.0);
+    void increaseCounter(const std::string &familyName, const labels_t &labels, double value = 1.0) {
+        updateCounter(familyName, labels, value);
+    }
+
+    /**
+     * Increase counter (label set: no allocation when the series exists, @see LabelSet)
+     */
+    template <typename L, if_label_set_t<L> = 0>
+    void increaseCounter(const std::string &familyName, const L &labels, double value = 1.0) {
+        updateCounter(familyName, labels, value);
+    }
 
     /**
      * Update gauge
@@ -265,7 +1138,17 @@ public:
      * @param labels Additional labels
      * @param value Instant current value
      */
-    void setGauge(const std::string &familyName, const labels_t &labels, double value);
+    void setGauge(const std::string &familyName, const labels_t &labels, double value) {
+        updateGauge(familyName, labels, value);
+    }
+
+    /**
+     * Update gauge (label set: no allocation when the series exists, @see LabelSet)
+     */
+    template <typename L, if_label_set_t<L> = 0>
+    void setGauge(const std::string &familyName, const L &labels, double value) {
+        updateGauge(familyName, labels, value);
+    }
 
     /**
      * Observe histogram
@@ -278,7 +1161,174 @@ public:
      * @param value Observed value
      * @param bucketBoundaries Reference to the bucket boundaries used
      */
-    void observeHistogram(const std::string &familyName, const labels_t &labels, double value, const bucket_boundaries_t & bucketBoundaries);
+    void observeHistogram(const std::string &familyName, const labels_t &labels, double value, const bucket_boundaries_t & bucketBoundaries) {
+        updateHistogram(familyName, labels, value, bucketBoundaries);
+    }
+
+    /**
+     * Observe histogram (label set: no allocation when the series exists, @see LabelSet)
+     */
+    template <typename L, if_label_set_t<L> = 0>
+    void observeHistogram(const std::string &familyName, const L &labels, double value, const bucket_boundaries_t & bucketBoundaries) {
+        updateHistogram(familyName, labels, value, bucketBoundaries);
+    }
+
+    /**
+     * Resolve counter handle
+     *
+     * Family and labels are resolved once, and the returned handle updates the series directly:
+     *
+     * <pre>
+     * // constructor
+     * ert::metrics::CounterHandle post_requests_ = metrics->counterHandle("admin_server_observed_requests_total", {{"method", "POST"}});
+     * ...
+     * // source code
+     * post_requests_.increment(); // no lock, no lookup
+     * </pre>
+     *
+     * Resolved series are cached, so 'increaseCounter()' shares them and this can also be called with dynamic labels
+     * (cost is then a single lookup, as the string-based API).
+     *
+     * @param familyName Family name
+     * @param labels Additional labels
+     *
+     * @return Counter handle, invalid if family is not found or labels are not valid
+     */
+    CounterHandle counterHandle(const std::string &familyName, const labels_t &labels = {}) {
+        return resolveCounter(familyName, labels);
+    }
+
+    /** Resolve counter handle (label set) */
+    template <typename L, if_label_set_t<L> = 0>
+    CounterHandle counterHandle(const std::string &familyName, const L &labels) {
+        return resolveCounter(familyName, labels);
+    }
+
+    /**
+     * Resolve gauge handle
+     *
+     * @param familyName Family name
+     * @param labels Additional labels
+     *
+     * @return Gauge handle, invalid if family is not found or labels are not valid
+     *
+     * @see counterHandle()
+     */
+    GaugeHandle gaugeHandle(const std::string &familyName, const labels_t &labels = {}) {
+        return resolveGauge(familyName, labels);
+    }
+
+    /** Resolve gauge handle (label set) */
+    template <typename L, if_label_set_t<L> = 0>
+    GaugeHandle gaugeHandle(const std::string &familyName, const L &labels) {
+        return resolveGauge(familyName, labels);
+    }
+
+    /**
+     * Resolve histogram handle
+     *
+     * Bucket boundaries are only used when the series is created (first resolution).
+     *
+     * @param familyName Family name
+     * @param labels Additional labels
+     * @param bucketBoundaries Reference to the bucket boundaries used
+     *
+     * @return Histogram handle, invalid if family is not found or labels are not valid
+     *
+     * @see counterHandle()
+     */
+    HistogramHandle histogramHandle(const std::string &familyName, const labels_t &labels, const bucket_boundaries_t & bucketBoundaries) {
+        return resolveHistogram(familyName, labels, bucketBoundaries);
+    }
+
+    /** Resolve histogram handle (label set) */
+    template <typename L, if_label_set_t<L> = 0>
+    HistogramHandle histogramHandle(const std::string &familyName, const L &labels, const bucket_boundaries_t & bucketBoundaries) {
+        return resolveHistogram(familyName, labels, bucketBoundaries);
+    }
+
+    /**
+     * Enable asynchronous updates
+     *
+     * Updates pushed with 'push()' are enqueued into a bounded lock-free queue, and a background aggregator
+     * thread resolves their series (dynamic labels included) and applies them in batches. So the caller cost is a
+     * single enqueue, and registry mutations never happen on the caller thread:
+     *
+     * <pre>
+     * metrics->enableAsync();
+     * ert::metrics::async_family_t responses = metrics->asyncCounterFamily("responses_total");
+     * ...
+     * metrics->push(responses, {{"status_code", std::to_string(status_code)}});
+     * </pre>
+     *
+     * Dropped updates (queue full with 'Drop' overflow policy) are counted in 'ert_metrics_async_dropped_total'.
+     * Updates are applied in order, but later than pushed: use 'flushAsync()' to wait for them.
+     *
+     * @param config Queue configuration (capacity, overflow policy and batch size)
+     *
+     * @return false if already enabled
+     */
+    bool enableAsync(const async_config_t &config = {});
+
+    /**
+     * Resolve counter family for asynchronous updates
+     *
+     * @param familyName Family name
+     *
+     * @return Family identifier, invalid if family is not found
+     */
+    async_family_t asyncCounterFamily(const std::string &familyName);
+
+    /**
+     * Resolve gauge family for asynchronous updates
+     *
+     * @param familyName Family name
+     *
+     * @return Family identifier, invalid if family is not found
+     */
+    async_family_t asyncGaugeFamily(const std::string &familyName);
+
+    /**
+     * Resolve histogram family for asynchronous updates
+     *
+     * @param familyName Family name
+     * @param bucketBoundaries Bucket boundaries used for the series created by asynchronous updates (copied)
+     *
+     * @return Family identifier, invalid if family is not found
+     */
+    async_family_t asyncHistogramFamily(const std::string &familyName, const bucket_boundaries_t &bucketBoundaries);
+
+    /**
+     * Push update: counter increase, gauge value or histogram observation, depending on the family.
+     * Applied synchronously if asynchronous updates are not enabled.
+     *
+     * @param family Family identifier
+     * @param labels Additional labels, converted to a label set (keys interned, values copied inline: no allocation
+     * for known keys and values within @see label_set_storage). Sets larger than @see label_set_capacity are
+     * copied as a map (allocates on the caller thread).
+     * @param value Update value
+     *
+     * @return false if the update was dropped (queue full, or invalid family)
+     */
+    bool push(const async_family_t &family, const labels_t &labels, double value = 1.0) {
+        if (labels.size() > label_set_capacity) {
+            AsyncRecord record{family, {}, labels, value};
+            return enqueue(record);
+        }
+
+        AsyncRecord record{family, LabelSet(labels), {}, value};
+        return enqueue(record);
+    }
+
+    /** Push update (label set: no allocation, @see LabelSet) */
+    template <typename L, if_label_set_t<L> = 0>
+    bool push(const async_family_t &family, const L &labels, double value = 1.0) {
+        AsyncRecord record{family, labels, {}, value};
+        return enqueue(record);
+    }
+
+    /** Wait until every update pushed before this call has been applied */
+    void flushAsync();
 };
 
 }
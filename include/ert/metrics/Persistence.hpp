@@ -0,0 +1,135 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/metric_family.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Series values restored from a checkpoint (@see CheckpointStore) */
+struct persisted_series_t {
+    labels_t labels;
+    double value{}; // counters
+    bucket_boundaries_t bounds; // histograms
+    std::vector<double> counts; // histograms: per bucket (not cumulative), '+Inf' included
+    double sum{}; // histograms
+};
+
+/** Family values restored from a checkpoint (@see CheckpointStore) */
+struct persisted_family_t {
+    prometheus::MetricType type{};
+    std::string name;
+    std::vector<persisted_series_t> series;
+};
+
+/**
+ * Crash-consistent checkpoints of counter and histogram families, double-buffered on two memory-mapped files
+ * ('<path>.0' and '<path>.1') written alternately.
+ *
+ * Every checkpoint has a header with generation, payload size and checksum. The header is completed (and
+ * synced) after the payload, so a crash while checkpointing leaves the previous checkpoint valid in the
+ * other file. Loading picks the valid checkpoint with the highest generation.
+ *
+ * Not thread-safe: used by one thread at a time (@see Metrics::enablePersistence()).
+ */
+class CheckpointStore {
+
+    struct File {
+        int fd{-1};
+        unsigned char *base{};
+        std::size_t size{};
+    };
+
+    std::string path_;
+    File files_[2];
+    std::uint64_t generation_;
+    std::size_t next_; // file written on next checkpoint
+    std::vector<unsigned char> buffer_; // serialization buffer (reused)
+
+    bool reserve(File &file, std::size_t size);
+
+public:
+
+    /**
+     * Constructor: opens (or creates) checkpoint files
+     *
+     * @param path Checkpoint files path prefix
+     *
+     * @throw std::runtime_error if files cannot be opened
+     */
+    explicit CheckpointStore(const std::string &path);
+
+    /** Destructor: unmaps and closes files */
+    ~CheckpointStore();
+
+    CheckpointStore(const CheckpointStore&) = delete;
+    CheckpointStore& operator=(const CheckpointStore&) = delete;
+
+    /**
+     * Load latest valid checkpoint
+     *
+     * @param families Restored families (counters and histograms)
+     *
+     * @return False if there is no valid checkpoint
+     */
+    bool load(std::vector<persisted_family_t> &families);
+
+    /**
+     * Write checkpoint
+     *
+     * @param families Collected counter and histogram families (other types are ignored)
+     *
+     * @return False on failure (logged): previous checkpoint remains valid
+     */
+    bool save(const std::vector<prometheus::MetricFamily> &families);
+
+    /** Generation of the last checkpoint loaded or written (zero if none) */
+    std::uint64_t generation() const {
+        return generation_;
+    }
+};
+
+}
+}
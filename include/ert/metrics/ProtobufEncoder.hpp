@@ -0,0 +1,85 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <prometheus/metric_family.h>
+#include <string>
+#include <vector>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Protobuf exposition encoder: length-delimited 'io.prometheus.client.MetricFamily' messages (the format
+ * negotiated by Prometheus with 'application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily;
+ * encoding=delimited').
+ *
+ * Messages are written by hand (wire format), so no protobuf runtime is needed. Scratch buffers for nested
+ * messages are kept between scrapes. Histogram '+Inf' buckets are implicit (sample count), as in the reference
+ * clients. Exponential histograms captured while collecting (@see NativeHistogramCapture) are also encoded as
+ * native histograms (schema, zero bucket, spans and deltas), next to their conventional buckets.
+ *
+ * Not thread-safe: each instance must be used by one scrape at a time.
+ */
+class ProtobufEncoder {
+
+    std::string family_;
+    std::string metric_;
+    std::string field_;
+    std::string item_;
+
+public:
+
+    /** Content type */
+    static const char *contentType() {
+        return "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; encoding=delimited";
+    }
+
+    /**
+     * Encode families appending to output buffer
+     *
+     * @param families Collected families
+     * @param out Output buffer (appended)
+     */
+    void encode(const std::vector<prometheus::MetricFamily> &families, std::string &out);
+};
+
+}
+}
+
@@ -0,0 +1,224 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ert/metrics/Sharded.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Read-mostly map (string keys): append-only open-addressing table of entry pointers (RCU style).
+ *
+ * Lookups are wait-free (atomic load of the table plus probing of atomic slots, which only go from empty to
+ * an entry). Insertions store the new entry in a free slot, without stalling readers. When the table is half
+ * full, a table twice as large is built with the same entries (never copied) and published. Values are never
+ * removed, and retired tables are released together with the map: memory stays linear in the number of
+ * entries (retired tables add up to less than the current one). This is intended for data which is written at
+ * startup and read on every operation (i.e. metric families).
+ */
+template <typename V>
+class ReadMostlyMap {
+
+    struct Entry {
+        std::string key;
+        std::size_t hash;
+        V *value;
+    };
+
+    struct Table {
+        explicit Table(std::size_t capacity) : slots(new std::atomic<const Entry*>[capacity]()), mask(capacity - 1) {}
+
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+        std::size_t mask;
+    };
+
+    static constexpr std::size_t initial_capacity = 16;
+
+    std::atomic<const Table*> current_;
+
+    std::mutex writers_mutex_;
+    std::size_t size_{};
+    std::vector<std::unique_ptr<const Table>> tables_; // current and retired ones
+    std::vector<std::unique_ptr<const Entry>> entries_;
+    std::vector<std::unique_ptr<V>> values_;
+
+    // Free slot, or slot of the key (writers mutex held when inserting):
+    static std::atomic<const Entry*> &probe(const Table &table, const std::string &key, std::size_t hash) {
+        for (std::size_t k = hash & table.mask;; k = (k + 1) & table.mask) {
+            const Entry *entry = table.slots[k].load(std::memory_order_acquire);
+            if (!entry || (entry->hash == hash && entry->key == key)) return table.slots[k];
+        }
+    }
+
+public:
+
+    ReadMostlyMap() {
+        tables_.emplace_back(new Table(initial_capacity));
+        current_.store(tables_.back().get(), std::memory_order_release);
+    }
+
+    ReadMostlyMap(const ReadMostlyMap&) = delete;
+    ReadMostlyMap& operator=(const ReadMostlyMap&) = delete;
+
+    /**
+     * Find value (wait-free)
+     *
+     * @param key Key to find
+     *
+     * @return Value or nullptr if missing
+     */
+    V *find(const std::string &key) const {
+        const Entry *entry = probe(*current_.load(std::memory_order_acquire), key, std::hash<std::string>()(key)).load(std::memory_order_acquire);
+        return entry ? entry->value : nullptr;
+    }
+
+    /**
+     * Insert value if key is missing
+     *
+     * @param key Key to insert
+     * @param make Value factory (returning std::unique_ptr<V>), only called when the key is missing
+     *
+     * @return Pair with stored value and boolean which is true if the value was inserted
+     */
+    template <typename F>
+    std::pair<V*, bool> insert(const std::string &key, F &&make) {
+        std::lock_guard<std::mutex> lock(writers_mutex_);
+
+        const std::size_t hash = std::hash<std::string>()(key);
+        const Table *table = current_.load(std::memory_order_relaxed);
+        if (const Entry *entry = probe(*table, key, hash).load(std::memory_order_relaxed)) return std::make_pair(entry->value, false);
+
+        std::unique_ptr<V> value = make();
+        V *result = value.get();
+        values_.push_back(std::move(value));
+        entries_.emplace_back(new Entry{key, hash, result});
+        const Entry *entry = entries_.back().get();
+
+        // Larger table (half full at most, so probes stay short), published once filled:
+        if (2 * (size_ + 1) > table->mask + 1) {
+            std::unique_ptr<Table> larger(new Table(2 * (table->mask + 1)));
+            for (std::size_t k = 0; k <= table->mask; k++) {
+                if (const Entry *item = table->slots[k].load(std::memory_order_relaxed)) {
+                    probe(*larger, item->key, item->hash).store(item, std::memory_order_relaxed);
+                }
+            }
+            table = larger.get();
+            tables_.push_back(std::move(larger));
+        }
+
+        probe(*table, key, hash).store(entry, std::memory_order_release);
+        current_.store(table, std::memory_order_release);
+        size_++;
+
+        return std::make_pair(result, true);
+    }
+
+    /**
+     * Visit every value
+     *
+     * @param visitor Function called with key and value
+     */
+    template <typename F>
+    void forEach(F &&visitor) const {
+        const Table *table = current_.load(std::memory_order_acquire);
+        for (std::size_t k = 0; k <= table->mask; k++) {
+            if (const Entry *entry = table->slots[k].load(std::memory_order_acquire)) visitor(entry->key, *entry->value);
+        }
+    }
+};
+
+/**
+ * Striped shared mutex (big-reader lock): readers only lock the cache-line-padded reader-writer mutex of their
+ * own shard (@see currentShard()) in shared mode, so readers on different shards do not share cache lines, and
+ * readers on the same shard do not exclude each other. Writers lock every shard exclusively.
+ *
+ * Meets the SharedMutex requirements used by std::shared_lock and std::unique_lock.
+ */
+class StripedSharedMutex {
+
+    struct alignas(cache_line_size) Slot {
+        std::shared_mutex mutex;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_;
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param shards Number of reader slots, rounded up to a power of two. Zero means @see defaultShards()
+     */
+    explicit StripedSharedMutex(std::size_t shards = 0);
+
+    StripedSharedMutex(const StripedSharedMutex&) = delete;
+    StripedSharedMutex& operator=(const StripedSharedMutex&) = delete;
+
+    void lock_shared() {
+        slots_[currentShard() & mask_].mutex.lock_shared();
+    }
+
+    bool try_lock_shared() {
+        return slots_[currentShard() & mask_].mutex.try_lock_shared();
+    }
+
+    void unlock_shared() {
+        slots_[currentShard() & mask_].mutex.unlock_shared();
+    }
+
+    void lock();
+
+    bool try_lock();
+
+    void unlock();
+};
+
+}
+}
+
@@ -0,0 +1,421 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/check_names.h>
+#include <prometheus/client_metric.h>
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <prometheus/metric_type.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <ert/metrics/SlabPool.hpp>
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Series collection for scrapes: 'Collect()' of the series with the given labels. Series types exposing more
+ * than a client metric specialize it (@see ExponentialHistogram).
+ */
+template <typename T>
+struct series_collector_t {
+    static prometheus::ClientMetric collect(const T &series, const std::string &family, std::vector<prometheus::ClientMetric::Label> &&labels) {
+        (void)family;
+        prometheus::ClientMetric metric = series.Collect();
+        metric.label = std::move(labels);
+        return metric;
+    }
+};
+
+/**
+ * Family of series implemented by this library (not by prometheus-cpp).
+ *
+ * It mimics prometheus::Family<T>: series are created by 'Add()' (same labels return the same series, whose
+ * reference is stable until 'Remove()'), and the whole family is a collectable registered by Metrics class
+ * on the exposer. Series type must provide 'prometheus::ClientMetric Collect() const'.
+ *
+ * Writers never wait for scrapes: series are published into slots of chunks which are never moved, and
+ * 'Collect()' walks them without locks. Each scrape starts a new epoch and only exposes series added before
+ * it, so series added meanwhile are published to the next one. Removed series are released once scrapes in
+ * progress are over. The series set of a scrape is consistent (an epoch), and its values are read back to back
+ * once labels are prepared, so the scrape window between the first and the last value read only covers the
+ * reads themselves. Writers are not frozen, so values are not an atomic point in time across series: a scrape
+ * may still include an update of one series and miss an earlier update of another.
+ *
+ * Series may be allocated from slab pools instead of the heap (@see series_storage_t): freed slots are
+ * recycled, and family nodes are packed so scrapes walk contiguous memory.
+ */
+template <typename T>
+class SeriesFamily : public prometheus::Collectable {
+
+public:
+
+    /** Series factory, used to create series when 'Add()' receives no constructor arguments */
+    typedef std::function<std::unique_ptr<T>()> factory_t;
+
+private:
+
+    struct Node {
+        labels_t labels;
+        T *series;
+        std::uint64_t epoch;
+        bool pooled; // series allocated from the slab pool
+    };
+
+    // Chunk k holds (first_chunk_size << k) slots:
+    static constexpr std::size_t chunks = 40;
+    static constexpr std::size_t first_chunk_size = 64;
+
+    std::string name_;
+    std::string help_;
+    prometheus::MetricType type_;
+    labels_t constant_labels_;
+    factory_t factory_;
+    std::unique_ptr<SlabPool> series_pool_; // empty for heap storage
+    std::unique_ptr<SlabPool> node_pool_;
+
+    std::array<std::atomic<std::atomic<Node*>*>, chunks> chunks_{};
+    std::atomic<std::size_t> published_{0}; // slots in use
+    mutable std::atomic<std::uint64_t> epoch_{0};
+    mutable std::atomic<std::size_t> scrapes_{0}; // in progress
+
+    mutable std::mutex mutex_; // writers: protects everything below
+    std::map<labels_t, std::size_t> index_; // labels to slot
+    std::unordered_map<const T*, std::size_t> slots_; // series to slot (@see Remove())
+    std::vector<std::size_t> free_; // slots of removed series
+    mutable std::vector<Node*> retired_; // removed series, released when no scrape is in progress
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param name Family name
+     * @param help Family help description
+     * @param type Prometheus metric type exposed on scrape
+     * @param labels Family definition labels
+     * @param factory Series factory for family-wide settings. Empty to default-construct series.
+     * @param storage Series storage. Slab storage applies to series constructed by this class (not by the factory).
+     *
+     * @throw std::invalid_argument on invalid family or label names
+     */
+    SeriesFamily(const std::string &name, const std::string &help, prometheus::MetricType type, const labels_t &labels = {}, factory_t factory = nullptr,
+                 series_storage_t storage = series_storage_t::Heap)
+        : name_(name), help_(help), type_(type), constant_labels_(labels), factory_(std::move(factory)) {
+        if (storage != series_storage_t::Heap) {
+            series_pool_.reset(new SlabPool(sizeof(T), alignof(T), storage == series_storage_t::Padded));
+            node_pool_.reset(new SlabPool(sizeof(Node), alignof(Node), false)); // walked on scrapes
+        }
+
+        if (!prometheus::CheckMetricName(name_)) {
+            throw std::invalid_argument("Invalid metric name");
+        }
+        for (const auto &label: constant_labels_) {
+            if (!prometheus::CheckLabelName(label.first)) {
+                throw std::invalid_argument("Invalid label name");
+            }
+        }
+    }
+
+    ~SeriesFamily() {
+        reclaim(true);
+        for (std::size_t k = 0; k < chunks; k++) {
+            std::atomic<Node*> *chunk = chunks_[k].load(std::memory_order_relaxed);
+            if (!chunk) continue;
+            for (std::size_t i = 0; i < (first_chunk_size << k); i++) {
+                if (Node *node = chunk[i].load(std::memory_order_relaxed)) destroy(node);
+            }
+            delete [] chunk;
+        }
+    }
+
+    SeriesFamily(const SeriesFamily&) = delete;
+    SeriesFamily& operator=(const SeriesFamily&) = delete;
+
+private:
+
+    // Series construction: slab slot, unless created by the family factory
+    template <typename... Args>
+    T *construct(bool &pooled, Args&&... args) {
+        pooled = false;
+        if constexpr (sizeof...(Args) == 0) {
+            if (factory_) return factory_().release();
+        }
+
+        if constexpr (sizeof...(Args) == 0 && !std::is_default_constructible<T>::value) {
+            throw std::invalid_argument("Missing series constructor arguments");
+        }
+        else {
+            if (!series_pool_) return new T(std::forward<Args>(args)...);
+
+            void *memory = series_pool_->allocate();
+            try {
+                T *result = new (memory) T(std::forward<Args>(args)...);
+                pooled = true;
+                return result;
+            }
+            catch(...) {
+                series_pool_->release(memory);
+                throw;
+            }
+        }
+    }
+
+    Node *newNode(const labels_t &labels, T *series, bool pooled) {
+        const std::uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        if (!node_pool_) return new Node{labels, series, epoch, pooled};
+
+        void *memory = node_pool_->allocate();
+        try {
+            return new (memory) Node{labels, series, epoch, pooled};
+        }
+        catch(...) {
+            node_pool_->release(memory);
+            throw;
+        }
+    }
+
+    void destroy(T *series, bool pooled) const {
+        if (!pooled) {
+            delete series;
+            return;
+        }
+        series->~T();
+        series_pool_->release(series);
+    }
+
+    void destroy(Node *node) const {
+        destroy(node->series, node->pooled);
+        if (!node_pool_) {
+            delete node;
+            return;
+        }
+        node->~Node();
+        node_pool_->release(node);
+    }
+
+    // Slot position: chunk k starts at first_chunk_size * (2^k - 1)
+    static std::pair<std::size_t, std::size_t> position(std::size_t slot) {
+        std::size_t k = 0;
+        while ((first_chunk_size << (k + 1)) - first_chunk_size <= slot) k++;
+        return {k, slot - ((first_chunk_size << k) - first_chunk_size)};
+    }
+
+    std::atomic<Node*> &slot(std::size_t index) const {
+        auto pos = position(index);
+        return chunks_[pos.first].load(std::memory_order_acquire)[pos.second];
+    }
+
+    // Releases retired series unless a scrape is in progress (writers mutex held)
+    void reclaim(bool force = false) const {
+        if (retired_.empty() || (!force && scrapes_.load(std::memory_order_seq_cst) != 0)) return;
+        for (Node *node: retired_) destroy(node);
+        retired_.clear();
+    }
+
+public:
+
+    /** Family name */
+    const std::string &name() const {
+        return name_;
+    }
+
+    /** Family definition labels */
+    const labels_t &constantLabels() const {
+        return constant_labels_;
+    }
+
+    /**
+     * Add series (or get the existing one for these labels)
+     *
+     * @param labels Additional labels
+     * @param args Series constructor arguments (only used on creation). When missing, the family factory is used.
+     *
+     * @throw std::invalid_argument on invalid label names
+     */
+    template <typename... Args>
+    T &Add(const labels_t &labels, Args&&... args) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reclaim();
+
+        auto it = index_.find(labels);
+        if (it != index_.end()) {
+            return *(slot(it->second).load(std::memory_order_relaxed)->series);
+        }
+
+        for (const auto &label: labels) {
+            if (!prometheus::CheckLabelName(label.first)) {
+                throw std::invalid_argument("Invalid label name");
+            }
+        }
+
+        // Slot first, so nothing is built if the family is full:
+        const bool recycled = !free_.empty();
+        const std::size_t index = recycled ? free_.back() : published_.load(std::memory_order_relaxed);
+        if (!recycled) {
+            auto pos = position(index);
+            if (pos.first >= chunks) throw std::length_error("Too many series");
+            if (!chunks_[pos.first].load(std::memory_order_relaxed)) {
+                chunks_[pos.first].store(new std::atomic<Node*>[first_chunk_size << pos.first](), std::memory_order_release);
+            }
+        }
+
+        bool pooled;
+        T *series = construct(pooled, std::forward<Args>(args)...);
+
+        Node *node;
+        try {
+            node = newNode(labels, series, pooled);
+        }
+        catch(...) {
+            destroy(series, pooled);
+            throw;
+        }
+
+        if (recycled) free_.pop_back();
+        try {
+            slots_.emplace(series, index);
+            index_.emplace(labels, index);
+        }
+        catch(...) {
+            slots_.erase(series);
+            if (recycled) free_.push_back(index);
+            destroy(node);
+            throw;
+        }
+        slot(index).store(node, std::memory_order_release);
+        if (index == published_.load(std::memory_order_relaxed)) published_.store(index + 1, std::memory_order_release);
+
+        return *series;
+    }
+
+    /**
+     * Remove series
+     *
+     * References to the series become invalid.
+     *
+     * @param series Series to remove
+     */
+    void Remove(T *series) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = slots_.find(series);
+        if (it != slots_.end()) {
+            std::atomic<Node*> &item = slot(it->second);
+            Node *node = item.load(std::memory_order_relaxed);
+
+            item.store(nullptr, std::memory_order_seq_cst);
+            free_.push_back(it->second);
+            index_.erase(node->labels);
+            slots_.erase(it);
+            retired_.push_back(node);
+        }
+
+        reclaim();
+    }
+
+    /** Number of series */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return index_.size();
+    }
+
+    /** Collect family for scrape (lock-free: series added meanwhile are left for the next scrape) */
+    std::vector<prometheus::MetricFamily> Collect() const override {
+        scrapes_.fetch_add(1, std::memory_order_seq_cst);
+        const std::uint64_t epoch = epoch_.fetch_add(1, std::memory_order_acq_rel);
+        const std::size_t published = published_.load(std::memory_order_acquire);
+
+        prometheus::MetricFamily family;
+        family.name = name_;
+        family.help = help_;
+        family.type = type_;
+
+        // Series of the epoch and their labels first (allocations), so values are then read back to back:
+        std::vector<const Node*> nodes;
+        std::vector<std::vector<prometheus::ClientMetric::Label>> labels;
+        nodes.reserve(published);
+        labels.reserve(published);
+        for (std::size_t k = 0; k < published; k++) {
+            const Node *node = slot(k).load(std::memory_order_acquire);
+            if (!node || node->epoch > epoch) continue;
+
+            nodes.push_back(node);
+            labels.emplace_back();
+            labels.back().reserve(constant_labels_.size() + node->labels.size());
+            for (const auto &label: constant_labels_) {
+                labels.back().push_back({label.first, label.second});
+            }
+            for (const auto &label: node->labels) {
+                labels.back().push_back({label.first, label.second});
+            }
+        }
+
+        family.metric.reserve(nodes.size());
+        for (std::size_t k = 0; k < nodes.size(); k++) {
+            family.metric.push_back(series_collector_t<T>::collect(*nodes[k]->series, name_, std::move(labels[k])));
+        }
+
+        // Last scrape out releases removed series, unless a writer is busy (it will do it later):
+        if (scrapes_.fetch_sub(1, std::memory_order_seq_cst) == 1 && mutex_.try_lock()) {
+            reclaim();
+            mutex_.unlock();
+        }
+
+        if (family.metric.empty()) return {};
+        return {std::move(family)};
+    }
+};
+
+}
+}
+
@@ -0,0 +1,168 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include <ert/metrics/SeriesFamily.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Cache line size assumed for padding */
+constexpr std::size_t cache_line_size = 64;
+
+/**
+ * Shard index for the calling thread.
+ * Threads get consecutive indexes on first use, so up to 'shards' threads never share a slot.
+ */
+std::size_t currentShard();
+
+/** Default shards number: hardware concurrency rounded up to a power of two */
+std::size_t defaultShards();
+
+/**
+ * Striped value: one cache-line-padded slot per shard. Writers only touch the slot of their own shard,
+ * and slots are summed on read (scrape).
+ */
+class StripedValue {
+
+    struct alignas(cache_line_size) Slot {
+        std::atomic<double> value{0.0};
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_;
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param shards Number of slots, rounded up to a power of two. Zero means @see defaultShards()
+     */
+    explicit StripedValue(std::size_t shards = 0);
+
+    /** Add amount to the slot of the calling thread */
+    void add(double value) {
+        auto &slot = slots_[currentShard() & mask_].value;
+        double current = slot.load(std::memory_order_relaxed);
+        while (!slot.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+    }
+
+    /** Sum of all slots */
+    double sum() const;
+
+    /** Number of slots */
+    std::size_t shards() const {
+        return mask_ + 1;
+    }
+};
+
+/**
+ * Sharded counter: monotonically increasing counter without contention between writer threads.
+ * Same interface than prometheus counter, so it may replace 'counter_t' on hot paths.
+ */
+class ShardedCounter {
+    StripedValue value_;
+
+public:
+    explicit ShardedCounter(std::size_t shards = 0) : value_(shards) {}
+
+    /** Increase counter (negative values are ignored) */
+    void Increment(double value = 1.0) {
+        if (value < 0.0) return;
+        value_.add(value);
+    }
+
+    /** Current value (sum of shards) */
+    double Value() const {
+        return value_.sum();
+    }
+
+    /** Collect for scrape */
+    prometheus::ClientMetric Collect() const;
+};
+
+/**
+ * Sharded up/down gauge: value is only changed by increments and decrements (there is no 'Set()' as the
+ * value is spread among shards), i.e. concurrent requests, queue depths, etc.
+ */
+class ShardedGauge {
+    StripedValue value_;
+
+public:
+    explicit ShardedGauge(std::size_t shards = 0) : value_(shards) {}
+
+    /** Increase gauge */
+    void Increment(double value = 1.0) {
+        value_.add(value);
+    }
+
+    /** Decrease gauge */
+    void Decrement(double value = 1.0) {
+        value_.add(-value);
+    }
+
+    /** Current value (sum of shards) */
+    double Value() const {
+        return value_.sum();
+    }
+
+    /** Collect for scrape */
+    prometheus::ClientMetric Collect() const;
+};
+
+/** Sharded counter type */
+typedef ShardedCounter sharded_counter_t;
+
+/** Sharded gauge type */
+typedef ShardedGauge sharded_gauge_t;
+
+/** Sharded counters family */
+typedef SeriesFamily<ShardedCounter> sharded_counter_family_t;
+
+/** Sharded gauges family */
+typedef SeriesFamily<ShardedGauge> sharded_gauge_family_t;
+
+}
+}
+
@@ -0,0 +1,257 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/** Shared segment layout (@see SharedSegment) */
+struct shared_segment_config_t {
+    /** Maximum number of processes writing at the same time (one row each) */
+    std::size_t processes = 64;
+    /** Maximum number of series (name plus labels) */
+    std::size_t slots = 4096;
+    /** Maximum number of histogram bucket boundaries */
+    std::size_t max_buckets = 32;
+};
+
+/** How gauge values written by different processes are merged on scrape */
+enum class gauge_merge_t {
+    Sum, // sum of live processes values
+    Max, // maximum of live processes values
+    PerPid // one series per live process, with an additional 'pid' label
+};
+
+class SharedSegment;
+
+/** Counter series within a shared segment */
+class SharedCounter {
+    SharedSegment *segment_;
+    std::uint32_t slot_;
+
+public:
+    SharedCounter(SharedSegment *segment = nullptr, std::uint32_t slot = 0) : segment_(segment), slot_(slot) {}
+
+    /** Returns true if the series was registered */
+    bool valid() const {
+        return (segment_ != nullptr);
+    }
+
+    /** Increment (non-negative values) */
+    void Increment(double value = 1.0) const;
+};
+
+/** Gauge series within a shared segment: every process sets its own value */
+class SharedGauge {
+    SharedSegment *segment_;
+    std::uint32_t slot_;
+
+public:
+    SharedGauge(SharedSegment *segment = nullptr, std::uint32_t slot = 0) : segment_(segment), slot_(slot) {}
+
+    /** Returns true if the series was registered */
+    bool valid() const {
+        return (segment_ != nullptr);
+    }
+
+    /** Set value for the calling process */
+    void Set(double value) const;
+
+    /** Increment value for the calling process */
+    void Increment(double value = 1.0) const;
+
+    /** Decrement value for the calling process */
+    void Decrement(double value = 1.0) const;
+};
+
+/** Histogram series within a shared segment */
+class SharedHistogram {
+    SharedSegment *segment_;
+    std::uint32_t slot_;
+
+public:
+    SharedHistogram(SharedSegment *segment = nullptr, std::uint32_t slot = 0) : segment_(segment), slot_(slot) {}
+
+    /** Returns true if the series was registered */
+    bool valid() const {
+        return (segment_ != nullptr);
+    }
+
+    /** Observe value */
+    void Observe(double value) const;
+};
+
+/**
+ * Shared memory-mapped metrics segment, for pre-forked (or otherwise cooperating) worker processes exported
+ * from a single endpoint.
+ *
+ * The segment is a file (i.e. under '/dev/shm') mapped by every process, laid out as a fixed table:
+ * > Process table: every process writing claims its own row on first update (rows of finished processes are
+ *   reused), and is identified by its pid.
+ * > Slot table: one descriptor per series (name, help, type, labels, bucket boundaries), appended without
+ *   locks. Registration is meant for start-up: it scans the table.
+ * > Cells: one cache-aligned row of atomic cells per process, so processes never write the same cache line.
+ *
+ * Updates are plain atomic operations on the row of the calling process: no system calls nor locks (the
+ * row is claimed once per process, also in children forked after it was claimed).
+ *
+ * The exporter process registers the segment as a collectable (@see Metrics::registerCollectable()), and
+ * every scrape merges rows: counters and histograms are summed for every process (finished ones included,
+ * so they remain monotonic), and gauges from live processes are merged by the rule given on registration.
+ *
+ * <pre>
+ * // Exporter (before forking workers):
+ * auto segment = std::make_shared<ert::metrics::SharedSegment>("/dev/shm/myapp_metrics", config, true);
+ * metrics.registerCollectable(segment);
+ * metrics.serve();
+ *
+ * // Workers (forked, or opening the same path with 'create = false'):
+ * ert::metrics::SharedCounter requests = segment->counter("requests_total", "Requests", {{"method", "GET"}});
+ * requests.Increment();
+ * </pre>
+ */
+class SharedSegment : public prometheus::Collectable {
+
+public:
+    /** Series type within the segment */
+    enum class Kind : std::uint8_t { Counter = 1, Gauge, Histogram };
+
+private:
+    struct Header;
+    struct Descriptor;
+
+    std::string path_;
+    int fd_;
+    unsigned char *base_;
+    std::size_t size_;
+
+    Header *header_;
+    std::atomic<std::int32_t> *pids_;
+    Descriptor *descriptors_;
+    double *bounds_;
+    std::atomic<std::uint64_t> *cells_;
+    std::size_t processes_, slots_, max_buckets_, row_cells_;
+
+    // Row claimed by this process: fork generation (high bits) and row plus one (low 16 bits, all ones if none)
+    std::atomic<std::uint64_t> row_state_;
+
+    void map(bool create, const shared_segment_config_t &config);
+    std::size_t claimRow();
+    std::uint32_t registerSeries(Kind kind, gauge_merge_t merge, const std::string &name, const std::string &help, const labels_t &labels, const bucket_boundaries_t &bounds);
+
+    friend class SharedCounter;
+    friend class SharedGauge;
+    friend class SharedHistogram;
+
+    /** Cells of a slot within the row of the calling process (nullptr if no row is available) */
+    std::atomic<std::uint64_t> *cells(std::uint32_t slot);
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param path Segment file path (i.e. '/dev/shm/<name>')
+     * @param config Layout (ignored when opening an existing segment)
+     * @param create Create (or truncate) and initialize the segment, or open an existing one
+     *
+     * @throw std::runtime_error if the segment cannot be created, opened or mapped, or it is not valid
+     */
+    SharedSegment(const std::string &path, const shared_segment_config_t &config = {}, bool create = false);
+
+    /** Destructor: unmaps the segment (file is kept, for other processes) */
+    ~SharedSegment();
+
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+
+    /**
+     * Register counter series (or get the existing one)
+     *
+     * @return Counter series, invalid (@see SharedCounter::valid()) if it could not be registered (logged)
+     *
+     * @throw std::invalid_argument on invalid metric or label names
+     */
+    SharedCounter counter(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+    /**
+     * Register gauge series (or get the existing one)
+     *
+     * @param merge Rule to merge values from every process on scrape
+     *
+     * @return Gauge series, invalid (@see SharedGauge::valid()) if it could not be registered (logged)
+     *
+     * @throw std::invalid_argument on invalid metric or label names
+     */
+    SharedGauge gauge(const std::string &name, const std::string &help, const labels_t &labels = {}, gauge_merge_t merge = gauge_merge_t::Sum);
+
+    /**
+     * Register histogram series (or get the existing one)
+     *
+     * @param bucketBoundaries Sorted bucket boundaries (up to configured maximum)
+     *
+     * @return Histogram series, invalid (@see SharedHistogram::valid()) if it could not be registered (logged)
+     *
+     * @throw std::invalid_argument on invalid metric or label names
+     */
+    SharedHistogram histogram(const std::string &name, const std::string &help, const labels_t &labels, const bucket_boundaries_t &bucketBoundaries);
+
+    /** Segment file path */
+    const std::string &path() const {
+        return path_;
+    }
+
+    /** Number of series registered */
+    std::size_t size() const;
+
+    /** Merged view of every process (exporter side) */
+    std::vector<prometheus::MetricFamily> Collect() const override;
+};
+
+}
+}
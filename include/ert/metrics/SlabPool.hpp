@@ -0,0 +1,106 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Series storage for library families (@see SeriesFamily):
+ * > Heap: one heap object per series.
+ * > Packed: series allocated contiguously from slabs (cold series: fast scrape iteration, less memory).
+ * > Padded: series allocated from slabs, each one on its own cache lines (hot series updated from different
+ *   threads: no false sharing).
+ */
+enum class series_storage_t { Heap, Packed, Padded };
+
+/**
+ * Slab pool: fixed-size slots carved from cache-line-aligned slabs, recycled through a free list.
+ * Not thread-safe (owners serialize allocations). Memory is only returned to the system on destruction.
+ */
+class SlabPool {
+
+    struct Free {
+        void operator()(unsigned char *slab) const;
+    };
+
+    std::size_t slot_size_;
+    std::size_t slots_per_slab_;
+    std::vector<std::unique_ptr<unsigned char[], Free>> slabs_;
+    std::size_t used_; // slots used in the last slab
+    std::vector<void*> free_;
+
+public:
+
+    /** Slab size in bytes (at least one slot) */
+    static constexpr std::size_t slab_size = 65536;
+
+    /**
+     * Constructor
+     *
+     * @param size Object size
+     * @param alignment Object alignment (up to cache line size)
+     * @param padded Round slots up to whole cache lines
+     */
+    SlabPool(std::size_t size, std::size_t alignment, bool padded);
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    /** Allocate slot (recycled ones first) */
+    void *allocate();
+
+    /** Return slot to the free list */
+    void release(void *slot) {
+        free_.push_back(slot);
+    }
+
+    /** Slot size in bytes */
+    std::size_t slotSize() const {
+        return slot_size_;
+    }
+};
+
+}
+}
+
@@ -0,0 +1,190 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <ert/metrics/SeriesFamily.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * DDSketch: quantile sketch with relative error guarantee (any quantile value is within 'relative accuracy' of the
+ * exact one), mergeable and with bounded memory (fixed number of logarithmic bins, allocated on construction).
+ * When the range of values exceeds the bins, lowest bins are collapsed (so lowest quantiles lose accuracy first).
+ */
+class DDSketch {
+
+    /** Dense bins for consecutive keys, starting at 'offset' */
+    struct Store {
+        std::vector<std::uint64_t> bins;
+        std::int32_t offset{};
+        std::uint64_t count{};
+
+        void add(std::int32_t key, std::uint64_t n);
+        void clear();
+    };
+
+    double gamma_;
+    double log_gamma_;
+    double min_indexable_;
+
+    Store positive_;
+    Store negative_;
+    std::uint64_t zero_count_{};
+
+    std::int32_t key(double value) const;
+    double value(std::int32_t key) const;
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param relativeAccuracy Relative accuracy (i.e. 0.01 for 1%)
+     * @param maxBins Number of bins for positive values (and the same for negative ones)
+     *
+     * @throw std::invalid_argument for accuracy out of (0, 1) or zero bins
+     */
+    explicit DDSketch(double relativeAccuracy = 0.01, std::size_t maxBins = 2048);
+
+    /** Add value (no allocations) */
+    void add(double value);
+
+    /**
+     * Merge another sketch (no allocations)
+     *
+     * @throw std::invalid_argument if sketches have different accuracy or bins
+     */
+    void merge(const DDSketch &other);
+
+    /** Reset sketch (keeps memory) */
+    void clear();
+
+    /** Number of values added */
+    std::uint64_t count() const {
+        return positive_.count + negative_.count + zero_count_;
+    }
+
+    /**
+     * Estimated quantile value
+     *
+     * @param q Quantile in [0, 1]
+     *
+     * @return Quantile estimation, or NaN if sketch is empty
+     */
+    double quantile(double q) const;
+};
+
+/** Summary configuration */
+struct summary_config_t {
+    /** Quantiles exposed on scrape */
+    std::vector<double> quantiles = {0.5, 0.9, 0.99, 0.999};
+    /** Sliding time window for quantiles */
+    std::chrono::milliseconds window = std::chrono::seconds(60);
+    /** Number of sketches covering the window (rotation granularity is window/age_buckets) */
+    std::size_t age_buckets = 5;
+    /** Sketches relative accuracy */
+    double relative_accuracy = 0.01;
+    /** Sketches bins (bounds memory: 8 bytes per bin, twice per sketch) */
+    std::size_t max_bins = 1024;
+};
+
+/**
+ * Summary backed by DDSketch: quantiles over a sliding time window, with relative error guarantee.
+ *
+ * Each observation goes into the sketch for the current time slice (window/age_buckets). On scrape, the sketches
+ * within the window are merged and quantiles are calculated. Observe path never allocates. Count and sum are
+ * cumulative (not windowed), as usual for Prometheus summaries.
+ */
+class SketchSummary {
+
+    summary_config_t config_;
+    std::int64_t slice_ms_;
+
+    mutable std::mutex mutex_;
+    mutable std::vector<DDSketch> slices_;
+    mutable DDSketch merged_;
+    mutable std::int64_t epoch_; // current slice epoch (time/slice)
+    std::uint64_t count_{};
+    double sum_{};
+
+    void rotate(std::int64_t epoch) const;
+    static std::int64_t nowMs();
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param config Summary configuration
+     *
+     * @throw std::invalid_argument on invalid configuration
+     */
+    explicit SketchSummary(const summary_config_t &config = {});
+
+    /** Observe value (NaN values are ignored) */
+    void Observe(double value);
+
+    /**
+     * Quantile over the sliding window
+     *
+     * @param q Quantile in [0, 1]
+     *
+     * @return Quantile estimation, or NaN if there are no observations within the window
+     */
+    double quantile(double q) const;
+
+    /** Collect for scrape */
+    prometheus::ClientMetric Collect() const;
+};
+
+/** Summary type */
+typedef SketchSummary summary_t;
+
+/** Summaries family */
+typedef SeriesFamily<SketchSummary> summary_family_t;
+
+}
+}
+
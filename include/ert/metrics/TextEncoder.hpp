@@ -0,0 +1,153 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <prometheus/client_metric.h>
+#include <prometheus/metric_family.h>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Incremental text exposition encoder (Prometheus text format 0.0.4, or OpenMetrics text 1.0.0).
+ *
+ * It keeps state between scrapes:
+ * > Family headers (HELP/TYPE) and, for every series, the pre-rendered line prefixes (name, escaped labels,
+ *   'le'/'quantile' labels), so only numeric values are formatted on each scrape.
+ * > The rendered block of every family together with a fingerprint of its labels and values: families which
+ *   did not change since the previous scrape are copied without formatting anything.
+ * Output buffer is provided by the caller, so it can be reused (capacity is kept) across scrapes.
+ * Cached entries for series not seen in the last scrape are dropped when they become the majority.
+ *
+ * Not thread-safe: each instance must be used by one scrape at a time.
+ */
+class TextEncoder {
+
+public:
+
+    /** Exposition format */
+    enum class Format { Text, OpenMetrics };
+
+private:
+
+    struct SeriesEntry {
+        std::vector<prometheus::ClientMetric::Label> labels;
+        std::vector<double> bounds; // bucket upper bounds or quantiles used to build lines
+        std::vector<std::string> lines; // line prefixes (up to the value)
+        std::uint64_t generation{};
+    };
+
+    struct FamilyState {
+        std::string help;
+        prometheus::MetricType type{};
+        std::string header;
+        std::string block;
+        std::uint64_t fingerprint{};
+        std::uint64_t generation{};
+        std::unordered_map<std::uint64_t, SeriesEntry> series;
+    };
+
+    Format format_;
+    std::unordered_map<std::string, FamilyState> families_;
+    std::deque<FamilyState> duplicates_; // families collected twice in the same scrape
+    std::vector<std::string_view> pieces_;
+    std::uint64_t generation_{};
+    std::size_t cached_series_{};
+
+    void prepare(FamilyState &state, const prometheus::MetricFamily &family, std::vector<std::uint64_t> &labelsHashes);
+
+    const SeriesEntry &seriesEntry(FamilyState &state, const prometheus::MetricFamily &family, const prometheus::ClientMetric &metric, std::uint64_t labelsHash);
+    void render(FamilyState &state, const prometheus::MetricFamily &family, const std::vector<std::uint64_t> &labelsHashes);
+    void sweep(std::size_t alive);
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param format Exposition format
+     */
+    explicit TextEncoder(Format format = Format::Text) : format_(format) {}
+
+    /** Exposition format */
+    Format format() const {
+        return format_;
+    }
+
+    /** Content type for the exposition format */
+    const char *contentType() const;
+
+    /**
+     * Render families, returning the output pieces in order (family headers and blocks kept by the encoder),
+     * so they can be written or compressed without joining them first.
+     *
+     * @param families Collected families
+     *
+     * @return Output pieces, valid until the next call
+     */
+    const std::vector<std::string_view> &prepare(const std::vector<prometheus::MetricFamily> &families);
+
+    /**
+     * Encode families appending to output buffer
+     *
+     * @param families Collected families
+     * @param out Output buffer (appended)
+     */
+    void encode(const std::vector<prometheus::MetricFamily> &families, std::string &out);
+
+    /** Number of series with cached line prefixes */
+    std::size_t cachedSeries() const {
+        return cached_series_;
+    }
+
+    /** Drop all the cached state */
+    void clear();
+
+    /** Append value with exposition format ('NaN', '+Inf', '-Inf' or shortest round-trip representation) */
+    static void appendValue(std::string &out, double value);
+};
+
+}
+}
+
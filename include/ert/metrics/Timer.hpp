@@ -0,0 +1,217 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <ert/metrics/Metrics.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Timers clock: time stamp counter (rdtsc) when the processor provides an invariant one, calibrated once
+ * against the monotonic clock, or CLOCK_MONOTONIC_COARSE otherwise. Source is selected at runtime on first use.
+ *
+ * Readings are raw ticks, only converted to seconds when observed. Calibration takes a few milliseconds on
+ * first use (i.e. first timer constructed).
+ */
+class TimerClock {
+
+public:
+
+    enum class Source { Tsc, Coarse };
+
+private:
+
+    Source source_;
+    double seconds_per_tick_;
+
+    TimerClock();
+
+    static const TimerClock &instance() {
+        static const TimerClock clock;
+        return clock;
+    }
+
+public:
+
+    /** Clock source in use */
+    static Source source() {
+        return instance().source_;
+    }
+
+    /** Current ticks */
+    static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        if (instance().source_ == Source::Tsc) return __rdtsc();
+#endif
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return std::uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    /** Ticks to seconds */
+    static double seconds(std::uint64_t ticks) {
+        return ticks * instance().seconds_per_tick_;
+    }
+};
+
+/**
+ * Manual timer bound to a histogram handle: 'stop()' observes the seconds elapsed since 'start()'.
+ *
+ * With sampling, starts are timed with probability 1/N (the others are no-ops), so histogram counts are also
+ * divided by N while quantiles are preserved. Draws come from a per-thread generator, so timers sharing a
+ * thread do not skew the sampling of each other:
+ *
+ * <pre>
+ * ert::metrics::Timer timer(latency_, 16); // handle resolved on constructor, 1 in 16 calls timed
+ * ...
+ * timer.start();
+ * process();
+ * timer.stop();
+ * </pre>
+ *
+ * Timers are cheap to copy: use one per concurrent measurement (i.e. a local or member variable).
+ */
+class Timer {
+    HistogramHandle histogram_;
+    std::uint32_t mask_;
+    std::uint64_t start_{};
+
+    static std::uint32_t seed();
+
+    // Per-thread xorshift generator:
+    static std::uint32_t random() {
+        thread_local std::uint32_t state = seed();
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+public:
+
+    /**
+     * Constructor
+     *
+     * @param histogram Histogram series observed with elapsed seconds
+     * @param sampling Timed calls: one every 'sampling' on average (rounded up to a power of two). One times every call.
+     */
+    explicit Timer(HistogramHandle histogram, std::uint32_t sampling = 1);
+
+    /** Start measurement (skipped if this call is not sampled) */
+    void start() {
+        start_ = (mask_ == 0 || (random() & mask_) == 0) ? TimerClock::now() | 1 : 0; // odd: never zero when started
+    }
+
+    /**
+     * Stop measurement and observe elapsed time
+     *
+     * @return Elapsed seconds, negative if the measurement was not started or sampled
+     */
+    double stop() {
+        if (!start_) return -1.0;
+
+        std::uint64_t begin = start_ & ~std::uint64_t(1);
+        std::uint64_t end = TimerClock::now();
+        double elapsed = (end > begin) ? TimerClock::seconds(end - begin) : 0.0; // thread migration between unsynchronized counters
+        start_ = 0;
+        histogram_.observe(elapsed);
+        return elapsed;
+    }
+
+    /** Discard measurement in progress */
+    void cancel() {
+        start_ = 0;
+    }
+
+    /** Returns true if a sampled measurement is in progress */
+    bool running() const {
+        return start_ != 0;
+    }
+};
+
+/**
+ * Scoped timer: observes the lifetime of the object (@see Timer)
+ *
+ * <pre>
+ * {
+ *     ert::metrics::ScopedTimer timer(latency_);
+ *     process();
+ * } // observed here
+ * </pre>
+ */
+class ScopedTimer {
+    Timer timer_;
+
+public:
+
+    /**
+     * Constructor: starts the measurement
+     *
+     * @param histogram Histogram series observed with elapsed seconds
+     * @param sampling Timed scopes: one every 'sampling' on average (rounded up to a power of two)
+     */
+    explicit ScopedTimer(HistogramHandle histogram, std::uint32_t sampling = 1) : timer_(histogram, sampling) {
+        timer_.start();
+    }
+
+    /** Destructor: stops the measurement */
+    ~ScopedTimer() {
+        timer_.stop();
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    /** Discard the measurement (nothing observed on destruction) */
+    void cancel() {
+        timer_.cancel();
+    }
+};
+
+}
+}
+
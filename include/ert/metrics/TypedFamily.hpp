@@ -0,0 +1,158 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#include <ert/metrics/Types.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Label traits: must be specialized for each enumeration used as typed label dimension.
+ * Enumerators must be contiguous, starting at zero, and sorted as the 'values' array:
+ *
+ * <pre>
+ * enum class Method { GET, POST, PUT, DELETE };
+ *
+ * template <> struct ert::metrics::label_traits<Method> {
+ *     static constexpr const char *name = "method";
+ *     static constexpr std::array<const char*, 4> values = {"GET", "POST", "PUT", "DELETE"};
+ * };
+ * </pre>
+ */
+template <typename E>
+struct label_traits;
+
+/**
+ * Typed family: label dimensions and their value sets are declared at compile time (one enumeration per
+ * dimension). Every combination is created on construction and stored in a flat array indexed by the
+ * enumerators tuple, so getting a series is pure arithmetic (no labels map, no hashing, no lock):
+ *
+ * <pre>
+ * TypedCounterFamily<Method, StatusClass> requests(metrics->addCounterFamily("requests_total", "Requests"));
+ * ...
+ * requests.get(Method::POST, StatusClass::Success).Increment();
+ * </pre>
+ *
+ * Series belong to the underlying family (any family whose 'Add(labels, args...)' returns 'T&', i.e. prometheus
+ * families or library families like sharded counters), so they are exported as usual with normal label strings.
+ */
+template <typename T, typename... Es>
+class TypedFamily {
+
+    static_assert(sizeof...(Es) > 0, "typed family needs at least one label dimension");
+    static_assert((std::is_enum<Es>::value && ...), "typed label dimensions must be enumerations");
+
+public:
+
+    /** Number of label dimensions */
+    static constexpr std::size_t dimensions = sizeof...(Es);
+
+    /** Number of series (all the combinations) */
+    static constexpr std::size_t size = (label_traits<Es>::values.size() * ...);
+
+private:
+
+    std::array<T*, size> series_;
+
+    static constexpr std::array<std::size_t, dimensions> sizes_ = {label_traits<Es>::values.size()...};
+
+public:
+
+    /**
+     * Constructor: creates every combination of label values within the family.
+     *
+     * @param family Family where series are added
+     * @param labels Additional labels for all the series (not typed ones)
+     * @param args Series constructor arguments, i.e. bucket boundaries for histograms
+     *
+     * @throw std::invalid_argument on invalid label names
+     */
+    template <typename F, typename... Args>
+    explicit TypedFamily(F &family, const labels_t &labels = {}, const Args&... args) {
+        const std::array<const char*, dimensions> names = {label_traits<Es>::name...};
+        const std::array<const char * const *, dimensions> values = {label_traits<Es>::values.data()...};
+
+        labels_t seriesLabels(labels);
+        for (std::size_t k = 0; k < size; k++) {
+            std::size_t rest = k;
+            for (std::size_t d = dimensions; d-- > 0;) {
+                seriesLabels[names[d]] = values[d][rest % sizes_[d]];
+                rest /= sizes_[d];
+            }
+            series_[k] = &(family.Add(seriesLabels, args...));
+        }
+    }
+
+    /** Flat index for the enumerators tuple */
+    static std::size_t index(Es... es) {
+        std::size_t result = 0;
+        ((result = result * label_traits<Es>::values.size() + static_cast<std::size_t>(es)), ...);
+        return result;
+    }
+
+    /** Series for the enumerators tuple */
+    T &get(Es... es) const {
+        return *series_[index(es...)];
+    }
+
+    /** Series by flat index */
+    T &at(std::size_t index) const {
+        return *series_[index];
+    }
+};
+
+/** Typed counters family */
+template <typename... Es>
+using TypedCounterFamily = TypedFamily<counter_t, Es...>;
+
+/** Typed gauges family */
+template <typename... Es>
+using TypedGaugeFamily = TypedFamily<gauge_t, Es...>;
+
+/** Typed histograms family */
+template <typename... Es>
+using TypedHistogramFamily = TypedFamily<histogram_t, Es...>;
+
+}
+}
+
@@ -0,0 +1,101 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <prometheus/counter.h>
+#include <prometheus/gauge.h>
+#include <prometheus/histogram.h>
+#include <prometheus/family.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Labels: key-value pairs map to enable Prometheus's dimensional data model.
+ * Any combination of labels for the same metric identifies a particular dimensional instance of the metric.
+ * For example: all HTTP requests that used the method POST to the uri '/the/uri': {"method", "POST"}, {"uri", "/the/uri"}
+ */
+typedef std::map<std::string, std::string> labels_t;
+
+/** Prometheus counter type: cumulative metric that represents a single monotonically increasing counter (i.e.: requests sent, errors, etc.). */
+typedef prometheus::Counter counter_t;
+
+/** Prometheus gauge type: single numerical value that can go up and down arbitrarily (i.e.: temperatures, memory usage, concurrent requests, etc.). */
+typedef prometheus::Gauge gauge_t;
+
+/**
+ * Prometheus histogram type: samples observations within buckets of specific ranges (i.e.: requests durations, message sizes, etc.).
+ * Scrape exposes multiple time series:
+ * > cumulative counters (*_bucket{le="<upper inclusive bound>"})
+ * > total sum of observed values (*_sum)
+ * > count of events observed (*_count). Equals to *_bucket{le="+Inf"}.
+ */
+typedef prometheus::Histogram histogram_t;
+
+/** Bucket boundaries for histogram */
+typedef std::vector<double> bucket_boundaries_t;
+
+/** Counters family */
+typedef prometheus::Family<prometheus::Counter> counter_family_t;
+
+/** Gauges family */
+typedef prometheus::Family<prometheus::Gauge> gauge_family_t;
+
+/** Histograms family */
+typedef prometheus::Family<prometheus::Histogram> histogram_family_t;
+
+/** Map of counters family (indexed by counter name) */
+typedef std::unordered_map<std::string, counter_family_t&> counter_family_map_t;
+
+/** Map of gauges family (indexed by gauge name) */
+typedef std::unordered_map<std::string, gauge_family_t&> gauge_family_map_t;
+
+/** Map of histograms family (indexed by histogram name) */
+typedef std::unordered_map<std::string, histogram_family_t&> histogram_family_map_t;
+
+/** Labels hash, used to index series already resolved within a family */
+struct labels_hash_t {
+    std::size_t operator()(const labels_t &labels) const;
+};
+
+}
+}
+
@@ -0,0 +1,209 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ert/metrics/Metrics.hpp>
+
+
+namespace ert
+{
+namespace metrics
+{
+
+class WindowedView;
+
+/**
+ * Series watched by a windowed view: ring buffer of per-interval deltas (one slot per ticker interval).
+ * Queries read at most one slot per interval within the window, and never lock nor allocate, so they
+ * can be used on hot paths (i.e. backpressure decisions).
+ */
+class WindowedSeries {
+
+    friend class WindowedView;
+
+    const WindowedView &view_;
+    counter_t *counter_;
+    histogram_t *histogram_;
+    bucket_boundaries_t bounds_;
+    std::size_t width_; // deltas per slot: one for counters, buckets ('+Inf' included) for histograms
+    std::unique_ptr<std::atomic<double>[]> deltas_; // slots x width
+    std::vector<double> last_; // previous cumulative values (ticker)
+    std::vector<double> current_; // scratch (ticker)
+
+    WindowedSeries(const WindowedView &view, counter_t *counter, histogram_t *histogram);
+
+    void read(std::vector<double> &values) const; // cumulative values
+    void sample(std::size_t slot);
+
+public:
+
+    /**
+     * Increase over the window: counter increase, or number of observations for histograms
+     *
+     * @param window Time window (rounded up to ticker intervals, and limited to the view length)
+     */
+    double increase(std::chrono::milliseconds window) const;
+
+    /**
+     * Per-second rate over the window (@see increase())
+     *
+     * @return Rate, zero if nothing was sampled yet
+     */
+    double rate(std::chrono::milliseconds window) const;
+
+    /**
+     * Quantile of histogram observations within the window, interpolated within buckets (as Prometheus
+     * 'histogram_quantile()' does)
+     *
+     * @param quantile Quantile (0 to 1)
+     * @param window Time window
+     *
+     * @return Quantile estimation, NaN for counters or if there were no observations
+     */
+    double quantile(double quantile, std::chrono::milliseconds window) const;
+};
+
+/**
+ * Windowed view over counter and histogram series of a metrics instance, for local feedback loops
+ * ("requests per second over the last 10 seconds", "p99 over the last 30 seconds") without querying
+ * Prometheus.
+ *
+ * A ticker thread samples watched series every interval, and stores deltas in ring buffers of 'slots'
+ * intervals (also recording the actual duration of each interval). Queries cost O(window slots):
+ *
+ * <pre>
+ * ert::metrics::WindowedView view(metrics, std::chrono::seconds(1), 60);
+ * const ert::metrics::WindowedSeries *requests = view.watchCounter("requests_total", {{"method", "POST"}});
+ * const ert::metrics::WindowedSeries *latency = view.watchHistogram("latency_seconds", {}, boundaries);
+ * ...
+ * if (requests->rate(std::chrono::seconds(10)) > limit || latency->quantile(0.99, std::chrono::seconds(30)) > slo) shed();
+ * </pre>
+ *
+ * The view must be destroyed before the metrics instance.
+ */
+class WindowedView {
+
+    friend class WindowedSeries;
+
+    Metrics &metrics_;
+    std::chrono::steady_clock::duration interval_;
+    std::size_t slots_;
+    std::unique_ptr<std::atomic<double>[]> durations_; // seconds covered by each slot
+    std::atomic<std::uint64_t> ticks_; // completed intervals
+
+    mutable std::shared_mutex mutex_; // protects series
+    std::map<std::string, std::map<labels_t, std::unique_ptr<WindowedSeries>>> series_; // by family and labels
+
+    std::mutex ticker_mutex_;
+    std::condition_variable ticker_cv_;
+    bool stopping_;
+    std::thread ticker_;
+
+    void loop();
+    void tick(double seconds);
+    const WindowedSeries *watch(const std::string &familyName, const labels_t &labels, counter_t *counter, histogram_t *histogram);
+
+    // Slots within a window: number (up to 'slots - 1') and latest one
+    std::size_t window(std::chrono::milliseconds window, std::uint64_t &ticks) const;
+
+public:
+
+    /**
+     * Constructor: starts the ticker thread
+     *
+     * @param metrics Metrics instance
+     * @param interval Ticker interval (slot length), 1 second by default
+     * @param slots Number of intervals kept (view length is interval times slots minus one), 61 by default
+     */
+    explicit WindowedView(Metrics &metrics, std::chrono::milliseconds interval = std::chrono::seconds(1), std::size_t slots = 61);
+
+    /** Destructor: stops the ticker thread */
+    ~WindowedView();
+
+    WindowedView(const WindowedView&) = delete;
+    WindowedView& operator=(const WindowedView&) = delete;
+
+    /**
+     * Watch counter series (it is created if needed)
+     *
+     * @param familyName Counter family name
+     * @param labels Additional labels
+     *
+     * @return Windowed series (valid while the view exists, same for repeated calls), nullptr if the family
+     * is not found or labels are not valid
+     */
+    const WindowedSeries *watchCounter(const std::string &familyName, const labels_t &labels = {});
+
+    /**
+     * Watch histogram series (it is created if needed)
+     *
+     * @param familyName Histogram family name
+     * @param labels Additional labels
+     * @param bucketBoundaries Bucket boundaries, only used if the series is created
+     *
+     * @return Windowed series (@see watchCounter())
+     */
+    const WindowedSeries *watchHistogram(const std::string &familyName, const labels_t &labels, const bucket_boundaries_t &bucketBoundaries);
+
+    /**
+     * Per-second rate of a watched series (@see WindowedSeries::rate())
+     *
+     * @return Rate, NaN if the series is not watched
+     */
+    double rate(const std::string &familyName, const labels_t &labels, std::chrono::milliseconds window) const;
+
+    /**
+     * Quantile of a watched histogram series (@see WindowedSeries::quantile())
+     *
+     * @return Quantile estimation, NaN if the series is not watched
+     */
+    double quantile(const std::string &familyName, const labels_t &labels, double quantile, std::chrono::milliseconds window) const;
+};
+
+}
+}
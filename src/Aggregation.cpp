@@ -0,0 +1,348 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/Aggregation.hpp>
+#include <ert/metrics/ExponentialHistogram.hpp>
+
+#include <prometheus/check_names.h>
+#include <algorithm>
+#include <utility>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+bool monotonic(prometheus::MetricType type)
+{
+    return type == prometheus::MetricType::Counter || type == prometheus::MetricType::Histogram || type == prometheus::MetricType::Summary;
+}
+
+// Value used to rank series
+double rank(const prometheus::ClientMetric &metric, prometheus::MetricType type)
+{
+    switch (type) {
+    case prometheus::MetricType::Counter:
+        return metric.counter.value;
+    case prometheus::MetricType::Gauge:
+        return metric.gauge.value;
+    case prometheus::MetricType::Summary:
+        return static_cast<double>(metric.summary.sample_count);
+    case prometheus::MetricType::Histogram:
+        return static_cast<double>(metric.histogram.sample_count);
+    default:
+        return metric.untyped.value;
+    }
+}
+
+// Accumulate values (not labels) into a group. Returns false if histogram buckets do not match
+bool accumulate(prometheus::ClientMetric &into, bool first, const prometheus::ClientMetric &from, prometheus::MetricType type)
+{
+    switch (type) {
+    case prometheus::MetricType::Counter:
+        into.counter.value = (first ? 0.0 : into.counter.value) + from.counter.value;
+        break;
+    case prometheus::MetricType::Gauge:
+        into.gauge.value = (first ? 0.0 : into.gauge.value) + from.gauge.value;
+        break;
+    case prometheus::MetricType::Summary:
+        if (first) {
+            into.summary.sample_count = 0;
+            into.summary.sample_sum = 0.0;
+            into.summary.quantile.clear();
+        }
+        into.summary.sample_count += from.summary.sample_count;
+        into.summary.sample_sum += from.summary.sample_sum;
+        break;
+    case prometheus::MetricType::Histogram:
+        if (first) {
+            into.histogram = from.histogram;
+            break;
+        }
+        if (into.histogram.bucket.size() != from.histogram.bucket.size()) return false;
+        for (std::size_t k = 0; k < from.histogram.bucket.size(); k++) {
+            if (into.histogram.bucket[k].upper_bound != from.histogram.bucket[k].upper_bound) return false;
+        }
+        for (std::size_t k = 0; k < from.histogram.bucket.size(); k++) {
+            into.histogram.bucket[k].cumulative_count += from.histogram.bucket[k].cumulative_count;
+        }
+        into.histogram.sample_count += from.histogram.sample_count;
+        into.histogram.sample_sum += from.histogram.sample_sum;
+        break;
+    default:
+        into.untyped.value = (first ? 0.0 : into.untyped.value) + from.untyped.value;
+        break;
+    }
+    return true;
+}
+
+// Increase of a monotonic series since its last values (whole values when new or reset)
+void increase(prometheus::ClientMetric &into, const prometheus::ClientMetric &current, const prometheus::ClientMetric *last, prometheus::MetricType type)
+{
+    bool reset = !last || rank(current, type) < rank(*last, type);
+
+    switch (type) {
+    case prometheus::MetricType::Counter:
+        into.counter.value = current.counter.value - (reset ? 0.0 : last->counter.value);
+        break;
+    case prometheus::MetricType::Summary:
+        into.summary.sample_count = current.summary.sample_count - (reset ? 0 : last->summary.sample_count);
+        into.summary.sample_sum = current.summary.sample_sum - (reset ? 0.0 : last->summary.sample_sum);
+        break;
+    default: // histogram
+        reset = reset || last->histogram.bucket.size() != current.histogram.bucket.size();
+        into.histogram = current.histogram;
+        if (reset) break;
+        for (std::size_t k = 0; k < into.histogram.bucket.size(); k++) {
+            into.histogram.bucket[k].cumulative_count -= last->histogram.bucket[k].cumulative_count;
+        }
+        into.histogram.sample_count -= last->histogram.sample_count;
+        into.histogram.sample_sum -= last->histogram.sample_sum;
+        break;
+    }
+}
+
+// Group key (labels are sorted by name) into the reused buffer
+void buildKey(std::string &key, const std::vector<prometheus::ClientMetric::Label> &labels)
+{
+    key.clear();
+    for (const auto &label: labels) {
+        key += label.name;
+        key += '\0';
+        key += label.value;
+        key += '\0';
+    }
+}
+
+template <typename M>
+void resetGroups(M &groups)
+{
+    for (auto &group: groups) group.second.seen = false;
+}
+
+// Weight of previous scrapes on rankings of counters, histograms and summaries
+constexpr double score_decay = 0.75;
+
+template <typename M>
+void eraseUnseen(M &groups)
+{
+    for (auto it = groups.begin(); it != groups.end();) {
+        if (it->second.seen) ++it;
+        else it = groups.erase(it);
+    }
+}
+}
+
+bool Aggregator::add(const std::string &familyName, const aggregation_rule_t &rule)
+{
+    if (!rule.top_label.empty()) {
+        if (rule.top_k == 0 || std::find(rule.drop_labels.begin(), rule.drop_labels.end(), rule.top_label) != rule.drop_labels.end()) {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("Invalid ranking for family %s aggregation (top_k must be positive and ranked label cannot be dropped)", familyName.c_str()), ERT_FILE_LOCATION);
+            return false;
+        }
+    }
+    if (!rule.name.empty() && (rule.name == familyName || !prometheus::CheckMetricName(rule.name))) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Invalid aggregated family name '%s' for family %s", rule.name.c_str(), familyName.c_str()), ERT_FILE_LOCATION);
+        return false;
+    }
+
+    auto result = states_.insert(familyName, [&]() {
+        std::unique_ptr<State> state(new State());
+        state->rule = rule;
+        return state;
+    });
+    if (!result.second) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Family %s already aggregated", familyName.c_str()), ERT_FILE_LOCATION);
+        return false;
+    }
+
+    empty_.store(false, std::memory_order_release);
+    return true;
+}
+
+void Aggregator::aggregate(State &state, prometheus::MetricFamily &family, std::vector<prometheus::ClientMetric> &out)
+{
+    const aggregation_rule_t &rule = state.rule;
+    const bool increases = monotonic(family.type);
+    bool mismatch = false;
+
+    // Find or create group; 'created' is set for new groups:
+    auto group = [&state](std::map<std::string, Group> &groups, const std::vector<prometheus::ClientMetric::Label> &labels, bool &created) -> Group& {
+        buildKey(state.key, labels);
+        auto it = groups.find(state.key);
+        created = (it == groups.end());
+        if (created) {
+            it = groups.emplace(state.key, Group()).first;
+            it->second.metric.label = labels;
+        }
+        return it->second;
+    };
+
+    // Drop labels. Monotonic values are accumulated from the increases of each series, so groups keep the
+    // contributions of series which are gone:
+    resetGroups(state.sources);
+    resetGroups(state.groups);
+    std::vector<prometheus::ClientMetric::Label> labels;
+    prometheus::ClientMetric delta;
+    bool created;
+    for (const auto &metric: family.metric) {
+        const prometheus::ClientMetric *value = &metric;
+        if (increases) {
+            Group &source = group(state.sources, metric.label, created);
+            increase(delta, metric, created ? nullptr : &source.metric, family.type);
+            source.metric = metric;
+            source.seen = true;
+            value = &delta;
+        }
+
+        labels.clear();
+        for (const auto &label: metric.label) {
+            if (std::find(rule.drop_labels.begin(), rule.drop_labels.end(), label.name) == rule.drop_labels.end()) labels.push_back(label);
+        }
+
+        Group &aggregated = group(state.groups, labels, created);
+        if (!accumulate(aggregated.metric, increases ? created : !aggregated.seen, *value, family.type)) mismatch = true;
+        if (increases) accumulate(aggregated.increase, !aggregated.seen, *value, family.type);
+        aggregated.seen = true;
+    }
+    eraseUnseen(state.sources);
+    eraseUnseen(state.groups);
+
+    if (rule.top_label.empty()) {
+        for (const auto &aggregated: state.groups) out.push_back(aggregated.second.metric);
+    }
+    else {
+        // Rank label values (recent increases for monotonic values):
+        auto rankedValue = [&](const prometheus::ClientMetric &metric) -> const std::string* {
+            for (const auto &label: metric.label) {
+                if (label.name == rule.top_label) return &label.value;
+            }
+            return nullptr;
+        };
+
+        std::map<std::string, double> scores;
+        for (const auto &aggregated: state.groups) {
+            const std::string *value = rankedValue(aggregated.second.metric);
+            if (!value) continue;
+
+            auto inserted = scores.emplace(*value, 0.0);
+            double &score = inserted.first->second;
+            if (increases) {
+                auto previous = state.scores.find(*value);
+                if (inserted.second && previous != state.scores.end()) score = previous->second * score_decay;
+                score += rank(aggregated.second.increase, family.type);
+            }
+            else {
+                score += rank(aggregated.second.metric, family.type);
+            }
+        }
+        state.scores.swap(scores);
+
+        std::vector<std::pair<double, const std::string*>> candidates;
+        for (const auto &score: state.scores) candidates.emplace_back(score.second, &score.first);
+        std::sort(candidates.begin(), candidates.end(), [](const std::pair<double, const std::string*> &a, const std::pair<double, const std::string*> &b) {
+            return a.first > b.first || (a.first == b.first && *a.second < *b.second);
+        });
+        state.kept.clear();
+        for (std::size_t k = 0; k < candidates.size() && k < rule.top_k; k++) {
+            state.kept.insert(*candidates[k].second);
+        }
+
+        // Fold the rest (monotonic values: only their increases while folded):
+        resetGroups(state.folded);
+        for (const auto &aggregated: state.groups) {
+            const std::string *value = rankedValue(aggregated.second.metric);
+            if (!value || state.kept.count(*value)) {
+                out.push_back(aggregated.second.metric);
+                continue;
+            }
+
+            labels = aggregated.second.metric.label;
+            for (auto &label: labels) {
+                if (label.name == rule.top_label) label.value = rule.other_value;
+            }
+
+            Group &folded = group(state.folded, labels, created);
+            const prometheus::ClientMetric &contribution = increases ? aggregated.second.increase : aggregated.second.metric;
+            if (!accumulate(folded.metric, increases ? created : !folded.seen, contribution, family.type)) mismatch = true;
+            folded.seen = true;
+        }
+        eraseUnseen(state.folded);
+        for (const auto &folded: state.folded) out.push_back(folded.second.metric);
+    }
+
+    if (mismatch && !state.mismatch_logged) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Histogram family %s aggregated with different bucket boundaries (mismatching series are ignored)", family.name.c_str()), ERT_FILE_LOCATION);
+        state.mismatch_logged = true;
+    }
+}
+
+void Aggregator::apply(std::vector<prometheus::MetricFamily> &families)
+{
+    if (empty_.load(std::memory_order_acquire)) return;
+
+    std::vector<prometheus::MetricFamily> added;
+    for (auto &family: families) {
+        State *state = states_.find(family.name);
+        if (!state) continue;
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        std::vector<prometheus::ClientMetric> aggregated;
+        aggregate(*state, family, aggregated);
+
+        if (state->rule.name.empty()) {
+            family.metric = std::move(aggregated);
+            if (auto capture = NativeHistogramCapture::current()) capture->discard(family.name); // no longer the collected series
+        }
+        else {
+            prometheus::MetricFamily result;
+            result.name = state->rule.name;
+            result.help = family.help;
+            result.type = family.type;
+            result.metric = std::move(aggregated);
+            added.push_back(std::move(result));
+        }
+    }
+
+    families.insert(families.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+}
+
+}
+}
+
@@ -0,0 +1,129 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/metrics/BucketLayout.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+// Branchless binary search over padded boundaries (power of two not required)
+std::size_t binarySearch(const double *bounds, std::size_t size, double value)
+{
+    const double *base = bounds;
+    std::size_t n = size;
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = (base[half] < value) ? base + half : base; // compiled to a conditional move
+        n -= half;
+    }
+    return (base - bounds) + (base[0] < value);
+}
+
+#if defined(__x86_64__)
+// Count of boundaries below value, two at a time (padding is '+Inf', never below)
+std::size_t sse2Count(const double *bounds, std::size_t size, double value)
+{
+    const __m128d v = _mm_set1_pd(value);
+    std::size_t result = 0;
+    for (std::size_t k = 0; k < size; k += 8) {
+        int mask = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(bounds + k), v));
+        mask |= _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(bounds + k + 2), v)) << 2;
+        mask |= _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(bounds + k + 4), v)) << 4;
+        mask |= _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(bounds + k + 6), v)) << 6;
+        result += __builtin_popcount(mask);
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+std::size_t avx2Count(const double *bounds, std::size_t size, double value)
+{
+    const __m256d v = _mm256_set1_pd(value);
+    std::size_t result = 0;
+    for (std::size_t k = 0; k < size; k += 8) {
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(bounds + k), v, _CMP_LT_OQ));
+        mask |= _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(bounds + k + 4), v, _CMP_LT_OQ)) << 4;
+        result += __builtin_popcount(mask);
+    }
+    return result;
+}
+#endif
+}
+
+BucketLayout::BucketLayout(const std::string &name, const bucket_boundaries_t &boundaries)
+    : name_(name), boundaries_(boundaries)
+{
+    for (std::size_t k = 0; k < boundaries_.size(); k++) {
+        if (!std::isfinite(boundaries_[k]) || (k > 0 && !(boundaries_[k - 1] < boundaries_[k]))) {
+            throw std::invalid_argument("Bucket Boundaries must be finite and strictly sorted");
+        }
+    }
+
+    padded_ = boundaries_;
+    padded_.resize(std::max<std::size_t>(8, (boundaries_.size() + 7) & ~std::size_t(7)), std::numeric_limits<double>::infinity());
+
+    search_ = binarySearch;
+#if defined(__x86_64__)
+    if (boundaries_.size() <= simd_max_boundaries) {
+        search_ = __builtin_cpu_supports("avx2") ? avx2Count : sse2Count;
+    }
+#endif
+}
+
+const char *BucketLayout::kernel() const
+{
+#if defined(__x86_64__)
+    if (search_ == avx2Count) return "avx2";
+    if (search_ == sse2Count) return "sse2";
+#endif
+    return "binary";
+}
+
+}
+}
+
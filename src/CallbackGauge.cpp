@@ -0,0 +1,157 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/CallbackGauge.hpp>
+
+#include <prometheus/check_names.h>
+#include <prometheus/client_metric.h>
+#include <exception>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+void CallbackGaugeRegistration::reset()
+{
+    if (!id_) return;
+
+    if (auto family = family_.lock()) family->Remove(id_);
+    family_.reset();
+    id_ = 0;
+}
+
+CallbackGaugeFamily::CallbackGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels, std::chrono::milliseconds cacheTtl)
+    : name_(name), help_(help), constant_labels_(labels), cache_ttl_(cacheTtl), next_id_(1)
+{
+    if (!prometheus::CheckMetricName(name_)) {
+        throw std::invalid_argument("Invalid metric name");
+    }
+    for (const auto &label: constant_labels_) {
+        if (!prometheus::CheckLabelName(label.first)) {
+            throw std::invalid_argument("Invalid label name");
+        }
+    }
+}
+
+CallbackGaugeRegistration CallbackGaugeFamily::Add(const labels_t &labels, gauge_callback_t callback)
+{
+    for (const auto &label: labels) {
+        if (!prometheus::CheckLabelName(label.first)) {
+            throw std::invalid_argument("Invalid label name");
+        }
+    }
+
+    if (!callback) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Empty callback for gauge family %s", name_.c_str()), ERT_FILE_LOCATION);
+        return CallbackGaugeRegistration();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &series: series_) {
+        if (series.second.labels == labels) {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("Callback already registered for these labels in gauge family %s", name_.c_str()), ERT_FILE_LOCATION);
+            return CallbackGaugeRegistration();
+        }
+    }
+
+    std::uint64_t id = next_id_++;
+    Series &series = series_[id];
+    series.labels = labels;
+    series.callback = std::move(callback);
+    evaluated_ = {}; // new series: next scrape evaluates
+
+    return CallbackGaugeRegistration(weak_from_this(), id);
+}
+
+void CallbackGaugeFamily::Remove(std::uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    series_.erase(id);
+}
+
+std::vector<prometheus::MetricFamily> CallbackGaugeFamily::Collect() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (series_.empty()) return {};
+
+    auto now = std::chrono::steady_clock::now();
+    bool evaluate = (cache_ttl_.count() == 0 || evaluated_ == std::chrono::steady_clock::time_point{} || now - evaluated_ >= cache_ttl_);
+
+    prometheus::MetricFamily family;
+    family.name = name_;
+    family.help = help_;
+    family.type = prometheus::MetricType::Gauge;
+    family.metric.reserve(series_.size());
+
+    for (auto &item: series_) {
+        Series &series = item.second;
+
+        if (evaluate) {
+            try {
+                series.value = series.callback();
+                series.valid = true;
+            }
+            catch(std::exception &e) {
+                series.valid = false;
+                ert::tracing::Logger::error(ert::tracing::Logger::asString("Gauge callback failed (family %s): %s", name_.c_str(), e.what()), ERT_FILE_LOCATION);
+            }
+        }
+        if (!series.valid) continue;
+
+        prometheus::ClientMetric metric;
+        metric.gauge.value = series.value;
+        metric.label.reserve(constant_labels_.size() + series.labels.size());
+        for (const auto &label: constant_labels_) {
+            metric.label.push_back({label.first, label.second});
+        }
+        for (const auto &label: series.labels) {
+            metric.label.push_back({label.first, label.second});
+        }
+        family.metric.push_back(std::move(metric));
+    }
+
+    if (evaluate) evaluated_ = now;
+    if (family.metric.empty()) return {};
+
+    return {std::move(family)};
+}
+
+}
+}
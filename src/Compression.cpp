@@ -0,0 +1,201 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/Compression.hpp>
+
+#include <zlib.h>
+#include <algorithm>
+#ifdef ERT_METRICS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+constexpr std::size_t min_output_size = 16384;
+
+// Output buffer exhausted (bound not reached in practice): doubled
+void grow(std::string &out)
+{
+    out.resize(std::max(min_output_size, 2 * out.size()));
+}
+}
+
+Compressor::Compressor()
+{
+}
+
+Compressor::~Compressor()
+{
+    if (gzip_) deflateEnd(gzip_.get());
+#ifdef ERT_METRICS_ZSTD
+    if (zstd_) ZSTD_freeCCtx(zstd_);
+#endif
+}
+
+bool Compressor::supported(content_encoding_t encoding)
+{
+#ifdef ERT_METRICS_ZSTD
+    return true;
+#else
+    return encoding != content_encoding_t::Zstd;
+#endif
+}
+
+const char *Compressor::name(content_encoding_t encoding)
+{
+    switch (encoding) {
+    case content_encoding_t::Gzip:
+        return "gzip";
+    case content_encoding_t::Zstd:
+        return "zstd";
+    default:
+        return "";
+    }
+}
+
+bool Compressor::compress(content_encoding_t encoding, int level, const std::vector<std::string_view> &pieces, std::string &out)
+{
+    switch (encoding) {
+    case content_encoding_t::Gzip:
+        return gzip(level, pieces, out);
+    case content_encoding_t::Zstd:
+        return zstd(level, pieces, out);
+    default:
+        out.clear();
+        for (std::string_view piece: pieces) out.append(piece.data(), piece.size());
+        return true;
+    }
+}
+
+bool Compressor::gzip(int level, const std::vector<std::string_view> &pieces, std::string &out)
+{
+    level = std::min(std::max(level, 1), 9);
+
+    if (gzip_ && level != gzip_level_) {
+        deflateEnd(gzip_.get());
+        gzip_.reset();
+    }
+    if (!gzip_) {
+        std::unique_ptr<z_stream_s> stream(new z_stream_s());
+        if (deflateInit2(stream.get(), level, Z_DEFLATED, 15 + 16 /* gzip wrapper */, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            ert::tracing::Logger::error("Cannot initialize gzip compression", ERT_FILE_LOCATION);
+            return false;
+        }
+        gzip_ = std::move(stream);
+        gzip_level_ = level;
+    }
+    else if (deflateReset(gzip_.get()) != Z_OK) {
+        return false;
+    }
+
+    z_stream_s &stream = *gzip_;
+    std::size_t total = 0;
+    for (std::string_view piece: pieces) total += piece.size();
+    out.resize(std::max<std::size_t>(out.capacity(), deflateBound(&stream, total)));
+
+    std::size_t used = 0;
+    for (std::size_t k = 0; k <= pieces.size(); k++) {
+        const bool last = (k == pieces.size());
+        stream.next_in = last ? nullptr : reinterpret_cast<Bytef*>(const_cast<char*>(pieces[k].data()));
+        stream.avail_in = last ? 0 : static_cast<uInt>(pieces[k].size());
+
+        int rc;
+        do {
+            if (used == out.size()) grow(out);
+            stream.next_out = reinterpret_cast<Bytef*>(&out[used]);
+            stream.avail_out = static_cast<uInt>(out.size() - used);
+            rc = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH);
+            used = out.size() - stream.avail_out;
+            if (rc == Z_STREAM_ERROR) return false;
+        } while (last ? (rc != Z_STREAM_END) : (stream.avail_in > 0));
+    }
+
+    out.resize(used);
+    return true;
+}
+
+bool Compressor::zstd(int level, const std::vector<std::string_view> &pieces, std::string &out)
+{
+#ifdef ERT_METRICS_ZSTD
+    if (!zstd_) {
+        zstd_ = ZSTD_createCCtx();
+        if (!zstd_) {
+            ert::tracing::Logger::error("Cannot initialize zstd compression", ERT_FILE_LOCATION);
+            return false;
+        }
+    }
+    ZSTD_CCtx_reset(zstd_, ZSTD_reset_session_only);
+    ZSTD_CCtx_setParameter(zstd_, ZSTD_c_compressionLevel, level);
+
+    std::size_t total = 0;
+    for (std::string_view piece: pieces) total += piece.size();
+    ZSTD_CCtx_setPledgedSrcSize(zstd_, total);
+    out.resize(std::max<std::size_t>(out.capacity(), ZSTD_compressBound(total)));
+
+    std::size_t used = 0;
+    for (std::size_t k = 0; k <= pieces.size(); k++) {
+        const bool last = (k == pieces.size());
+        ZSTD_inBuffer input { last ? nullptr : pieces[k].data(), last ? 0 : pieces[k].size(), 0 };
+
+        std::size_t remaining;
+        do {
+            if (used == out.size()) grow(out);
+            ZSTD_outBuffer output { &out[0], out.size(), used };
+            remaining = ZSTD_compressStream2(zstd_, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+            used = output.pos;
+            if (ZSTD_isError(remaining)) return false;
+        } while (last ? (remaining != 0) : (input.pos < input.size));
+    }
+
+    out.resize(used);
+    return true;
+#else
+    (void)level;
+    (void)pieces;
+    (void)out;
+    return false;
+#endif
+}
+
+}
+}
+
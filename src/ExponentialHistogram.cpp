@@ -0,0 +1,381 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/ExponentialHistogram.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+constexpr int min_schema = -4;
+constexpr int max_schema = 8;
+
+/**
+ * Lookup tables for positive schemas. Mantissa fraction (in [0.5, 1)) is mapped to the sub-bucket by a table
+ * indexed by the leading mantissa bits (2^(schema+1) cells, narrower than the distance between consecutive
+ * bounds, so each cell holds one bound at most) and a single comparison.
+ */
+struct SchemaTables {
+    std::vector<double> bounds; // 2^schema bounds in [0.5, 1), plus sentinel 1.0
+    std::vector<std::uint16_t> cells; // smallest bound index with bound >= cell low value
+
+    explicit SchemaTables(int schema) {
+        const std::size_t size = std::size_t(1) << schema;
+        bounds.resize(size + 1);
+        for (std::size_t j = 0; j < size; j++) {
+            bounds[j] = std::exp2(double(j) / size - 1.0);
+        }
+        bounds[size] = 1.0;
+
+        const std::size_t cellsSize = size << 1;
+        cells.resize(cellsSize);
+        std::size_t j = 0;
+        for (std::size_t c = 0; c < cellsSize; c++) {
+            const double low = 0.5 + 0.5 * double(c) / cellsSize;
+            while (bounds[j] < low) j++;
+            cells[c] = static_cast<std::uint16_t>(j);
+        }
+    }
+};
+
+const SchemaTables &schemaTables(int schema)
+{
+    static const std::vector<SchemaTables> tables = []() {
+        std::vector<SchemaTables> result;
+        for (int s = 0; s <= max_schema; s++) result.emplace_back(s);
+        return result;
+    }();
+    return tables[schema];
+}
+
+// Native representation: populated buckets as spans and count deltas
+void encodeSpans(const std::map<std::int32_t, std::uint64_t> &buckets, std::vector<native_histogram_t::Span> &spans, std::vector<std::int64_t> &deltas)
+{
+    std::int64_t previousCount = 0;
+    std::int32_t previousIndex = 0;
+    bool first = true;
+    for (const auto &bucket: buckets) {
+        if (first || bucket.first != previousIndex + 1) {
+            const std::int32_t offset = first ? bucket.first : (bucket.first - previousIndex - 1);
+            spans.push_back({offset, 0});
+        }
+        spans.back().length++;
+        deltas.push_back(static_cast<std::int64_t>(bucket.second) - previousCount);
+        previousCount = static_cast<std::int64_t>(bucket.second);
+        previousIndex = bucket.first;
+        first = false;
+    }
+}
+
+void encodeNative(native_histogram_t &result, int schema, double zeroThreshold, std::uint64_t zeroCount, std::uint64_t count, double sum,
+                  const std::map<std::int32_t, std::uint64_t> &positive, const std::map<std::int32_t, std::uint64_t> &negative)
+{
+    result.schema = schema;
+    result.zero_threshold = zeroThreshold;
+    result.zero_count = zeroCount;
+    result.count = count;
+    result.sum = sum;
+    result.positive_spans.clear();
+    result.positive_deltas.clear();
+    result.negative_spans.clear();
+    result.negative_deltas.clear();
+    encodeSpans(positive, result.positive_spans, result.positive_deltas);
+    encodeSpans(negative, result.negative_spans, result.negative_deltas);
+}
+}
+
+void ExponentialHistogram::Buckets::add(std::int32_t index, std::uint64_t count)
+{
+    auto &chunk = chunks[index >> chunk_bits];
+    if (!chunk) chunk.reset(new chunk_t{});
+
+    auto &cell = (*chunk)[index & ((1 << chunk_bits) - 1)];
+    if (cell == 0) populated++;
+    cell += count;
+}
+
+std::map<std::int32_t, std::uint64_t> ExponentialHistogram::Buckets::sorted() const
+{
+    std::map<std::int32_t, std::uint64_t> result;
+    for (const auto &chunk: chunks) {
+        for (std::size_t k = 0; k < chunk.second->size(); k++) {
+            if ((*chunk.second)[k]) {
+                result.emplace(static_cast<std::int32_t>((chunk.first << chunk_bits) + k), (*chunk.second)[k]);
+            }
+        }
+    }
+    return result;
+}
+
+ExponentialHistogram::ExponentialHistogram(const exponential_histogram_config_t &config)
+    : schema_(config.schema), zero_threshold_(std::fabs(config.zero_threshold)), max_buckets_(config.max_buckets)
+{
+    if (schema_ < min_schema || schema_ > max_schema) {
+        throw std::invalid_argument("Exponential histogram schema must be within [-4, 8]");
+    }
+}
+
+std::int32_t ExponentialHistogram::bucketIndex(double value, int schema)
+{
+    if (std::isinf(value)) value = DBL_MAX;
+
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const std::uint64_t mantissa = bits & ((std::uint64_t(1) << 52) - 1);
+    const int biasedExponent = static_cast<int>((bits >> 52) & 0x7ff);
+
+    // value = fraction * 2^exponent, fraction in [0.5, 1):
+    int exponent;
+    double fraction;
+    std::size_t cell;
+    if (biasedExponent != 0) {
+        exponent = biasedExponent - 1022;
+        const std::uint64_t fractionBits = (std::uint64_t(1022) << 52) | mantissa;
+        std::memcpy(&fraction, &fractionBits, sizeof(fraction));
+        cell = (schema > 0) ? static_cast<std::size_t>(mantissa >> (52 - (schema + 1))) : 0;
+    }
+    else { // subnormal
+        fraction = std::frexp(value, &exponent);
+        cell = (schema > 0) ? static_cast<std::size_t>((fraction - 0.5) * (std::size_t(1) << (schema + 2))) : 0;
+    }
+
+    if (schema > 0) {
+        const SchemaTables &tables = schemaTables(schema);
+        std::size_t j = tables.cells[cell];
+        if (tables.bounds[j] < fraction) j++;
+        return static_cast<std::int32_t>(j) + (exponent - 1) * (1 << schema);
+    }
+
+    std::int32_t key = exponent;
+    if (fraction == 0.5) key--; // exact power of two belongs to the lower bucket
+    const std::int32_t offset = (1 << -schema) - 1;
+    return (key + offset) >> -schema;
+}
+
+double ExponentialHistogram::upperBound(std::int32_t index, int schema)
+{
+    if (schema <= 0) {
+        return std::ldexp(1.0, index * (1 << -schema));
+    }
+
+    const std::int32_t size = 1 << schema;
+    std::int32_t exponent = index / size;
+    std::int32_t rest = index % size;
+    if (rest < 0) {
+        rest += size;
+        exponent--;
+    }
+    return std::ldexp(std::exp2(double(rest) / size), exponent);
+}
+
+void ExponentialHistogram::reduceResolution()
+{
+    while (positive_.populated + negative_.populated > max_buckets_ && schema_ > min_schema) {
+        schema_--;
+        for (Buckets *buckets: {&positive_, &negative_}) {
+            Buckets reduced;
+            for (const auto &bucket: buckets->sorted()) {
+                reduced.add((bucket.first + 1) >> 1, bucket.second); // bucket i goes to ceil(i/2)
+            }
+            *buckets = std::move(reduced);
+        }
+    }
+}
+
+void ExponentialHistogram::Observe(double value)
+{
+    if (std::isnan(value)) return;
+
+    const double magnitude = std::fabs(value);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    count_++;
+    sum_ += value;
+
+    if (magnitude <= zero_threshold_) {
+        zero_count_++;
+        return;
+    }
+
+    (value > 0 ? positive_ : negative_).add(bucketIndex(magnitude, schema_), 1);
+
+    if (max_buckets_ && (positive_.populated + negative_.populated > max_buckets_)) {
+        reduceResolution();
+    }
+}
+
+int ExponentialHistogram::schema() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return schema_;
+}
+
+native_histogram_t ExponentialHistogram::native() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    native_histogram_t result;
+    encodeNative(result, schema_, zero_threshold_, zero_count_, count_, sum_, positive_.sorted(), negative_.sorted());
+    return result;
+}
+
+prometheus::ClientMetric ExponentialHistogram::Collect() const
+{
+    return collect(nullptr);
+}
+
+prometheus::ClientMetric ExponentialHistogram::Collect(native_histogram_t &native) const
+{
+    return collect(&native);
+}
+
+prometheus::ClientMetric ExponentialHistogram::collect(native_histogram_t *native) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto positive = positive_.sorted();
+    const auto negative = negative_.sorted();
+
+    prometheus::ClientMetric metric;
+    auto &buckets = metric.histogram.bucket;
+    buckets.reserve(positive.size() + negative.size() + 2);
+
+    std::uint64_t cumulative = 0;
+    auto push = [&](double upperBound, std::uint64_t count) {
+        cumulative += count;
+        prometheus::ClientMetric::Bucket bucket;
+        bucket.cumulative_count = cumulative;
+        bucket.upper_bound = upperBound;
+        buckets.push_back(bucket);
+    };
+
+    // Ascending values: negative buckets (i covers [-base^i, -base^(i-1))) from the highest index:
+    for (auto it = negative.rbegin(); it != negative.rend(); it++) {
+        push(-upperBound(it->first - 1, schema_), it->second);
+    }
+    push(zero_threshold_, zero_count_);
+    for (const auto &bucket: positive) {
+        push(upperBound(bucket.first, schema_), bucket.second);
+    }
+    push(std::numeric_limits<double>::infinity(), 0);
+
+    metric.histogram.sample_count = count_;
+    metric.histogram.sample_sum = sum_;
+
+    if (native) encodeNative(*native, schema_, zero_threshold_, zero_count_, count_, sum_, positive, negative);
+
+    return metric;
+}
+
+namespace
+{
+thread_local NativeHistogramCapture *current_capture = nullptr;
+
+// Series key: labels names and values, separated by characters not allowed in names
+std::string seriesKey(const std::vector<prometheus::ClientMetric::Label> &labels)
+{
+    std::string result;
+    for (const auto &label: labels) {
+        result += label.name;
+        result += '=';
+        result += label.value;
+        result += '\0';
+    }
+    return result;
+}
+}
+
+NativeHistogramCapture::NativeHistogramCapture() : previous_(current_capture)
+{
+    current_capture = this;
+}
+
+NativeHistogramCapture::~NativeHistogramCapture()
+{
+    current_capture = previous_;
+}
+
+NativeHistogramCapture *NativeHistogramCapture::current()
+{
+    return current_capture;
+}
+
+void NativeHistogramCapture::add(const std::string &family, const std::vector<prometheus::ClientMetric::Label> &labels, native_histogram_t &&native)
+{
+    families_[family][seriesKey(labels)] = std::move(native);
+}
+
+void NativeHistogramCapture::discard(const std::string &family)
+{
+    families_.erase(family);
+}
+
+const native_histogram_t *NativeHistogramCapture::find(const std::string &family, const std::vector<prometheus::ClientMetric::Label> &labels) const
+{
+    auto fit = families_.find(family);
+    if (fit == families_.end()) return nullptr;
+
+    auto sit = fit->second.find(seriesKey(labels));
+    return (sit == fit->second.end()) ? nullptr : &(sit->second);
+}
+
+prometheus::ClientMetric series_collector_t<ExponentialHistogram>::collect(const ExponentialHistogram &series, const std::string &family, std::vector<prometheus::ClientMetric::Label> &&labels)
+{
+    NativeHistogramCapture *capture = NativeHistogramCapture::current();
+
+    prometheus::ClientMetric metric;
+    native_histogram_t native;
+    if (capture) metric = series.Collect(native);
+    else metric = series.Collect();
+
+    metric.label = std::move(labels);
+    if (capture) capture->add(family, metric.label, std::move(native));
+
+    return metric;
+}
+
+}
+}
+
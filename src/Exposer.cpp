@@ -0,0 +1,640 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/Exposer.hpp>
+#include <ert/metrics/ExponentialHistogram.hpp>
+
+#include <prometheus/metric_family.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+constexpr std::size_t max_header_size = 16384;
+
+bool sendAll(int fd, const char *data, std::size_t size)
+{
+    while (size > 0) {
+        ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+std::string lower(std::string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) {
+        return std::tolower(c);
+    });
+    return value;
+}
+
+std::string trim(const std::string &value)
+{
+    const auto first = value.find_first_not_of(" \t");
+    if (first == std::string::npos) return "";
+    const auto last = value.find_last_not_of(" \t\r");
+    return value.substr(first, last - first + 1);
+}
+
+// Header list item ('value;param=x;q=0.5') with its quality, 1 by default:
+struct Preference {
+    std::string value;
+    std::vector<std::string> parameters;
+    double quality;
+};
+
+std::vector<Preference> preferences(const std::string &header)
+{
+    std::vector<Preference> result;
+    std::size_t position = 0;
+    while (position <= header.size()) {
+        auto next = header.find(',', position);
+        if (next == std::string::npos) next = header.size();
+        const std::string item = header.substr(position, next - position);
+        position = next + 1;
+
+        Preference preference{ "", {}, 1.0 };
+        std::size_t start = 0;
+        bool first = true;
+        while (start <= item.size()) {
+            auto end = item.find(';', start);
+            if (end == std::string::npos) end = item.size();
+            std::string token = lower(trim(item.substr(start, end - start)));
+            start = end + 1;
+
+            token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
+            if (first) preference.value = token;
+            else if (token.compare(0, 2, "q=") == 0) preference.quality = std::strtod(token.c_str() + 2, nullptr);
+            else if (!token.empty()) preference.parameters.push_back(token);
+            first = false;
+        }
+        if (!preference.value.empty()) result.push_back(std::move(preference));
+    }
+    return result;
+}
+
+bool hasParameter(const Preference &preference, const char *parameter)
+{
+    return std::find(preference.parameters.begin(), preference.parameters.end(), parameter) != preference.parameters.end();
+}
+
+enum class Format { Text, OpenMetrics, Protobuf };
+
+// Preferred format ('Accept' header), text when nothing else matches
+Format negotiateFormat(const std::string &accept)
+{
+    Format result = Format::Text;
+    double best = 0.0;
+
+    for (const auto &preference: preferences(accept)) {
+        Format candidate;
+        if (preference.value == "application/vnd.google.protobuf") {
+            if (!hasParameter(preference, "proto=io.prometheus.client.metricfamily") || !hasParameter(preference, "encoding=delimited")) continue;
+            candidate = Format::Protobuf;
+        }
+        else if (preference.value == "application/openmetrics-text") candidate = Format::OpenMetrics;
+        else if (preference.value == "text/plain" || preference.value == "text/*" || preference.value == "*/*") candidate = Format::Text;
+        else continue;
+
+        if (preference.quality > best) {
+            best = preference.quality;
+            result = candidate;
+        }
+    }
+    return result;
+}
+
+// Preferred content encoding ('Accept-Encoding' header) among the enabled ones. Zstd wins ties
+content_encoding_t negotiateEncoding(const std::string &acceptEncoding, const compression_config_t &config)
+{
+    const bool gzip = config.gzip;
+    const bool zstd = config.zstd && Compressor::supported(content_encoding_t::Zstd);
+
+    content_encoding_t result = content_encoding_t::Identity;
+    double best = 0.0;
+
+    for (const auto &preference: preferences(acceptEncoding)) {
+        content_encoding_t candidate;
+        if ((preference.value == "gzip" || preference.value == "x-gzip") && gzip) candidate = content_encoding_t::Gzip;
+        else if (preference.value == "zstd" && zstd) candidate = content_encoding_t::Zstd;
+        else if (preference.value == "*" && (gzip || zstd)) candidate = zstd ? content_encoding_t::Zstd : content_encoding_t::Gzip;
+        else continue;
+
+        if (preference.quality > best || (preference.quality == best && best > 0.0 && candidate == content_encoding_t::Zstd)) {
+            best = preference.quality;
+            result = candidate;
+        }
+    }
+    return result;
+}
+
+void sendStatus(int fd, const char *status, bool keepAlive)
+{
+    std::string response("HTTP/1.1 ");
+    response += status;
+    response += "\r\nContent-Type: text/plain\r\nContent-Length: 0\r\nConnection: ";
+    response += keepAlive ? "keep-alive" : "close";
+    response += "\r\n\r\n";
+    sendAll(fd, response.data(), response.size());
+}
+}
+
+Exposer::Exposer(const std::string &bindAddress, std::size_t numThreads, int backlog) : listen_fd_(-1), wake_fd_(-1), port_(0), stopping_(false)
+{
+    // Split host and port ('host:port', '[v6]:port' or ':port'):
+    const auto colon = bindAddress.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Invalid bind address (missing port): " + bindAddress);
+    }
+    std::string host = bindAddress.substr(0, colon);
+    const std::string port = bindAddress.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+    struct addrinfo *addresses = nullptr;
+    int rc = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+    if (rc != 0) {
+        throw std::runtime_error("Cannot resolve bind address " + bindAddress + ": " + gai_strerror(rc));
+    }
+
+    for (auto address = addresses; address; address = address->ai_next) {
+        int fd = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, address->ai_protocol);
+        if (fd < 0) continue;
+
+        int enable = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        if (::bind(fd, address->ai_addr, address->ai_addrlen) == 0 && ::listen(fd, (backlog > 0) ? backlog : SOMAXCONN) == 0) {
+            listen_fd_ = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    ::freeaddrinfo(addresses);
+
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("Cannot bind address " + bindAddress + ": " + std::strerror(errno));
+    }
+
+    struct sockaddr_storage bound {};
+    socklen_t length = sizeof(bound);
+    if (::getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&bound), &length) == 0) {
+        port_ = ntohs((bound.ss_family == AF_INET6) ? reinterpret_cast<struct sockaddr_in6*>(&bound)->sin6_port : reinterpret_cast<struct sockaddr_in*>(&bound)->sin_port);
+    }
+
+    wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd_ < 0) {
+        ::close(listen_fd_);
+        throw std::runtime_error(std::string("Cannot create exposer event: ") + std::strerror(errno));
+    }
+
+    numThreads = std::max<std::size_t>(1, numThreads);
+    for (std::size_t k = 0; k < numThreads; k++) {
+        workers_.emplace_back(&Exposer::workLoop, this);
+    }
+    poller_ = std::thread(&Exposer::pollLoop, this);
+}
+
+Exposer::~Exposer()
+{
+    stopping_.store(true);
+    wake();
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (int fd: busy_) ::shutdown(fd, SHUT_RDWR);
+    }
+    queue_cv_.notify_all();
+
+    if (poller_.joinable()) poller_.join();
+    for (auto &worker: workers_) worker.join();
+
+    for (const auto &connection: queue_) ::close(connection->fd);
+    for (const auto &connection: returned_) ::close(connection->fd);
+    ::close(wake_fd_);
+    ::close(listen_fd_);
+}
+
+void Exposer::RegisterCollectable(const std::weak_ptr<prometheus::Collectable> &collectable, const std::string &uri)
+{
+    auto target = endpoint(uri);
+    std::lock_guard<std::mutex> lock(target->collectables_mutex);
+    target->collectables.push_back(collectable);
+}
+
+void Exposer::RemoveCollectable(const std::weak_ptr<prometheus::Collectable> &collectable, const std::string &uri)
+{
+    auto target = endpoint(uri);
+    std::lock_guard<std::mutex> lock(target->collectables_mutex);
+
+    auto locked = collectable.lock();
+    auto &collectables = target->collectables;
+    collectables.erase(std::remove_if(collectables.begin(), collectables.end(), [&](const std::weak_ptr<prometheus::Collectable> &candidate) {
+        return candidate.lock() == locked;
+    }), collectables.end());
+}
+
+std::shared_ptr<Exposer::Endpoint> Exposer::endpoint(const std::string &uri)
+{
+    std::lock_guard<std::mutex> lock(endpoints_mutex_);
+
+    auto &result = endpoints_[uri];
+    if (!result) result = std::make_shared<Endpoint>();
+    return result;
+}
+
+void Exposer::wake()
+{
+    const std::uint64_t one = 1;
+    ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+    (void)written; // already signaled if the counter is full
+}
+
+void Exposer::accept(std::vector<std::unique_ptr<Connection>> &idle)
+{
+    const struct timeval timeout { io_timeout_ms / 1000, (io_timeout_ms % 1000) * 1000 };
+
+    while (true) {
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) { // wait for resources
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            return; // EAGAIN: no more pending connections
+        }
+
+        int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        connection->idle_since = std::chrono::steady_clock::now();
+        idle.push_back(std::move(connection));
+    }
+}
+
+void Exposer::pollLoop()
+{
+    std::vector<std::unique_ptr<Connection>> idle, ready;
+    std::vector<struct pollfd> fds;
+
+    while (!stopping_.load()) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            const auto now = std::chrono::steady_clock::now();
+            for (auto &connection: returned_) {
+                connection->idle_since = now;
+                idle.push_back(std::move(connection));
+            }
+            returned_.clear();
+        }
+
+        fds.clear();
+        fds.push_back({ listen_fd_, POLLIN, 0 });
+        fds.push_back({ wake_fd_, POLLIN, 0 });
+        for (const auto &connection: idle) fds.push_back({ connection->fd, POLLIN, 0 });
+
+        int rc = ::poll(fds.data(), fds.size(), 1000); // idle timeouts are checked at least every second
+        if (rc < 0 && errno != EINTR) {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("Exposer poll error: %s", std::strerror(errno)), ERT_FILE_LOCATION);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        if (stopping_.load()) break;
+
+        if (fds[1].revents & POLLIN) {
+            std::uint64_t value;
+            ssize_t received = ::read(wake_fd_, &value, sizeof(value));
+            (void)received;
+        }
+
+        // Connections ready to read go to workers, idle ones are closed after timeout:
+        const auto now = std::chrono::steady_clock::now();
+        std::size_t kept = 0;
+        for (std::size_t k = 0; k < idle.size(); k++) {
+            const short events = (k + 2 < fds.size()) ? fds[k + 2].revents : 0;
+            if (events) {
+                ready.push_back(std::move(idle[k]));
+            }
+            else if (now - idle[k]->idle_since > std::chrono::milliseconds(idle_timeout_ms)) {
+                ::close(idle[k]->fd);
+            }
+            else {
+                idle[kept++] = std::move(idle[k]);
+            }
+        }
+        idle.resize(kept);
+
+        if (fds[0].revents & POLLIN) accept(idle);
+
+        if (!ready.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                for (auto &connection: ready) {
+                    busy_.insert(connection->fd);
+                    queue_.push_back(std::move(connection));
+                }
+            }
+            ready.clear();
+            queue_cv_.notify_all();
+        }
+    }
+
+    for (const auto &connection: idle) ::close(connection->fd);
+    ::shutdown(listen_fd_, SHUT_RDWR);
+}
+
+void Exposer::workLoop()
+{
+    while (true) {
+        std::unique_ptr<Connection> connection;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this]() {
+                return stopping_.load() || !queue_.empty();
+            });
+            if (stopping_.load()) return;
+
+            connection = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        const int fd = connection->fd;
+        const bool keep = serve(*connection);
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            busy_.erase(fd);
+            if (keep && !stopping_.load()) returned_.push_back(std::move(connection));
+        }
+
+        if (connection) ::close(fd);
+        else wake();
+    }
+}
+
+bool Exposer::serve(Connection &connection)
+{
+    const int fd = connection.fd;
+    std::string &buffer = connection.input;
+
+    // Read what is available (the poller found the socket ready):
+    bool closed = false;
+    char chunk[4096];
+    while (buffer.size() <= max_header_size) {
+        ssize_t received = ::recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received > 0) {
+            buffer.append(chunk, received);
+            continue;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        closed = true; // closed by peer (requests already received are served) or error
+        break;
+    }
+
+    // Serve complete requests:
+    std::size_t end;
+    while (!stopping_.load() && (end = buffer.find("\r\n\r\n")) != std::string::npos) {
+        const std::string header = buffer.substr(0, end);
+        buffer.erase(0, end + 4); // pipelined requests are kept
+
+        // Request line:
+        const auto lineEnd = header.find("\r\n");
+        const std::string requestLine = header.substr(0, lineEnd);
+        const auto firstSpace = requestLine.find(' ');
+        const auto secondSpace = requestLine.find(' ', firstSpace + 1);
+        if (firstSpace == std::string::npos || secondSpace == std::string::npos) {
+            sendStatus(fd, "400 Bad Request", false);
+            return false;
+        }
+        const std::string method = requestLine.substr(0, firstSpace);
+        std::string uri = requestLine.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+        const std::string version = requestLine.substr(secondSpace + 1);
+        uri = uri.substr(0, uri.find('?'));
+
+        // Headers (connection management and content negotiation):
+        bool keepAlive = (version == "HTTP/1.1");
+        std::string accept, acceptEncoding;
+        std::size_t position = (lineEnd == std::string::npos) ? header.size() : lineEnd + 2;
+        while (position < header.size()) {
+            auto next = header.find("\r\n", position);
+            if (next == std::string::npos) next = header.size();
+            const std::string line = header.substr(position, next - position);
+            position = next + 2;
+
+            const auto colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            const std::string name = lower(trim(line.substr(0, colon)));
+            if (name == "connection") {
+                const std::string value = lower(trim(line.substr(colon + 1)));
+                if (value == "close") keepAlive = false;
+                else if (value == "keep-alive") keepAlive = true;
+            }
+            else if (name == "accept") {
+                accept = trim(line.substr(colon + 1));
+            }
+            else if (name == "accept-encoding") {
+                acceptEncoding = trim(line.substr(colon + 1));
+            }
+        }
+
+        if (!respond(connection, method, uri, keepAlive && !closed, accept, acceptEncoding) || !keepAlive) return false;
+    }
+
+    if (buffer.size() > max_header_size) {
+        sendStatus(fd, "431 Request Header Fields Too Large", false);
+        return false;
+    }
+    return !closed && !stopping_.load();
+}
+
+bool Exposer::respond(Connection &connection, const std::string &method, const std::string &uri, bool keepAlive, const std::string &accept, const std::string &acceptEncoding)
+{
+    const int fd = connection.fd;
+
+    if (method != "GET" && method != "HEAD") {
+        sendStatus(fd, "405 Method Not Allowed", keepAlive);
+        return true;
+    }
+
+    std::shared_ptr<Endpoint> target;
+    {
+        std::lock_guard<std::mutex> lock(endpoints_mutex_);
+        auto it = endpoints_.find(uri);
+        if (it != endpoints_.end()) target = it->second;
+    }
+    if (!target) {
+        sendStatus(fd, "404 Not Found", keepAlive);
+        return true;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    std::vector<std::weak_ptr<prometheus::Collectable>> collectables;
+    {
+        std::lock_guard<std::mutex> lock(target->collectables_mutex);
+        collectables = target->collectables;
+    }
+
+    // Protobuf scrapes also expose exponential histograms as native histograms, captured while collecting:
+    const Format format = negotiateFormat(accept);
+    std::optional<NativeHistogramCapture> capture;
+    if (format == Format::Protobuf) capture.emplace();
+
+    std::vector<prometheus::MetricFamily> families;
+    for (const auto &weak: collectables) {
+        auto collectable = weak.lock();
+        if (!collectable) continue;
+        auto collected = collectable->Collect();
+        families.insert(families.end(), std::make_move_iterator(collected.begin()), std::make_move_iterator(collected.end()));
+    }
+
+    compression_config_t compression;
+    {
+        std::lock_guard<std::mutex> compressionLock(compression_mutex_);
+        compression = compression_;
+    }
+
+    // Encode (pieces are compressed or joined without intermediate copies) and copy the response, so it is sent
+    // without holding the endpoint:
+    std::unique_lock<std::mutex> lock(target->mutex);
+    const char *contentType;
+    std::vector<std::string_view> encoded;
+    const std::vector<std::string_view> *pieces = &encoded;
+    if (format == Format::Protobuf) {
+        target->encoded.clear();
+        target->protobuf.encode(families, target->encoded);
+        encoded.push_back(target->encoded);
+        contentType = ProtobufEncoder::contentType();
+    }
+    else {
+        TextEncoder &encoder = (format == Format::OpenMetrics) ? target->open_metrics : target->text;
+        pieces = &encoder.prepare(families);
+        contentType = encoder.contentType();
+    }
+
+    std::size_t size = 0;
+    for (std::string_view piece: *pieces) size += piece.size();
+
+    content_encoding_t encoding = (size >= compression.min_size) ? negotiateEncoding(acceptEncoding, compression) : content_encoding_t::Identity;
+    const int level = (encoding == content_encoding_t::Zstd) ? compression.zstd_level : compression.gzip_level;
+    if (!target->compressor.compress(encoding, level, *pieces, target->body)) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Cannot compress scrape with %s, sent uncompressed", Compressor::name(encoding)), ERT_FILE_LOCATION);
+        encoding = content_encoding_t::Identity;
+        target->compressor.compress(encoding, 0, *pieces, target->body);
+    }
+
+    std::string head("HTTP/1.1 200 OK\r\nContent-Type: ");
+    head += contentType;
+    if (encoding != content_encoding_t::Identity) {
+        head += "\r\nContent-Encoding: ";
+        head += Compressor::name(encoding);
+    }
+    head += "\r\nContent-Length: ";
+    head += std::to_string(target->body.size());
+    head += "\r\nConnection: ";
+    head += keepAlive ? "keep-alive" : "close";
+    head += "\r\n\r\n";
+
+    const std::size_t bytes = target->body.size();
+    connection.output = head;
+    if (method != "HEAD") connection.output += target->body;
+    lock.unlock();
+
+    if (!sendAll(fd, connection.output.data(), connection.output.size())) return false;
+
+    std::function<void(const std::string&, double, std::size_t)> observer;
+    {
+        std::lock_guard<std::mutex> observerLock(observer_mutex_);
+        observer = observer_;
+    }
+    if (observer) {
+        observer(uri, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(), bytes);
+    }
+
+    return true;
+}
+
+void Exposer::SetScrapeObserver(std::function<void(const std::string &uri, double seconds, std::size_t bytes)> observer)
+{
+    std::lock_guard<std::mutex> lock(observer_mutex_);
+    observer_ = std::move(observer);
+}
+
+void Exposer::SetCompression(const compression_config_t &config)
+{
+    std::lock_guard<std::mutex> lock(compression_mutex_);
+    compression_ = config;
+}
+
+}
+}
+
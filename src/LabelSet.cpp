@@ -0,0 +1,260 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/metrics/LabelSet.hpp>
+#include <ert/metrics/ReadMostly.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+class Interner {
+    StripedSharedMutex mutex_;
+    std::unordered_set<std::string_view> index_;
+    std::deque<std::string> storage_; // stable addresses
+
+public:
+
+    std::string_view intern(std::string_view value) {
+        {
+            std::shared_lock<StripedSharedMutex> lock(mutex_);
+            auto it = index_.find(value);
+            if (it != index_.end()) return *it;
+        }
+
+        std::unique_lock<StripedSharedMutex> lock(mutex_);
+        auto it = index_.find(value);
+        if (it != index_.end()) return *it;
+
+        storage_.emplace_back(value);
+        return *(index_.insert(storage_.back()).first);
+    }
+};
+
+// Never destroyed: label sets may still be used by other static objects on exit
+Interner &interner()
+{
+    static Interner *result = new Interner();
+    return *result;
+}
+}
+
+LabelSet::LabelSet(std::initializer_list<std::pair<std::string_view, std::string_view>> labels)
+{
+    for (const auto &label: labels) put(intern(label.first), label.second);
+    own();
+    rehash();
+}
+
+LabelSet::LabelSet(const labels_t &labels)
+{
+    for (const auto &label: labels) put(intern(label.first), label.second);
+    own();
+    rehash();
+}
+
+LabelSet LabelSet::view(const labels_t &labels)
+{
+    LabelSet result;
+    for (const auto &label: labels) result.put(label.first, label.second);
+    result.rehash();
+    return result;
+}
+
+std::string_view LabelSet::intern(std::string_view value)
+{
+    return interner().intern(value);
+}
+
+void LabelSet::put(std::string_view key, std::string_view value)
+{
+    std::size_t pos = 0;
+    while (pos < size_ && labels_[pos].first < key) pos++;
+
+    if (pos < size_ && labels_[pos].first == key) {
+        labels_[pos].second = value;
+        return;
+    }
+
+    if (size_ == label_set_capacity) {
+        throw std::invalid_argument("Too many labels");
+    }
+
+    for (std::size_t k = size_; k > pos; k--) labels_[k] = labels_[k - 1];
+    labels_[pos] = {key, value};
+    size_++;
+}
+
+void LabelSet::own()
+{
+    std::size_t total = 0;
+    for (std::size_t k = 0; k < size_; k++) total += labels_[k].second.size();
+
+    // Values may be viewed on our own storage (i.e. 'with()' on a copy), so they are copied to a new one:
+    std::array<char, label_set_storage> buffer;
+    std::string heap;
+    char *out = buffer.data();
+    if (total > label_set_storage) {
+        heap.resize(total);
+        out = &heap[0];
+    }
+
+    std::array<std::size_t, label_set_capacity> offsets;
+    std::size_t offset = 0;
+    for (std::size_t k = 0; k < size_; k++) {
+        offsets[k] = offset;
+        if (!labels_[k].second.empty()) std::memcpy(out + offset, labels_[k].second.data(), labels_[k].second.size());
+        offset += labels_[k].second.size();
+    }
+
+    if (heap.empty()) std::memcpy(inline_.data(), buffer.data(), total);
+    heap_ = std::move(heap);
+    owned_ = true;
+
+    const char *base = storage();
+    for (std::size_t k = 0; k < size_; k++) labels_[k].second = std::string_view(base + offsets[k], labels_[k].second.size());
+}
+
+void LabelSet::assign(const LabelSet &other)
+{
+    labels_ = other.labels_;
+    size_ = other.size_;
+    hash_ = other.hash_;
+    owned_ = other.owned_;
+    if (!owned_) return;
+
+    heap_ = other.heap_;
+    if (heap_.empty()) {
+        std::size_t total = 0;
+        for (std::size_t k = 0; k < size_; k++) total += labels_[k].second.size();
+        std::memcpy(inline_.data(), other.inline_.data(), total);
+    }
+
+    const char *from = other.storage();
+    const char *base = storage();
+    for (std::size_t k = 0; k < size_; k++) {
+        labels_[k].second = std::string_view(base + (labels_[k].second.data() - from), labels_[k].second.size());
+    }
+}
+
+void LabelSet::rehash()
+{
+    std::hash<std::string_view> hasher;
+    std::size_t seed = size_;
+
+    for (std::size_t k = 0; k < size_; k++) {
+        seed ^= hasher(labels_[k].first) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= hasher(labels_[k].second) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    hash_ = seed;
+}
+
+LabelSet LabelSet::with(std::string_view key, std::string_view value) const
+{
+    // Keys already in the set are not looked up again:
+    const label_t *existing = std::find_if(begin(), end(), [key](const label_t &label) { return label.first == key; });
+
+    LabelSet result(*this);
+    result.put(existing != end() ? existing->first : intern(key), value);
+    result.own();
+    result.rehash();
+    return result;
+}
+
+LabelSet LabelSet::merge(const LabelSet &other) const
+{
+    LabelSet result;
+    std::size_t i = 0, j = 0;
+
+    while (i < size_ || j < other.size_) {
+        if (result.size_ == label_set_capacity) {
+            throw std::invalid_argument("Too many labels");
+        }
+
+        if (j == other.size_ || (i < size_ && labels_[i].first < other.labels_[j].first)) {
+            result.labels_[result.size_++] = labels_[i++];
+        }
+        else {
+            if (i < size_ && labels_[i].first == other.labels_[j].first) i++; // replaced
+            result.labels_[result.size_++] = other.labels_[j++];
+        }
+    }
+
+    result.own();
+    result.rehash();
+    return result;
+}
+
+labels_t LabelSet::labels() const
+{
+    labels_t result;
+    for (std::size_t k = 0; k < size_; k++) {
+        result.emplace(std::string(labels_[k].first), std::string(labels_[k].second));
+    }
+    return result;
+}
+
+bool LabelSet::operator==(const LabelSet &other) const
+{
+    if (size_ != other.size_ || hash_ != other.hash_) return false;
+
+    // Interned keys compare by pointer, values and views (@see view()) by content:
+    auto same = [](std::string_view a, std::string_view b) {
+        return a.data() == b.data() ? a.size() == b.size() : a == b;
+    };
+
+    for (std::size_t k = 0; k < size_; k++) {
+        if (!same(labels_[k].first, other.labels_[k].first) || !same(labels_[k].second, other.labels_[k].second)) return false;
+    }
+
+    return true;
+}
+
+}
+}
+
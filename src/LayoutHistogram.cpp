@@ -0,0 +1,79 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/metrics/LayoutHistogram.hpp>
+
+#include <limits>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+LayoutHistogram::LayoutHistogram(bucket_layout_t layout) : layout_(std::move(layout))
+{
+    if (!layout_) {
+        throw std::invalid_argument("Missing bucket layout");
+    }
+
+    counts_.reset(new std::atomic<std::uint64_t>[layout_->buckets()]);
+    for (std::size_t k = 0; k < layout_->buckets(); k++) counts_[k].store(0, std::memory_order_relaxed);
+}
+
+prometheus::ClientMetric LayoutHistogram::Collect() const
+{
+    const bucket_boundaries_t &boundaries = layout_->boundaries();
+
+    prometheus::ClientMetric metric;
+    metric.histogram.bucket.reserve(layout_->buckets());
+
+    std::uint64_t cumulative = 0;
+    for (std::size_t k = 0; k < layout_->buckets(); k++) {
+        cumulative += counts_[k].load(std::memory_order_relaxed);
+        prometheus::ClientMetric::Bucket bucket;
+        bucket.cumulative_count = cumulative;
+        bucket.upper_bound = (k == boundaries.size()) ? std::numeric_limits<double>::infinity() : boundaries[k];
+        metric.histogram.bucket.push_back(bucket);
+    }
+    metric.histogram.sample_count = cumulative;
+    metric.histogram.sample_sum = sum_.load(std::memory_order_relaxed);
+
+    return metric;
+}
+
+}
+}
+
@@ -0,0 +1,218 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/LocalHistogram.hpp>
+
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+/**
+ * Private arrays of one thread. Cells are only written by the owner thread (relaxed load and store, so plain
+ * memory accesses), and read by the scrape.
+ */
+struct alignas(64) LocalHistogram::Shard {
+    explicit Shard(std::size_t buckets) : counts(new std::atomic<std::uint64_t>[buckets]), size(buckets) {
+        for (std::size_t k = 0; k < size; k++) counts[k].store(0, std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+    std::size_t size;
+    std::atomic<double> sum{0.0};
+    std::atomic<bool> retired{false}; // owner thread finished
+};
+
+namespace
+{
+/** Histogram indexes on threads shards tables, recycled on destruction */
+struct Indexes {
+    std::mutex mutex;
+    std::vector<std::uint64_t> serials; // serial of the live histogram by index (0: free)
+    std::vector<std::size_t> free;
+    std::uint64_t next_serial{1};
+};
+
+// Never destroyed: threads may finish after static destruction
+Indexes &indexes()
+{
+    static Indexes *result = new Indexes();
+    return *result;
+}
+
+/**
+ * Shards of the current thread, indexed by histogram index. They are owned by their histograms, so a slot is
+ * only used while its serial is the live one for the index; shards are retired on thread exit.
+ */
+struct ThreadShards {
+    struct Slot {
+        std::uint64_t serial{};
+        LocalHistogram::Shard *shard{};
+    };
+
+    std::vector<Slot> slots;
+
+    ~ThreadShards() {
+        // Histograms release their index under this lock before destroying their shards:
+        Indexes &ids = indexes();
+        std::lock_guard<std::mutex> lock(ids.mutex);
+
+        for (std::size_t k = 0; k < slots.size(); k++) {
+            if (slots[k].shard && ids.serials[k] == slots[k].serial) slots[k].shard->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadShards thread_shards;
+}
+
+LocalHistogram::LocalHistogram(const bucket_boundaries_t &boundaries)
+    : LocalHistogram(std::make_shared<BucketLayout>("", boundaries))
+{
+}
+
+LocalHistogram::LocalHistogram(bucket_layout_t layout)
+    : layout_(std::move(layout)), retired_sum_(0.0)
+{
+    if (!layout_) {
+        throw std::invalid_argument("Missing bucket layout");
+    }
+    retired_counts_.assign(layout_->buckets(), 0);
+
+    Indexes &ids = indexes();
+    std::lock_guard<std::mutex> lock(ids.mutex);
+
+    if (ids.free.empty()) {
+        id_ = ids.serials.size();
+        ids.serials.push_back(0);
+    }
+    else {
+        id_ = ids.free.back();
+        ids.free.pop_back();
+    }
+    serial_ = ids.next_serial++;
+    ids.serials[id_] = serial_;
+}
+
+LocalHistogram::~LocalHistogram()
+{
+    Indexes &ids = indexes();
+    std::lock_guard<std::mutex> lock(ids.mutex);
+
+    ids.serials[id_] = 0;
+    ids.free.push_back(id_);
+}
+
+LocalHistogram::Shard &LocalHistogram::localShard()
+{
+    auto &slots = thread_shards.slots;
+    if (id_ < slots.size() && slots[id_].serial == serial_) {
+        return *slots[id_].shard;
+    }
+
+    // First observation from this thread (a previous owner of the index may have left a slot):
+    if (id_ >= slots.size()) slots.resize(id_ + 1);
+    auto shard = std::make_unique<Shard>(layout_->buckets());
+    slots[id_] = {serial_, shard.get()};
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    shards_.push_back(std::move(shard));
+
+    return *slots[id_].shard;
+}
+
+void LocalHistogram::Observe(double value)
+{
+    Shard &shard = localShard();
+
+    const std::size_t index = layout_->index(value);
+    auto &count = shard.counts[index];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    shard.sum.store(shard.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+prometheus::ClientMetric LocalHistogram::Collect() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::uint64_t> counts(retired_counts_);
+    double sum = retired_sum_;
+
+    for (auto it = shards_.begin(); it != shards_.end();) {
+        const Shard &shard = **it;
+        const bool retired = shard.retired.load(std::memory_order_acquire);
+
+        for (std::size_t k = 0; k < shard.size; k++) {
+            counts[k] += shard.counts[k].load(std::memory_order_relaxed);
+        }
+        sum += shard.sum.load(std::memory_order_relaxed);
+
+        if (retired) { // fold into retired counts: owner thread will not write anymore
+            for (std::size_t k = 0; k < shard.size; k++) {
+                retired_counts_[k] += shard.counts[k].load(std::memory_order_relaxed);
+            }
+            retired_sum_ += shard.sum.load(std::memory_order_relaxed);
+            it = shards_.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+
+    const bucket_boundaries_t &boundaries = layout_->boundaries();
+
+    prometheus::ClientMetric metric;
+    metric.histogram.bucket.reserve(counts.size());
+
+    std::uint64_t cumulative = 0;
+    for (std::size_t k = 0; k < counts.size(); k++) {
+        cumulative += counts[k];
+        prometheus::ClientMetric::Bucket bucket;
+        bucket.cumulative_count = cumulative;
+        bucket.upper_bound = (k == boundaries.size()) ? std::numeric_limits<double>::infinity() : boundaries[k];
+        metric.histogram.bucket.push_back(bucket);
+    }
+    metric.histogram.sample_count = cumulative;
+    metric.histogram.sample_sum = sum;
+
+    return metric;
+}
+
+}
+}
+
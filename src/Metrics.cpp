@@ -34,140 +34,1283 @@ SOFTWARE.
 #include <ert/tracing/Logger.hpp>
 
 #include <ert/metrics/Metrics.hpp>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <iostream>
+#include <limits>
+#include <shared_mutex>
+#include <stdexcept>
+#include <type_traits>
 
 namespace ert
 {
 namespace metrics
 {
 
-bool Metrics::serve(const std::string & endpoint)
+namespace
 {
 
+// Self-metrics kinds, indexed by kindIndex():
+const char *kind_names[] = {"counter", "gauge", "histogram"};
+
+template <typename T>
+constexpr std::size_t kindIndex()
+{
+    return std::is_same<T, counter_t>::value ? 0 : (std::is_same<T, gauge_t>::value ? 1 : 2);
+}
+
+// Coarse monotonic time (nanoseconds), cheap enough for updates:
+std::int64_t coarseNow()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return std::int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// One of every (mask + 1) calls on each thread returns true:
+bool sampled(std::uint32_t mask)
+{
+    thread_local std::uint32_t calls = 0;
+    return ((++calls) & mask) == 0;
+}
+
+}
+
+std::size_t labels_hash_t::operator()(const labels_t &labels) const
+{
+    std::hash<std::string> hasher;
+    std::size_t seed = labels.size();
+
+    for (const auto &label: labels) {
+        seed ^= hasher(label.first) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= hasher(label.second) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    return seed;
+}
+
+template <typename T, typename B>
+prometheus::Family<T> &Metrics::addFamily(family_entries_t<T> &families, const char *kind, B builder, const std::string &name, const std::string &help, const labels_t &labels)
+{
+    auto result = families.insert(name, [&]() {
+        return std::make_unique<FamilyEntry<T>>(builder.Name(name).Help(help).Labels(labels).Register(*registry_));
+    });
+
+    if (!result.second)
+    {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("%s family %s already registered", kind, name.c_str()), ERT_FILE_LOCATION);
+    }
+    else if constexpr (!std::is_same<T, gauge_t>::value)
+    {
+        std::lock_guard<std::mutex> lock(persistence_mutex_);
+        restore(result.first->family);
+    }
+
+    return result.first->family;
+}
+
+template <typename T>
+Metrics::FamilyEntry<T> *Metrics::findFamily(const family_entries_t<T> &families, const std::string &familyName, const char *kind) const
+{
+    FamilyEntry<T> *result = families.find(familyName);
+    if (!result)
+    {
+        lookup_misses_[kindIndex<T>()].fetch_add(1, std::memory_order_relaxed);
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("%s family %s not found", kind, familyName.c_str()), ERT_FILE_LOCATION);
+    }
+
+    return result;
+}
+
+template <typename Lock, typename T>
+Lock Metrics::lockSeries(FamilyEntry<T> &entry)
+{
+    if (!self_metrics_.load(std::memory_order_relaxed)) return Lock(entry.mutex);
+
+    std::uint32_t mask = self_sampling_mask_.load(std::memory_order_relaxed);
+    if (!sampled(mask)) return Lock(entry.mutex);
+
+    auto begin = std::chrono::steady_clock::now();
+    Lock lock(entry.mutex);
+    auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    entry.lock_wait_ns.fetch_add(std::uint64_t(waited) * (mask + 1), std::memory_order_relaxed);
+
+    return lock;
+}
+
+template <typename T>
+T *Metrics::lookup(FamilyEntry<T> &entry, const LabelSet &labels, bool pin)
+{
+    auto sit = entry.series.find(labels);
+    if (sit == entry.series.end()) return nullptr;
+
+    if (pin) sit->second.pinned.store(true, std::memory_order_relaxed);
+    else if (entry.ttl_ns.load(std::memory_order_relaxed)) sit->second.updated.store(coarseNow(), std::memory_order_relaxed);
+
+    return sit->second.series;
+}
+
+template <typename T>
+T *Metrics::find(FamilyEntry<T> &entry, const LabelSet &labels, bool pin, bool &overflowed)
+{
+    T *result = lookup(entry, labels, pin);
+    overflowed = (!result && entry.max_series && entry.series.size() >= entry.max_series);
+
+    return overflowed ? entry.overflow : result;
+}
+
+template <typename T, typename... Args>
+void Metrics::create(FamilyEntry<T> &entry, const LabelSet &labels, bool pin, Args&&... args)
+{
+    // The family series is added out of the series cache lock: a scrape holding the family lock only stalls
+    // this thread, not every update on the family
+    labels_t map;
+    bool full;
+    std::uint64_t removals;
+    while (true) {
+        {
+            auto lock = lockSeries<std::shared_lock<StripedSharedMutex>>(entry);
+
+            if (lookup(entry, labels, pin)) return;
+            full = (entry.max_series && entry.series.size() >= entry.max_series);
+            if (full && entry.overflow) return;
+            if (!entry.removing) {
+                map = full ? entry.overflow_labels : labels.labels();
+                removals = entry.removals;
+                break;
+            }
+        }
+
+        // Family may still return evicted series: wait for pending removals
+        std::lock_guard<std::mutex> removal(entry.removal_mutex);
+    }
+
+    bool existing = !full && entry.family.Has(map); // created out of this class: references may be held
+
+    T *result = nullptr;
+    try {
+        result = &(entry.family.Add(map, std::forward<Args>(args)...));
+    }
+    catch(std::exception &e) {
+        ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
+        return;
+    }
+
+    auto lock = lockSeries<std::unique_lock<StripedSharedMutex>>(entry);
+
+    if (full) {
+        if (!entry.overflow) entry.overflow = result;
+        return;
+    }
+
+    // Concurrent creations get the same series from the family, the first one is cached (cap may be exceeded by them):
+    if (lookup(entry, labels, pin)) return;
+
+    // Series evicted meanwhile may be the one returned by the family (removed now or soon), so it is created again:
+    if (entry.removals != removals) {
+        lock.unlock();
+        create(entry, labels, pin, std::forward<Args>(args)...);
+        return;
+    }
+
+    // Cache key views strings owned by the entry (released on eviction), instead of interning them:
+    auto owned = std::make_unique<const labels_t>(std::move(map));
+    SeriesEntry<T> &series = entry.series[LabelSet::view(*owned)];
+    series.labels = std::move(owned);
+    series.series = result;
+    series.pinned.store(pin || existing, std::memory_order_relaxed);
+    if (entry.ttl_ns.load(std::memory_order_relaxed)) series.updated.store(coarseNow(), std::memory_order_relaxed);
+    entry.series_created.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T, typename... Args>
+T *Metrics::resolve(FamilyEntry<T> &entry, const LabelSet &labels, Args&&... args)
+{
+    auto cached = [this, &entry, &labels]() -> T* {
+        auto lock = lockSeries<std::shared_lock<StripedSharedMutex>>(entry);
+
+        bool overflowed;
+        T *result = find(entry, labels, true, overflowed);
+        if (result && overflowed && entry.dropped) entry.dropped->Increment();
+        return result;
+    };
+
+    if (T *result = cached()) return result;
+
+    create(entry, labels, true, std::forward<Args>(args)...);
+    return cached();
+}
+
+template <typename T, typename U, typename... Args>
+void Metrics::update(FamilyEntry<T> &entry, const LabelSet &labels, U &&apply, Args&&... args)
+{
+    auto cached = [this, &entry, &labels, &apply]() -> bool {
+        auto lock = lockSeries<std::shared_lock<StripedSharedMutex>>(entry);
+
+        bool overflowed;
+        T *series = find(entry, labels, false, overflowed);
+        if (!series) return false;
+
+        if (overflowed && entry.dropped) entry.dropped->Increment();
+        apply(*series);
+        return true;
+    };
+
+    if (cached()) return;
+
+    create(entry, labels, false, std::forward<Args>(args)...);
+    cached();
+}
+
+template <typename T, typename... Args>
+T *Metrics::resolve(FamilyEntry<T> &entry, const labels_t &labels, Args&&... args)
+{
+    if (labels.size() <= label_set_capacity) return resolve(entry, LabelSet::view(labels), std::forward<Args>(args)...);
+
+    // Larger sets do not fit in a cache key: series is not cached (neither limited nor evicted)
+    try {
+        return &(entry.family.Add(labels, std::forward<Args>(args)...));
+    }
+    catch(std::exception &e) {
+        ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
+    }
+
+    return nullptr;
+}
+
+template <typename T, typename U, typename... Args>
+void Metrics::update(FamilyEntry<T> &entry, const labels_t &labels, U &&apply, Args&&... args)
+{
+    if (labels.size() <= label_set_capacity) {
+        update(entry, LabelSet::view(labels), std::forward<U>(apply), std::forward<Args>(args)...);
+        return;
+    }
+
+    // Larger sets do not fit in a cache key: applied on the family, as for series created out of this class
+    try {
+        apply(entry.family.Add(labels, std::forward<Args>(args)...));
+    }
+    catch(std::exception &e) {
+        ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
+    }
+}
+
+template <typename F, typename... Args>
+F &Metrics::addSeriesFamily(series_families_t<F> &families, const char *kind, const std::string &name, Args&&... args)
+{
+    std::shared_ptr<F> family;
+    {
+        std::lock_guard<std::mutex> lock(series_families_mutex_);
+
+        auto fit = families.find(name);
+        if (fit != families.end())
+        {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("%s family %s already registered", kind, name.c_str()), ERT_FILE_LOCATION);
+            return *(fit->second);
+        }
+
+        family = std::make_shared<F>(name, std::forward<Args>(args)...);
+        families.emplace(name, family);
+    }
+
+    registerCollectable(family);
+
+    return *family;
+}
+
+bool Metrics::serve(const std::string & endpoint, const compression_config_t &compression)
+{
+    serve_options_t options;
+    options.endpoint = endpoint;
+    options.compression = compression;
+    return serve(options);
+}
+
+class Metrics::FamiliesCollectable : public prometheus::Collectable {
+    const Metrics &metrics_;
+    std::vector<std::string> names_;
+    mutable std::mutex mutex_; // protects resolved families
+    mutable std::vector<std::shared_ptr<prometheus::Collectable>> resolved_;
+
+public:
+    FamiliesCollectable(const Metrics &metrics, const std::vector<std::string> &names) : metrics_(metrics), names_(names), resolved_(names.size()) {}
+
+    std::vector<prometheus::MetricFamily> Collect() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<prometheus::MetricFamily> result;
+        for (std::size_t k = 0; k < names_.size(); k++) {
+            if (!resolved_[k]) resolved_[k] = metrics_.familyCollectable(names_[k]);
+            if (!resolved_[k]) continue;
+
+            auto collected = resolved_[k]->Collect();
+            result.insert(result.end(), std::make_move_iterator(collected.begin()), std::make_move_iterator(collected.end()));
+        }
+        return result;
+    }
+};
+
+std::shared_ptr<prometheus::Collectable> Metrics::familyCollectable(const std::string &name) const
+{
+    // Prometheus families are owned by the registry:
+    if (auto entry = counter_families_.find(name)) return std::shared_ptr<prometheus::Collectable>(registry_, &entry->family);
+    if (auto entry = gauge_families_.find(name)) return std::shared_ptr<prometheus::Collectable>(registry_, &entry->family);
+    if (auto entry = histogram_families_.find(name)) return std::shared_ptr<prometheus::Collectable>(registry_, &entry->family);
+
+    std::lock_guard<std::mutex> lock(series_families_mutex_);
+    std::shared_ptr<prometheus::Collectable> result;
+    auto find = [&](const auto &families) {
+        if (result) return;
+        auto it = families.find(name);
+        if (it != families.end()) result = it->second;
+    };
+    find(sharded_counter_families_);
+    find(sharded_gauge_families_);
+    find(compact_counter_families_);
+    find(compact_gauge_families_);
+    find(local_histogram_families_);
+    find(layout_histogram_families_);
+    find(exponential_histogram_families_);
+    find(summary_families_);
+    find(callback_gauge_families_);
+    return result;
+}
+
+bool Metrics::serve(const serve_options_t &options)
+{
+    std::vector<scrape_path_t> paths = options.paths;
+    if (paths.empty()) paths.emplace_back();
+    for (const auto &path: paths) {
+        if (path.path.empty() || path.path.front() != '/') {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("Invalid scrape path '%s' (must start with '/')", path.path.c_str()), ERT_FILE_LOCATION);
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(exposer_mutex_);
+
+    std::unique_ptr<Exposer> exposer;
     try {
-        exposer_ = new prometheus::Exposer({endpoint});
+        exposer.reset(new Exposer(options.endpoint, options.threads, options.backlog));
     }
-    catch(...)
+    catch(std::exception &e)
     {
-        ert::tracing::Logger::error("Initialization error (prometheus interface)", ERT_FILE_LOCATION);
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Initialization error (metrics exposer): %s", e.what()), ERT_FILE_LOCATION);
         return false;
     }
 
-    exposer_->RegisterCollectable(registry_);
+    exposer->SetCompression(options.compression);
+    exposer->SetScrapeObserver([this](const std::string&, double seconds, std::size_t bytes) {
+        observeScrape(seconds, bytes);
+    });
+
+    for (const auto &path: paths) {
+        if (path.families.empty() && path.collectables.empty()) {
+            exposer->RegisterCollectable(exposed_registry_, path.path);
+            for (const auto &collectable: collectables_) {
+                exposer->RegisterCollectable(collectable, path.path);
+            }
+            full_paths_.emplace_back(exposer.get(), path.path);
+            continue;
+        }
 
+        if (!path.families.empty()) {
+            path_collectables_.push_back(std::make_shared<AggregatedCollectable>(std::make_shared<FamiliesCollectable>(*this, path.families), aggregator_));
+            exposer->RegisterCollectable(path_collectables_.back(), path.path);
+        }
+        for (const auto &collectable: path.collectables) {
+            path_collectables_.push_back(std::make_shared<AggregatedCollectable>(collectable, aggregator_));
+            exposer->RegisterCollectable(path_collectables_.back(), path.path);
+        }
+    }
+
+    exposers_.push_back(std::move(exposer));
     return true;
 }
 
-counter_family_t& Metrics::addCounterFamily(const std::string &name, const std::string &help, const labels_t &labels)
+void Metrics::registerCollectable(const std::shared_ptr<prometheus::Collectable> &collectable)
 {
-    std::lock_guard<std::mutex> lock(counter_mutex_);
+    std::lock_guard<std::mutex> lock(exposer_mutex_);
 
-    auto fit = counter_families_.find(name);
-    if (fit != counter_families_.end())
-    {
-        ert::tracing::Logger::error(ert::tracing::Logger::asString("counter family %s already registered", name.c_str()), ERT_FILE_LOCATION);
-        return fit->second;
+    collectables_.push_back(std::make_shared<AggregatedCollectable>(collectable, aggregator_));
+    for (const auto &path: full_paths_) {
+        path.first->RegisterCollectable(collectables_.back(), path.second);
     }
+}
 
-    auto& cf = prometheus::BuildCounter().Name(name).Help(help).Labels(labels).Register(*registry_);
-    counter_families_.emplace(name, cf);
+bool Metrics::aggregateFamily(const std::string &familyName, const aggregation_rule_t &rule)
+{
+    return aggregator_->add(familyName, rule);
+}
+
+class Metrics::SelfCollectable : public prometheus::Collectable {
+    const Metrics &metrics_;
+
+public:
+    explicit SelfCollectable(const Metrics &metrics) : metrics_(metrics) {}
+
+    std::vector<prometheus::MetricFamily> Collect() const override {
+        return metrics_.collectSelf();
+    }
+};
+
+void Metrics::enableSelfMetrics(bool enable, std::uint32_t sampling)
+{
+    std::uint32_t period = 1;
+    while (period < sampling && period < (1u << 31)) period <<= 1;
+    self_sampling_mask_.store(period - 1, std::memory_order_relaxed);
+
+    if (enable) {
+        std::lock_guard<std::mutex> lock(self_mutex_);
+        if (!self_collectable_) {
+            scrape_duration_ = std::make_unique<histogram_t>(bucket_boundaries_t{0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5});
+            scrape_size_ = std::make_unique<histogram_t>(bucket_boundaries_t{1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216, 67108864});
+            self_collectable_ = std::make_shared<SelfCollectable>(*this);
+            registerCollectable(self_collectable_);
+        }
+    }
 
-    return cf;
+    self_metrics_.store(enable, std::memory_order_release);
 }
 
-gauge_family_t& Metrics::addGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels)
+void Metrics::observeScrape(double seconds, std::size_t bytes)
+{
+    if (!self_metrics_.load(std::memory_order_acquire)) return;
+
+    scrape_duration_->Observe(seconds);
+    scrape_size_->Observe(double(bytes));
+}
+
+std::vector<prometheus::MetricFamily> Metrics::collectSelf() const
 {
-    std::lock_guard<std::mutex> lock(gauge_mutex_);
+    std::vector<prometheus::MetricFamily> result;
+    if (!self_metrics_.load(std::memory_order_acquire)) return result;
+    result.reserve(6); // families below are referenced while others are added
+
+    auto family = [&result](const char *name, const char *help, prometheus::MetricType type) -> prometheus::MetricFamily& {
+        result.push_back(prometheus::MetricFamily{name, help, type, {}});
+        return result.back();
+    };
+    auto add = [](prometheus::MetricFamily &target, std::initializer_list<std::pair<const char*, std::string>> labels, double value) {
+        prometheus::ClientMetric metric;
+        for (const auto &label: labels) metric.label.push_back(prometheus::ClientMetric::Label{label.first, label.second});
+        if (target.type == prometheus::MetricType::Gauge) metric.gauge.value = value;
+        else metric.counter.value = value;
+        target.metric.push_back(std::move(metric));
+    };
+
+    auto &lockWait = family("ert_metrics_series_lock_wait_seconds_total", "Estimated time acquiring series cache locks (sampled)", prometheus::MetricType::Counter);
+    auto &series = family("ert_metrics_series", "Series per family (resolved through metrics instance for prometheus families)", prometheus::MetricType::Gauge);
+    auto &created = family("ert_metrics_series_created_total", "Series created through metrics instance", prometheus::MetricType::Counter);
+
+    auto entries = [&](const auto &families, const char *kind) {
+        families.forEach([&](const std::string &name, const auto &entry) {
+            std::size_t size;
+            {
+                std::shared_lock<StripedSharedMutex> lock(entry.mutex);
+                size = entry.series.size();
+            }
+            add(lockWait, {{"family", name}, {"kind", kind}}, entry.lock_wait_ns.load(std::memory_order_relaxed) / 1e9);
+            add(series, {{"family", name}, {"kind", kind}}, double(size));
+            add(created, {{"family", name}, {"kind", kind}}, double(entry.series_created.load(std::memory_order_relaxed)));
+        });
+    };
+    entries(counter_families_, kind_names[kindIndex<counter_t>()]);
+    entries(gauge_families_, kind_names[kindIndex<gauge_t>()]);
+    entries(histogram_families_, kind_names[kindIndex<histogram_t>()]);
 
-    auto fit = gauge_families_.find(name);
-    if (fit != gauge_families_.end())
     {
-        ert::tracing::Logger::error(ert::tracing::Logger::asString("gauge family %s already registered", name.c_str()), ERT_FILE_LOCATION);
-        return fit->second;
+        std::lock_guard<std::mutex> lock(series_families_mutex_);
+        auto seriesFamilies = [&](const auto &families, const char *kind) {
+            for (const auto &item: families) add(series, {{"family", item.first}, {"kind", kind}}, double(item.second->size()));
+        };
+        seriesFamilies(sharded_counter_families_, "sharded_counter");
+        seriesFamilies(sharded_gauge_families_, "sharded_gauge");
+        seriesFamilies(compact_counter_families_, "compact_counter");
+        seriesFamilies(compact_gauge_families_, "compact_gauge");
+        seriesFamilies(local_histogram_families_, "local_histogram");
+        seriesFamilies(layout_histogram_families_, "layout_histogram");
+        seriesFamilies(exponential_histogram_families_, "exponential_histogram");
+        seriesFamilies(summary_families_, "summary");
+        seriesFamilies(callback_gauge_families_, "callback_gauge");
+    }
+
+    auto &misses = family("ert_metrics_family_lookup_misses_total", "Updates for families not found", prometheus::MetricType::Counter);
+    for (std::size_t k = 0; k < lookup_misses_.size(); k++) {
+        add(misses, {{"kind", kind_names[k]}}, double(lookup_misses_[k].load(std::memory_order_relaxed)));
     }
 
-    auto& gf = prometheus::BuildGauge().Name(name).Help(help).Labels(labels).Register(*registry_);
-    gauge_families_.emplace(name, gf);
+    family("ert_metrics_scrape_duration_seconds", "Scrape duration (collection, encoding and sending)", prometheus::MetricType::Histogram).metric.push_back(scrape_duration_->Collect());
+    family("ert_metrics_scrape_size_bytes", "Scrape payload size", prometheus::MetricType::Histogram).metric.push_back(scrape_size_->Collect());
 
-    return gf;
+    return result;
+}
+
+counter_family_t& Metrics::addCounterFamily(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    return addFamily(counter_families_, "counter", prometheus::BuildCounter(), name, help, labels);
+}
+
+gauge_family_t& Metrics::addGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    return addFamily(gauge_families_, "gauge", prometheus::BuildGauge(), name, help, labels);
 }
 
 histogram_family_t& Metrics::addHistogramFamily(const std::string &name, const std::string &help, const labels_t &labels)
 {
-    std::lock_guard<std::mutex> lock(histogram_mutex_);
+    return addFamily(histogram_families_, "histogram", prometheus::BuildHistogram(), name, help, labels);
+}
 
-    auto fit = histogram_families_.find(name);
-    if (fit != histogram_families_.end())
-    {
-        ert::tracing::Logger::error(ert::tracing::Logger::asString("histogram family %s already registered", name.c_str()), ERT_FILE_LOCATION);
-        return fit->second;
-    }
+sharded_counter_family_t& Metrics::addShardedCounterFamily(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    return addSeriesFamily(sharded_counter_families_, "sharded counter", name, help, prometheus::MetricType::Counter, labels);
+}
 
-    auto& hf = prometheus::BuildHistogram().Name(name).Help(help).Labels(labels).Register(*registry_);
-    histogram_families_.emplace(name, hf);
+sharded_gauge_family_t& Metrics::addShardedGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    return addSeriesFamily(sharded_gauge_families_, "sharded gauge", name, help, prometheus::MetricType::Gauge, labels);
+}
 
-    return hf;
+compact_counter_family_t& Metrics::addCompactCounterFamily(const std::string &name, const std::string &help, const labels_t &labels, series_storage_t storage)
+{
+    return addSeriesFamily(compact_counter_families_, "compact counter", name, help, prometheus::MetricType::Counter, labels, nullptr, storage);
 }
 
-void Metrics::increaseCounter(const std::string &familyName, const labels_t &labels, double value)
+compact_gauge_family_t& Metrics::addCompactGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels, series_storage_t storage)
 {
-    std::lock_guard<std::mutex> lock(counter_mutex_);
+    return addSeriesFamily(compact_gauge_families_, "compact gauge", name, help, prometheus::MetricType::Gauge, labels, nullptr, storage);
+}
 
-    auto fit = counter_families_.find(familyName);
-    if (fit == counter_families_.end())
-    {
-        ert::tracing::Logger::error(ert::tracing::Logger::asString("counter family %s not found", familyName.c_str()), ERT_FILE_LOCATION);
-        return;
+local_histogram_family_t& Metrics::addLocalHistogramFamily(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    return addSeriesFamily(local_histogram_families_, "thread-local histogram", name, help, prometheus::MetricType::Histogram, labels);
+}
+
+bucket_layout_t Metrics::registerBucketLayout(const std::string &name, const bucket_boundaries_t &boundaries)
+{
+    std::lock_guard<std::mutex> lock(bucket_layouts_mutex_);
+
+    auto it = bucket_layouts_.find(name);
+    if (it != bucket_layouts_.end()) {
+        if (it->second->boundaries() == boundaries) return it->second;
+
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Bucket layout %s already registered with other boundaries", name.c_str()), ERT_FILE_LOCATION);
+        return nullptr;
     }
 
     try {
-        (fit -> second).Add(labels).Increment(value); // negative values are ignored by prometheus-cpp
+        bucket_layout_t layout = std::make_shared<const BucketLayout>(name, boundaries);
+        bucket_layouts_.emplace(name, layout);
+        return layout;
     }
     catch(std::exception &e) {
-        ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Invalid bucket layout %s: %s", name.c_str(), e.what()), ERT_FILE_LOCATION);
     }
+
+    return nullptr;
+}
+
+bucket_layout_t Metrics::bucketLayout(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(bucket_layouts_mutex_);
+
+    auto it = bucket_layouts_.find(name);
+    return (it != bucket_layouts_.end()) ? it->second : nullptr;
+}
+
+layout_histogram_family_t& Metrics::addLayoutHistogramFamily(const std::string &name, const std::string &help, const bucket_layout_t &layout, const labels_t &labels)
+{
+    if (!layout) {
+        throw std::invalid_argument("Missing bucket layout"); // as family builders do on invalid configuration
+    }
+
+    return addSeriesFamily(layout_histogram_families_, "layout histogram", name, help, prometheus::MetricType::Histogram, labels,
+    [layout]() {
+        return std::make_unique<LayoutHistogram>(layout);
+    });
+}
+
+exponential_histogram_family_t& Metrics::addExponentialHistogramFamily(const std::string &name, const std::string &help, const labels_t &labels, const exponential_histogram_config_t &config)
+{
+    ExponentialHistogram validation(config); // throws on invalid configuration, as family builders do
+
+    return addSeriesFamily(exponential_histogram_families_, "exponential histogram", name, help, prometheus::MetricType::Histogram, labels,
+    [config]() {
+        return std::make_unique<ExponentialHistogram>(config);
+    });
+}
+
+summary_family_t& Metrics::addSummaryFamily(const std::string &name, const std::string &help, const labels_t &labels, const summary_config_t &config)
+{
+    SketchSummary validation(config); // throws on invalid configuration, as family builders do
+
+    return addSeriesFamily(summary_families_, "summary", name, help, prometheus::MetricType::Summary, labels,
+    [config]() {
+        return std::make_unique<SketchSummary>(config);
+    });
 }
 
-void Metrics::setGauge(const std::string &familyName, const labels_t &labels, double value)
+callback_gauge_family_t& Metrics::addCallbackGaugeFamily(const std::string &name, const std::string &help, const labels_t &labels, std::chrono::milliseconds cacheTtl)
 {
-    std::lock_guard<std::mutex> lock(gauge_mutex_);
+    return addSeriesFamily(callback_gauge_families_, "callback gauge", name, help, labels, cacheTtl);
+}
 
-    auto fit = gauge_families_.find(familyName);
-    if (fit == gauge_families_.end())
+CallbackGaugeRegistration Metrics::registerGaugeCallback(const std::string &familyName, const labels_t &labels, gauge_callback_t callback)
+{
+    std::shared_ptr<callback_gauge_family_t> family;
     {
-        ert::tracing::Logger::error(ert::tracing::Logger::asString("gauge family %s not found", familyName.c_str()), ERT_FILE_LOCATION);
-        return;
+        std::lock_guard<std::mutex> lock(series_families_mutex_);
+        auto it = callback_gauge_families_.find(familyName);
+        if (it != callback_gauge_families_.end()) family = it->second;
+    }
+
+    if (!family) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("callback gauge family %s not found", familyName.c_str()), ERT_FILE_LOCATION);
+        return CallbackGaugeRegistration();
     }
 
     try {
-        (fit -> second).Add(labels).Set(value);
+        return family->Add(labels, std::move(callback));
     }
     catch(std::exception &e) {
         ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
     }
+
+    return CallbackGaugeRegistration();
+}
+
+template <typename L>
+CounterHandle Metrics::resolveCounter(const std::string &familyName, const L &labels)
+{
+    auto entry = findFamily(counter_families_, familyName, "counter");
+    if (!entry) return CounterHandle();
+
+    return CounterHandle(resolve(*entry, labels));
+}
+
+template <typename L>
+GaugeHandle Metrics::resolveGauge(const std::string &familyName, const L &labels)
+{
+    auto entry = findFamily(gauge_families_, familyName, "gauge");
+    if (!entry) return GaugeHandle();
+
+    return GaugeHandle(resolve(*entry, labels));
+}
+
+template <typename L>
+HistogramHandle Metrics::resolveHistogram(const std::string &familyName, const L &labels, const bucket_boundaries_t &bucketBoundaries)
+{
+    auto entry = findFamily(histogram_families_, familyName, "histogram");
+    if (!entry) return HistogramHandle();
+
+    return HistogramHandle(resolve(*entry, labels, bucketBoundaries));
+}
+
+template <typename L>
+void Metrics::updateCounter(const std::string &familyName, const L &labels, double value)
+{
+    auto entry = findFamily(counter_families_, familyName, "counter");
+    if (!entry) return;
+
+    update(*entry, labels, [value](counter_t &counter) {
+        counter.Increment(value); // negative values are ignored by prometheus-cpp
+    });
+}
+
+template <typename L>
+void Metrics::updateGauge(const std::string &familyName, const L &labels, double value)
+{
+    auto entry = findFamily(gauge_families_, familyName, "gauge");
+    if (!entry) return;
+
+    update(*entry, labels, [value](gauge_t &gauge) {
+        gauge.Set(value);
+    });
+}
+
+template <typename L>
+void Metrics::updateHistogram(const std::string &familyName, const L &labels, double value, const bucket_boundaries_t &bucketBoundaries)
+{
+    auto entry = findFamily(histogram_families_, familyName, "histogram");
+    if (!entry) return;
+
+    update(*entry, labels, [value](histogram_t &histogram) {
+        histogram.Observe(value);
+    }, bucketBoundaries);
+}
+
+template CounterHandle Metrics::resolveCounter(const std::string&, const LabelSet&);
+template CounterHandle Metrics::resolveCounter(const std::string&, const labels_t&);
+template GaugeHandle Metrics::resolveGauge(const std::string&, const LabelSet&);
+template GaugeHandle Metrics::resolveGauge(const std::string&, const labels_t&);
+template HistogramHandle Metrics::resolveHistogram(const std::string&, const LabelSet&, const bucket_boundaries_t&);
+template HistogramHandle Metrics::resolveHistogram(const std::string&, const labels_t&, const bucket_boundaries_t&);
+template void Metrics::updateCounter(const std::string&, const LabelSet&, double);
+template void Metrics::updateCounter(const std::string&, const labels_t&, double);
+template void Metrics::updateGauge(const std::string&, const LabelSet&, double);
+template void Metrics::updateGauge(const std::string&, const labels_t&, double);
+template void Metrics::updateHistogram(const std::string&, const LabelSet&, double, const bucket_boundaries_t&);
+template void Metrics::updateHistogram(const std::string&, const labels_t&, double, const bucket_boundaries_t&);
+
+template <typename T>
+void Metrics::evict(FamilyEntry<T> &entry, std::int64_t now)
+{
+    std::int64_t ttl = entry.ttl_ns.load(std::memory_order_relaxed);
+    if (!ttl) return;
+
+    // Expired series are unlinked under the cache lock, and removed from the family out of it (removals wait
+    // for scrapes in progress):
+    std::lock_guard<std::mutex> removal(entry.removal_mutex);
+    std::vector<T*> expired;
+    {
+        auto lock = lockSeries<std::unique_lock<StripedSharedMutex>>(entry);
+
+        for (auto it = entry.series.begin(); it != entry.series.end();) {
+            if (it->second.pinned.load(std::memory_order_relaxed) || now - it->second.updated.load(std::memory_order_relaxed) < ttl) {
+                it++;
+                continue;
+            }
+
+            expired.push_back(it->second.series);
+            it = entry.series.erase(it);
+        }
+
+        if (expired.empty()) return;
+        entry.removing = true;
+        entry.removals++;
+    }
+
+    for (T *series: expired) {
+        entry.family.Remove(series);
+        if (entry.evicted) entry.evicted->Increment();
+    }
+
+    auto lock = lockSeries<std::unique_lock<StripedSharedMutex>>(entry);
+    entry.removing = false;
+}
+
+bool Metrics::limitFamily(const std::string &familyName, const series_limits_t &limits)
+{
+    std::lock_guard<std::mutex> lock(eviction_mutex_);
+
+    // Exported counters, one series per limited family:
+    auto counter = [this](const std::string &name, const std::string &help) -> counter_family_t& {
+        FamilyEntry<counter_t> *entry = counter_families_.find(name);
+        return entry ? entry->family : addCounterFamily(name, help);
+    };
+    auto configure = [&](auto &entry) {
+        counter_t *dropped = &(counter("ert_metrics_series_dropped_total", "Updates for new series redirected to overflow series (cardinality limit)").Add({{"family", familyName}}));
+        counter_t *evicted = &(counter("ert_metrics_series_evicted_total", "Idle series removed").Add({{"family", familyName}}));
+
+        auto seriesLock = lockSeries<std::unique_lock<StripedSharedMutex>>(entry);
+        entry.max_series = limits.max_series;
+        entry.overflow_labels = limits.overflow_labels;
+        entry.dropped = dropped;
+        entry.evicted = evicted;
+        std::int64_t ttl = std::chrono::duration_cast<std::chrono::nanoseconds>(limits.ttl).count();
+
+        // Updates were not stamped while eviction was disabled: existing series start idle now
+        if (ttl > 0 && !entry.ttl_ns.load(std::memory_order_relaxed)) {
+            std::int64_t now = coarseNow();
+            for (auto &item: entry.series) item.second.updated.store(now, std::memory_order_relaxed);
+        }
+        entry.ttl_ns.store(ttl, std::memory_order_relaxed);
+    };
+
+    if (auto entry = counter_families_.find(familyName)) configure(*entry);
+    else if (auto entry = gauge_families_.find(familyName)) configure(*entry);
+    else if (auto entry = histogram_families_.find(familyName)) configure(*entry);
+    else {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("family %s not found", familyName.c_str()), ERT_FILE_LOCATION);
+        return false;
+    }
+
+    if (limits.ttl.count() > 0 && !eviction_thread_.joinable()) {
+        eviction_stopping_ = false;
+        eviction_thread_ = std::thread(&Metrics::evictionLoop, this);
+    }
+    eviction_cv_.notify_all(); // period may change
+
+    return true;
 }
 
-void Metrics::observeHistogram(const std::string &familyName, const labels_t &labels, double value, const bucket_boundaries_t & bucketBoundaries)
+void Metrics::evictionLoop()
 {
-    std::lock_guard<std::mutex> lock(histogram_mutex_);
+    std::unique_lock<std::mutex> lock(eviction_mutex_);
 
-    auto fit = histogram_families_.find(familyName);
-    if (fit == histogram_families_.end())
+    while (!eviction_stopping_) {
+        // Period: half the shortest time to live (between 100 milliseconds and 10 seconds)
+        std::int64_t shortest = 0;
+        auto minimum = [&shortest](const std::string&, const auto &entry) {
+            std::int64_t ttl = entry.ttl_ns.load(std::memory_order_relaxed);
+            if (ttl && (!shortest || ttl < shortest)) shortest = ttl;
+        };
+        counter_families_.forEach(minimum);
+        gauge_families_.forEach(minimum);
+        histogram_families_.forEach(minimum);
+
+        auto period = std::chrono::nanoseconds(shortest / 2);
+        period = std::min<std::chrono::nanoseconds>(std::max<std::chrono::nanoseconds>(period, std::chrono::milliseconds(100)), std::chrono::seconds(10));
+        if (eviction_cv_.wait_for(lock, period, [this]() { return eviction_stopping_; })) break;
+
+        lock.unlock();
+        std::int64_t now = coarseNow();
+        auto sweep = [this, now](const std::string&, auto &entry) {
+            evict(entry, now);
+        };
+        counter_families_.forEach(sweep);
+        gauge_families_.forEach(sweep);
+        histogram_families_.forEach(sweep);
+        lock.lock();
+    }
+}
+
+void Metrics::stopEviction()
+{
     {
-        ert::tracing::Logger::error(ert::tracing::Logger::asString("histogram family %s not found", familyName.c_str()), ERT_FILE_LOCATION);
+        std::lock_guard<std::mutex> lock(eviction_mutex_);
+        eviction_stopping_ = true;
+    }
+    eviction_cv_.notify_all();
+    if (eviction_thread_.joinable()) eviction_thread_.join();
+}
+
+
+bool Metrics::enableAsync(const async_config_t &config)
+{
+    std::lock_guard<std::mutex> lock(async_mutex_);
+
+    if (async_queue_storage_) {
+        ert::tracing::Logger::error("asynchronous updates already enabled", ERT_FILE_LOCATION);
+        return false;
+    }
+
+    async_config_ = config;
+    if (async_config_.batch == 0) async_config_.batch = 1;
+
+    async_dropped_ = &(addCounterFamily("ert_metrics_async_dropped_total", "Metrics updates dropped because asynchronous queue was full").Add({}));
+    async_queue_storage_ = std::make_unique<BoundedQueue<AsyncRecord>>(async_config_.capacity);
+    async_thread_ = std::thread(&Metrics::asyncLoop, this);
+
+    // Published last, so pushes from other threads see the configuration above:
+    async_queue_.store(async_queue_storage_.get(), std::memory_order_release);
+
+    return true;
+}
+
+async_family_t Metrics::resolveFamily(async_family_t::Kind kind, const std::string &familyName)
+{
+    async_family_t result;
+    result.kind = kind;
+    switch (kind) {
+    case async_family_t::Kind::Counter:
+        result.entry = findFamily(counter_families_, familyName, "counter");
+        break;
+    case async_family_t::Kind::Gauge:
+        result.entry = findFamily(gauge_families_, familyName, "gauge");
+        break;
+    case async_family_t::Kind::Histogram:
+        result.entry = findFamily(histogram_families_, familyName, "histogram");
+        break;
+    }
+    return result;
+}
+
+template <typename F>
+void Metrics::visit(const async_family_t &family, F &&f)
+{
+    switch (family.kind) {
+    case async_family_t::Kind::Counter:
+        f(*static_cast<FamilyEntry<counter_t>*>(family.entry));
+        break;
+    case async_family_t::Kind::Gauge:
+        f(*static_cast<FamilyEntry<gauge_t>*>(family.entry));
+        break;
+    case async_family_t::Kind::Histogram:
+        f(*static_cast<FamilyEntry<histogram_t>*>(family.entry));
+        break;
+    }
+}
+
+namespace {
+
+void applyValue(counter_t &counter, double value) {
+    counter.Increment(value);
+}
+
+void applyValue(gauge_t &gauge, double value) {
+    gauge.Set(value);
+}
+
+void applyValue(histogram_t &histogram, double value) {
+    histogram.Observe(value);
+}
+
+}
+
+async_family_t Metrics::asyncCounterFamily(const std::string &familyName)
+{
+    return resolveFamily(async_family_t::Kind::Counter, familyName);
+}
+
+async_family_t Metrics::asyncGaugeFamily(const std::string &familyName)
+{
+    return resolveFamily(async_family_t::Kind::Gauge, familyName);
+}
+
+async_family_t Metrics::asyncHistogramFamily(const std::string &familyName, const bucket_boundaries_t &bucketBoundaries)
+{
+    async_family_t result = resolveFamily(async_family_t::Kind::Histogram, familyName);
+    if (result.entry) {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_boundaries_.push_back(std::make_unique<bucket_boundaries_t>(bucketBoundaries));
+        result.boundaries = async_boundaries_.back().get();
+    }
+    return result;
+}
+
+void Metrics::apply(AsyncRecord &record)
+{
+    double value = record.value;
+
+    visit(record.family, [this, &record, value](auto &entry) {
+        using series_t = std::remove_pointer_t<decltype(entry.overflow)>;
+        auto applyTo = [this, &entry, &record, value](const auto &labels) {
+            if constexpr (std::is_same<series_t, histogram_t>::value) {
+                update(entry, labels, [value](series_t &series) { applyValue(series, value); }, *record.family.boundaries);
+            }
+            else {
+                update(entry, labels, [value](series_t &series) { applyValue(series, value); });
+            }
+        };
+
+        if (record.owned.empty()) applyTo(record.labels);
+        else applyTo(record.owned);
+    });
+}
+
+bool Metrics::enqueue(AsyncRecord &record)
+{
+    if (!record.family.valid()) return false;
+
+    BoundedQueue<AsyncRecord> *queue = async_queue_.load(std::memory_order_acquire);
+    if (!queue) {
+        apply(record);
+        return true;
+    }
+
+    while (!queue->tryPush(record)) {
+        if (async_config_.overflow == async_config_t::Overflow::Drop || async_stopping_.load(std::memory_order_relaxed)) {
+            async_dropped_->Increment();
+            return false;
+        }
+        std::this_thread::yield();
+    }
+
+    return true;
+}
+
+void Metrics::asyncLoop()
+{
+    AsyncRecord record;
+    auto idle = std::chrono::microseconds(50);
+
+    while (true) {
+        std::size_t applied = 0;
+        while (applied < async_config_.batch && async_queue_storage_->tryPop(record)) {
+            apply(record);
+            applied++;
+        }
+
+        if (applied) {
+            async_applied_.fetch_add(applied, std::memory_order_release);
+            idle = std::chrono::microseconds(50);
+            continue;
+        }
+
+        if (async_stopping_.load()) break;
+
+        std::this_thread::sleep_for(idle);
+        idle = std::min<std::chrono::microseconds>(idle * 2, std::chrono::milliseconds(1));
+    }
+}
+
+void Metrics::flushAsync()
+{
+    BoundedQueue<AsyncRecord> *queue = async_queue_.load(std::memory_order_acquire);
+    if (!queue) return;
+
+    const std::size_t target = queue->pushed();
+    while (async_applied_.load(std::memory_order_acquire) < target) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void Metrics::stopAsync()
+{
+    if (!async_thread_.joinable()) return;
+
+    async_stopping_.store(true);
+    async_thread_.join();
+
+    // Pushes which raced with the stop:
+    AsyncRecord record;
+    while (async_queue_storage_->tryPop(record)) {
+        apply(record);
+        async_applied_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+template <typename T>
+void Metrics::restore(prometheus::Family<T> &family)
+{
+    auto it = restored_.find(family.GetName());
+    if (it == restored_.end()) return;
+
+    const prometheus::MetricType type = std::is_same<T, counter_t>::value ? prometheus::MetricType::Counter : prometheus::MetricType::Histogram;
+    if (it->second.type != type) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Persisted family %s has another type (not restored)", it->first.c_str()), ERT_FILE_LOCATION);
+        restored_.erase(it);
         return;
     }
 
+    // Persisted labels include family labels:
+    const auto constant = family.GetConstantLabels();
+
+    for (auto &series: it->second.series) {
+        for (const auto &label: constant) series.labels.erase(label.first);
+
+        try {
+            if constexpr (std::is_same<T, counter_t>::value) {
+                family.Add(series.labels).Increment(series.value);
+            }
+            else if constexpr (std::is_same<T, histogram_t>::value) {
+                family.Add(series.labels, series.bounds).ObserveMultiple(series.counts, series.sum);
+            }
+        }
+        catch(std::exception &e) {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("Cannot restore series of family %s: %s", it->first.c_str(), e.what()), ERT_FILE_LOCATION);
+        }
+    }
+
+    restored_.erase(it);
+}
+
+bool Metrics::enablePersistence(const std::string &path, std::chrono::milliseconds period)
+{
+    std::lock_guard<std::mutex> lock(persistence_mutex_);
+
+    if (checkpoint_store_) {
+        ert::tracing::Logger::error("Persistence already enabled", ERT_FILE_LOCATION);
+        return false;
+    }
+
     try {
-        (fit -> second).Add(labels, bucketBoundaries).Observe(value);
+        checkpoint_store_ = std::make_unique<CheckpointStore>(path);
     }
-    catch(std::exception &e) {
-        ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
+    catch(std::exception &e)
+    {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Initialization error (metrics persistence): %s", e.what()), ERT_FILE_LOCATION);
+        return false;
+    }
+
+    std::vector<persisted_family_t> families;
+    if (checkpoint_store_->load(families)) {
+        for (auto &family: families) {
+            std::string name = family.name;
+            restored_[name] = std::move(family);
+        }
     }
+
+    // Families already added:
+    counter_families_.forEach([this](const std::string&, const FamilyEntry<counter_t> &entry) {
+        restore(entry.family);
+    });
+    histogram_families_.forEach([this](const std::string&, const FamilyEntry<histogram_t> &entry) {
+        restore(entry.family);
+    });
+
+    if (period.count() > 0) {
+        checkpoint_thread_ = std::thread(&Metrics::checkpointLoop, this, period);
+    }
+
+    return true;
+}
+
+bool Metrics::saveCheckpoint()
+{
+    // Checkpoints are serialized, but families are collected out of the persistence lock, so adding families
+    // (which restores them under that lock) is not delayed by collections:
+    std::lock_guard<std::mutex> checkpointLock(checkpoint_mutex_);
+
+    std::unordered_map<std::string, persisted_family_t> restored;
+    {
+        std::lock_guard<std::mutex> lock(persistence_mutex_);
+        if (!checkpoint_store_) return false;
+        restored = restored_;
+    }
+
+    std::vector<prometheus::MetricFamily> families;
+    auto collect = [&families](const std::string&, const auto &entry) {
+        auto collected = entry.family.Collect();
+        families.insert(families.end(), std::make_move_iterator(collected.begin()), std::make_move_iterator(collected.end()));
+    };
+    counter_families_.forEach(collect);
+    histogram_families_.forEach(collect);
+
+    // Restored families added since the snapshot were collected already:
+    for (const auto &family: families) restored.erase(family.name);
+
+    // Restored families not added yet are kept for next restarts:
+    for (const auto &item: restored) {
+        const persisted_family_t &restoredFamily = item.second;
+        prometheus::MetricFamily family{restoredFamily.name, "", restoredFamily.type, {}};
+        for (const auto &series: restoredFamily.series) {
+            prometheus::ClientMetric metric;
+            for (const auto &label: series.labels) metric.label.push_back(prometheus::ClientMetric::Label{label.first, label.second});
+            metric.counter.value = series.value;
+            double cumulative = 0;
+            for (std::size_t k = 0; k < series.counts.size(); k++) {
+                cumulative += series.counts[k];
+                prometheus::ClientMetric::Bucket bucket;
+                bucket.cumulative_count = std::uint64_t(cumulative);
+                bucket.upper_bound = (k < series.bounds.size()) ? series.bounds[k] : std::numeric_limits<double>::infinity();
+                metric.histogram.bucket.push_back(bucket);
+            }
+            metric.histogram.sample_count = std::uint64_t(cumulative);
+            metric.histogram.sample_sum = series.sum;
+            family.metric.push_back(std::move(metric));
+        }
+        families.push_back(std::move(family));
+    }
+
+    std::lock_guard<std::mutex> lock(persistence_mutex_);
+    return checkpoint_store_->save(families);
+}
+
+bool Metrics::checkpoint()
+{
+    return saveCheckpoint();
 }
 
+void Metrics::checkpointLoop(std::chrono::milliseconds period)
+{
+    std::unique_lock<std::mutex> lock(persistence_mutex_);
 
+    while (!checkpoint_cv_.wait_for(lock, period, [this]() { return checkpoint_stopping_; })) {
+        lock.unlock();
+        saveCheckpoint();
+        lock.lock();
+    }
 }
+
+void Metrics::stopPersistence()
+{
+    {
+        std::lock_guard<std::mutex> lock(persistence_mutex_);
+        if (!checkpoint_store_) return;
+        checkpoint_stopping_ = true;
+    }
+    checkpoint_cv_.notify_all();
+    if (checkpoint_thread_.joinable()) checkpoint_thread_.join();
+
+    // Last values:
+    saveCheckpoint();
 }
 
+void Metrics::Batch::commit()
+{
+    if (updates_.empty()) return;
+
+    // Families are locked in address order, so concurrent commits cannot deadlock:
+    std::vector<const async_family_t*> families;
+    for (const auto &update: updates_) families.push_back(&update.family);
+    auto byEntry = [](const async_family_t *a, const async_family_t *b) { return a->entry < b->entry; };
+    auto sameEntry = [](const async_family_t *a, const async_family_t *b) { return a->entry == b->entry; };
+    std::sort(families.begin(), families.end(), byEntry);
+    families.erase(std::unique(families.begin(), families.end(), sameEntry), families.end());
+
+    std::vector<void*> series(updates_.size(), nullptr);
+    std::vector<char> overflowed(updates_.size(), 0);
+
+    // Larger label sets are not cached (@see Metrics::resolve()), so their series are added out of the locks:
+    for (std::size_t k = 0; k < updates_.size(); k++) {
+        const AsyncRecord &update = updates_[k];
+        if (update.owned.size() <= label_set_capacity) continue;
+
+        visit(update.family, [&series, &update, k](auto &entry) {
+            try {
+                if constexpr (std::is_same<std::decay_t<decltype(entry)>, FamilyEntry<histogram_t>>::value) {
+                    series[k] = &(entry.family.Add(update.owned, *update.family.boundaries));
+                }
+                else {
+                    series[k] = &(entry.family.Add(update.owned));
+                }
+            }
+            catch(std::exception &e) {
+                ert::tracing::Logger::error(e.what(), ERT_FILE_LOCATION);
+            }
+        });
+    }
+
+    // Single pass when every series exists. Otherwise, missing series are created out of the locks and a second
+    // pass applies the batch (series evicted in between are skipped):
+    std::vector<std::size_t> missing;
+    for (int pass = 0; pass < 2; pass++) {
+        {
+            std::vector<std::shared_lock<StripedSharedMutex>> locks;
+            locks.reserve(families.size());
+            for (const async_family_t *family: families) {
+                visit(*family, [this, &locks](auto &entry) {
+                    locks.push_back(metrics_.lockSeries<std::shared_lock<StripedSharedMutex>>(entry));
+                });
+            }
+
+            missing.clear();
+            for (std::size_t k = 0; k < updates_.size(); k++) {
+                const AsyncRecord &update = updates_[k];
+                if (update.owned.size() > label_set_capacity) continue;
+
+                visit(update.family, [this, &series, &overflowed, &missing, &update, k](auto &entry) {
+                    bool flag;
+                    series[k] = metrics_.find(entry, update.owned.empty() ? update.labels : LabelSet::view(update.owned), false, flag);
+                    overflowed[k] = flag;
+                    if (!series[k]) missing.push_back(k);
+                });
+            }
+
+            // Updates are applied in insertion order (i.e. last gauge value set wins):
+            if (missing.empty() || pass == 1) {
+                for (std::size_t k = 0; k < updates_.size(); k++) {
+                    if (!series[k]) continue;
+
+                    visit(updates_[k].family, [&series, &overflowed, this, k](auto &entry) {
+                        using series_t = std::remove_pointer_t<decltype(entry.overflow)>;
+                        if (overflowed[k] && entry.dropped) entry.dropped->Increment();
+                        applyValue(*static_cast<series_t*>(series[k]), updates_[k].value);
+                    });
+                }
+                break;
+            }
+        }
+
+        for (std::size_t k: missing) {
+            const AsyncRecord &update = updates_[k];
+            visit(update.family, [this, &update](auto &entry) {
+                const LabelSet labels = update.owned.empty() ? update.labels : LabelSet::view(update.owned);
+                if constexpr (std::is_same<std::decay_t<decltype(entry)>, FamilyEntry<histogram_t>>::value) {
+                    metrics_.create(entry, labels, false, *update.family.boundaries);
+                }
+                else {
+                    metrics_.create(entry, labels, false);
+                }
+            });
+        }
+    }
+
+    updates_.clear();
+}
+}
+}
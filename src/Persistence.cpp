@@ -0,0 +1,331 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/Persistence.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+constexpr std::uint64_t checkpoint_magic = 0x54504b4354524552ULL; // "RERTCKPT"
+constexpr std::uint32_t checkpoint_version = 1;
+constexpr std::size_t header_size = 64;
+
+struct Header {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t generation;
+    std::uint64_t size; // payload
+    std::uint64_t checksum; // payload
+};
+static_assert(sizeof(Header) <= header_size, "Checkpoint header too large");
+
+// FNV-1a over 64-bit words:
+std::uint64_t checksum(const unsigned char *data, std::size_t size)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    std::size_t k = 0;
+    for (; k + 8 <= size; k += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + k, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; k < size; k++) hash = (hash ^ data[k]) * 0x100000001b3ULL;
+    return hash;
+}
+
+class Writer {
+    std::vector<unsigned char> &buffer_;
+
+public:
+    explicit Writer(std::vector<unsigned char> &buffer) : buffer_(buffer) {}
+
+    template <typename T>
+    void put(T value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&value);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(T));
+    }
+    void put(const std::string &value) {
+        put<std::uint32_t>(value.size());
+        buffer_.insert(buffer_.end(), value.begin(), value.end());
+    }
+};
+
+class Reader {
+    const unsigned char *data_;
+    std::size_t size_;
+    std::size_t offset_{};
+
+public:
+    Reader(const unsigned char *data, std::size_t size) : data_(data), size_(size) {}
+
+    template <typename T>
+    bool get(T &value) {
+        if (size_ - offset_ < sizeof(T)) return false;
+        std::memcpy(&value, data_ + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return true;
+    }
+    bool get(std::string &value) {
+        std::uint32_t length;
+        if (!get(length) || size_ - offset_ < length) return false;
+        value.assign(reinterpret_cast<const char*>(data_ + offset_), length);
+        offset_ += length;
+        return true;
+    }
+    bool done() const {
+        return offset_ == size_;
+    }
+};
+
+bool parse(const unsigned char *data, std::size_t size, std::vector<persisted_family_t> &families)
+{
+    Reader reader(data, size);
+    std::uint32_t familiesCount;
+    if (!reader.get(familiesCount)) return false;
+
+    families.resize(familiesCount);
+    for (auto &family: families) {
+        std::uint8_t type;
+        std::uint32_t seriesCount;
+        if (!reader.get(type) || !reader.get(family.name) || !reader.get(seriesCount)) return false;
+        family.type = static_cast<prometheus::MetricType>(type);
+        if (family.type != prometheus::MetricType::Counter && family.type != prometheus::MetricType::Histogram) return false;
+
+        family.series.resize(seriesCount);
+        for (auto &series: family.series) {
+            std::uint32_t labelsCount;
+            if (!reader.get(labelsCount)) return false;
+            for (std::uint32_t k = 0; k < labelsCount; k++) {
+                std::string name, value;
+                if (!reader.get(name) || !reader.get(value)) return false;
+                series.labels.emplace_hint(series.labels.end(), std::move(name), std::move(value));
+            }
+
+            if (family.type == prometheus::MetricType::Counter) {
+                if (!reader.get(series.value)) return false;
+                continue;
+            }
+
+            std::uint32_t bounds;
+            if (!reader.get(bounds)) return false;
+            series.bounds.resize(bounds);
+            series.counts.resize(bounds + 1);
+            for (auto &bound: series.bounds) if (!reader.get(bound)) return false;
+            for (auto &count: series.counts) if (!reader.get(count)) return false;
+            if (!reader.get(series.sum)) return false;
+        }
+    }
+
+    return reader.done();
+}
+}
+
+CheckpointStore::CheckpointStore(const std::string &path) : path_(path), generation_(0), next_(0)
+{
+    for (std::size_t k = 0; k < 2; k++) {
+        std::string name = path_ + "." + std::to_string(k);
+        files_[k].fd = ::open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (files_[k].fd < 0) {
+            std::string error = std::strerror(errno);
+            if (k) ::close(files_[0].fd);
+            throw std::runtime_error("Cannot open checkpoint file " + name + ": " + error);
+        }
+
+        struct stat st;
+        if (::fstat(files_[k].fd, &st) == 0 && std::size_t(st.st_size) >= header_size) {
+            void *base = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, files_[k].fd, 0);
+            if (base != MAP_FAILED) {
+                files_[k].base = static_cast<unsigned char*>(base);
+                files_[k].size = st.st_size;
+            }
+        }
+    }
+}
+
+CheckpointStore::~CheckpointStore()
+{
+    for (auto &file: files_) {
+        if (file.base) ::munmap(file.base, file.size);
+        if (file.fd >= 0) ::close(file.fd);
+    }
+}
+
+bool CheckpointStore::reserve(File &file, std::size_t size)
+{
+    if (file.size >= size) return true;
+
+    std::size_t capacity = std::max(size + size / 2, std::size_t(4096));
+    if (::ftruncate(file.fd, capacity) != 0) return false;
+
+    if (file.base) ::munmap(file.base, file.size);
+    file.base = nullptr;
+    file.size = 0;
+
+    void *base = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+    if (base == MAP_FAILED) return false;
+
+    file.base = static_cast<unsigned char*>(base);
+    file.size = capacity;
+    return true;
+}
+
+bool CheckpointStore::load(std::vector<persisted_family_t> &families)
+{
+    int latest = -1;
+    std::uint64_t latestGeneration = 0;
+
+    for (int k = 0; k < 2; k++) {
+        const File &file = files_[k];
+        if (!file.base) continue;
+
+        Header header;
+        std::memcpy(&header, file.base, sizeof(header));
+        if (header.magic != checkpoint_magic || header.version != checkpoint_version || header.size > file.size - header_size) continue;
+        if (checksum(file.base + header_size, header.size) != header.checksum) {
+            ert::tracing::Logger::error(ert::tracing::Logger::asString("Corrupted checkpoint %s.%d (ignored)", path_.c_str(), k), ERT_FILE_LOCATION);
+            continue;
+        }
+        if (latest < 0 || header.generation > latestGeneration) {
+            latest = k;
+            latestGeneration = header.generation;
+        }
+    }
+
+    if (latest < 0) return false;
+
+    families.clear();
+    const File &file = files_[latest];
+    Header header;
+    std::memcpy(&header, file.base, sizeof(header));
+    if (!parse(file.base + header_size, header.size, families)) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Invalid checkpoint %s.%d (ignored)", path_.c_str(), latest), ERT_FILE_LOCATION);
+        families.clear();
+        return false;
+    }
+
+    generation_ = latestGeneration;
+    next_ = 1 - latest;
+    return true;
+}
+
+bool CheckpointStore::save(const std::vector<prometheus::MetricFamily> &families)
+{
+    buffer_.clear();
+    Writer writer(buffer_);
+
+    std::uint32_t count = 0;
+    for (const auto &family: families) {
+        if (family.type == prometheus::MetricType::Counter || family.type == prometheus::MetricType::Histogram) count++;
+    }
+    writer.put(count);
+
+    for (const auto &family: families) {
+        if (family.type != prometheus::MetricType::Counter && family.type != prometheus::MetricType::Histogram) continue;
+
+        writer.put(static_cast<std::uint8_t>(family.type));
+        writer.put(family.name);
+        writer.put<std::uint32_t>(family.metric.size());
+
+        for (const auto &metric: family.metric) {
+            writer.put<std::uint32_t>(metric.label.size());
+            for (const auto &label: metric.label) {
+                writer.put(label.name);
+                writer.put(label.value);
+            }
+
+            if (family.type == prometheus::MetricType::Counter) {
+                writer.put(metric.counter.value);
+                continue;
+            }
+
+            const auto &buckets = metric.histogram.bucket;
+            std::uint32_t bounds = buckets.empty() ? 0 : buckets.size() - 1; // last one is '+Inf'
+            writer.put(bounds);
+            for (std::uint32_t k = 0; k < bounds; k++) writer.put(buckets[k].upper_bound);
+            std::uint64_t previous = 0;
+            for (std::uint32_t k = 0; k <= bounds; k++) {
+                std::uint64_t cumulative = (k < buckets.size()) ? buckets[k].cumulative_count : previous;
+                writer.put(double(cumulative - previous));
+                previous = cumulative;
+            }
+            writer.put(metric.histogram.sample_sum);
+        }
+    }
+
+    File &file = files_[next_];
+    if (!reserve(file, header_size + buffer_.size())) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Cannot grow checkpoint file %s.%zu: %s", path_.c_str(), next_, std::strerror(errno)), ERT_FILE_LOCATION);
+        return false;
+    }
+
+    // Invalidate, write payload and sync, then complete header and sync it:
+    Header header{};
+    std::memcpy(file.base, &header, sizeof(header));
+    std::memcpy(file.base + header_size, buffer_.data(), buffer_.size());
+    if (::msync(file.base, header_size + buffer_.size(), MS_SYNC) != 0) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Cannot sync checkpoint file %s.%zu: %s", path_.c_str(), next_, std::strerror(errno)), ERT_FILE_LOCATION);
+        return false;
+    }
+
+    header.magic = checkpoint_magic;
+    header.version = checkpoint_version;
+    header.generation = generation_ + 1;
+    header.size = buffer_.size();
+    header.checksum = checksum(buffer_.data(), buffer_.size());
+    std::memcpy(file.base, &header, sizeof(header));
+    ::msync(file.base, header_size, MS_SYNC);
+
+    generation_++;
+    next_ = 1 - next_;
+    return true;
+}
+
+}
+}
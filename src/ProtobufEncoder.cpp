@@ -0,0 +1,230 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/metrics/ProtobufEncoder.hpp>
+#include <ert/metrics/ExponentialHistogram.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+// Wire types:
+constexpr std::uint32_t varint_type = 0;
+constexpr std::uint32_t fixed64_type = 1;
+constexpr std::uint32_t length_type = 2;
+
+void appendVarint(std::string &out, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void appendTag(std::string &out, std::uint32_t field, std::uint32_t wireType)
+{
+    appendVarint(out, (field << 3) | wireType);
+}
+
+void appendDouble(std::string &out, std::uint32_t field, double value)
+{
+    appendTag(out, field, fixed64_type);
+    char buffer[sizeof(double)];
+    std::memcpy(buffer, &value, sizeof(buffer)); // little endian hosts
+    out.append(buffer, sizeof(buffer));
+}
+
+void appendUnsigned(std::string &out, std::uint32_t field, std::uint64_t value)
+{
+    appendTag(out, field, varint_type);
+    appendVarint(out, value);
+}
+
+// Zigzag encoding (sint32, sint64):
+std::uint64_t zigzag(std::int64_t value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+void appendBytes(std::string &out, std::uint32_t field, const char *data, std::size_t size)
+{
+    appendTag(out, field, length_type);
+    appendVarint(out, size);
+    out.append(data, size);
+}
+
+void appendBytes(std::string &out, std::uint32_t field, const std::string &value)
+{
+    appendBytes(out, field, value.data(), value.size());
+}
+
+// Native histogram fields of io.prometheus.client.Histogram: schema (5), zero threshold (6) and count (7), spans
+// and deltas (9, 10 negative; 12, 13 positive)
+void appendNative(std::string &out, std::string &item, const native_histogram_t &native)
+{
+    appendTag(out, 5, varint_type);
+    appendVarint(out, zigzag(native.schema));
+    appendDouble(out, 6, native.zero_threshold);
+    appendUnsigned(out, 7, native.zero_count);
+
+    auto spans = [&out, &item](std::uint32_t field, const std::vector<native_histogram_t::Span> &values) {
+        for (const auto &span: values) { // BucketSpan
+            item.clear();
+            appendTag(item, 1, varint_type);
+            appendVarint(item, zigzag(span.offset));
+            appendUnsigned(item, 2, span.length);
+            appendBytes(out, field, item);
+        }
+    };
+    auto deltas = [&out, &item](std::uint32_t field, const std::vector<std::int64_t> &values) {
+        if (values.empty()) return;
+        item.clear();
+        for (std::int64_t delta: values) appendVarint(item, zigzag(delta)); // packed
+        appendBytes(out, field, item);
+    };
+
+    spans(9, native.negative_spans);
+    deltas(10, native.negative_deltas);
+    spans(12, native.positive_spans);
+    deltas(13, native.positive_deltas);
+
+    // No populated bucket: empty span, so the histogram is still recognized as native (as reference clients do)
+    if (native.positive_spans.empty() && native.negative_spans.empty()) {
+        spans(12, {{0, 0}});
+    }
+}
+
+// io.prometheus.client.MetricType
+std::uint64_t typeNumber(prometheus::MetricType type)
+{
+    switch (type) {
+    case prometheus::MetricType::Counter:
+        return 0;
+    case prometheus::MetricType::Gauge:
+        return 1;
+    case prometheus::MetricType::Summary:
+        return 2;
+    case prometheus::MetricType::Histogram:
+        return 4;
+    default:
+        return 3; // untyped
+    }
+}
+}
+
+void ProtobufEncoder::encode(const std::vector<prometheus::MetricFamily> &families, std::string &out)
+{
+    const NativeHistogramCapture *capture = NativeHistogramCapture::current();
+
+    for (const auto &family: families) {
+        family_.clear();
+        appendBytes(family_, 1, family.name);
+        appendBytes(family_, 2, family.help);
+        appendUnsigned(family_, 3, typeNumber(family.type));
+
+        for (const auto &metric: family.metric) {
+            metric_.clear();
+            for (const auto &label: metric.label) { // LabelPair
+                field_.clear();
+                appendBytes(field_, 1, label.name);
+                appendBytes(field_, 2, label.value);
+                appendBytes(metric_, 1, field_);
+            }
+
+            field_.clear();
+            switch (family.type) {
+            case prometheus::MetricType::Counter:
+                appendDouble(field_, 1, metric.counter.value);
+                appendBytes(metric_, 3, field_);
+                break;
+            case prometheus::MetricType::Gauge:
+                appendDouble(field_, 1, metric.gauge.value);
+                appendBytes(metric_, 2, field_);
+                break;
+            case prometheus::MetricType::Summary:
+                appendUnsigned(field_, 1, metric.summary.sample_count);
+                appendDouble(field_, 2, metric.summary.sample_sum);
+                for (const auto &quantile: metric.summary.quantile) {
+                    item_.clear();
+                    appendDouble(item_, 1, quantile.quantile);
+                    appendDouble(item_, 2, quantile.value);
+                    appendBytes(field_, 3, item_);
+                }
+                appendBytes(metric_, 4, field_);
+                break;
+            case prometheus::MetricType::Histogram:
+                appendUnsigned(field_, 1, metric.histogram.sample_count);
+                appendDouble(field_, 2, metric.histogram.sample_sum);
+                for (const auto &bucket: metric.histogram.bucket) {
+                    if (std::isinf(bucket.upper_bound) && bucket.upper_bound > 0) continue;
+                    item_.clear();
+                    appendUnsigned(item_, 1, bucket.cumulative_count);
+                    appendDouble(item_, 2, bucket.upper_bound);
+                    appendBytes(field_, 3, item_);
+                }
+                if (capture) {
+                    if (const native_histogram_t *native = capture->find(family.name, metric.label)) appendNative(field_, item_, *native);
+                }
+                appendBytes(metric_, 7, field_);
+                break;
+            default:
+                appendDouble(field_, 1, metric.untyped.value);
+                appendBytes(metric_, 5, field_);
+            }
+
+            if (metric.timestamp_ms) {
+                appendTag(metric_, 6, varint_type);
+                appendVarint(metric_, static_cast<std::uint64_t>(metric.timestamp_ms));
+            }
+
+            appendBytes(family_, 4, metric_);
+        }
+
+        appendVarint(out, family_.size());
+        out += family_;
+    }
+}
+
+}
+}
+
@@ -0,0 +1,80 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/ReadMostly.hpp>
+
+namespace ert
+{
+namespace metrics
+{
+
+StripedSharedMutex::StripedSharedMutex(std::size_t shards)
+{
+    if (shards == 0) shards = defaultShards();
+
+    std::size_t size = 1;
+    while (size < shards) size <<= 1;
+
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+}
+
+void StripedSharedMutex::lock()
+{
+    for (std::size_t k = 0; k <= mask_; k++) {
+        slots_[k].mutex.lock();
+    }
+}
+
+bool StripedSharedMutex::try_lock()
+{
+    for (std::size_t k = 0; k <= mask_; k++) {
+        if (!slots_[k].mutex.try_lock()) {
+            while (k-- > 0) slots_[k].mutex.unlock();
+            return false;
+        }
+    }
+    return true;
+}
+
+void StripedSharedMutex::unlock()
+{
+    for (std::size_t k = mask_ + 1; k-- > 0;) {
+        slots_[k].mutex.unlock();
+    }
+}
+
+}
+}
+
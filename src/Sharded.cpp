@@ -0,0 +1,103 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/Sharded.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+std::atomic<std::size_t> next_shard{0};
+
+std::size_t roundUpPowerOfTwo(std::size_t value)
+{
+    std::size_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+}
+
+std::size_t currentShard()
+{
+    static thread_local const std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed);
+    return shard;
+}
+
+std::size_t defaultShards()
+{
+    static const std::size_t shards = roundUpPowerOfTwo(std::max(1u, std::thread::hardware_concurrency()));
+    return shards;
+}
+
+StripedValue::StripedValue(std::size_t shards)
+{
+    if (shards == 0) shards = defaultShards();
+    shards = roundUpPowerOfTwo(shards);
+
+    slots_.reset(new Slot[shards]);
+    mask_ = shards - 1;
+}
+
+double StripedValue::sum() const
+{
+    double result = 0.0;
+    for (std::size_t k = 0; k <= mask_; k++) {
+        result += slots_[k].value.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+prometheus::ClientMetric ShardedCounter::Collect() const
+{
+    prometheus::ClientMetric metric;
+    metric.counter.value = Value();
+    return metric;
+}
+
+prometheus::ClientMetric ShardedGauge::Collect() const
+{
+    prometheus::ClientMetric metric;
+    metric.gauge.value = Value();
+    return metric;
+}
+
+}
+}
+
@@ -0,0 +1,534 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/tracing/Logger.hpp>
+
+#include <ert/metrics/SharedSegment.hpp>
+
+#include <prometheus/check_names.h>
+#include <prometheus/client_metric.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+constexpr std::uint64_t segment_magic = 0x31474553545245ULL; // "ERTSEG1"
+constexpr std::uint32_t segment_version = 1;
+constexpr std::uint32_t no_slot = std::numeric_limits<std::uint32_t>::max();
+constexpr std::uint64_t no_row = 0xffff;
+constexpr std::size_t max_processes = 0xfffe;
+
+enum : std::uint32_t { slot_free = 0, slot_writing, slot_ready };
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Shared segment cells need lock-free 64-bit atomics");
+static_assert(std::atomic<std::int32_t>::is_always_lock_free, "Shared segment process table needs lock-free 32-bit atomics");
+static_assert(sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t), "Unexpected atomic layout");
+
+// Incremented on children after fork, so they claim their own row:
+std::atomic<std::uint64_t> fork_generation{1};
+std::once_flag atfork_once;
+
+void onForkChild()
+{
+    fork_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::size_t align(std::size_t value, std::size_t alignment = 64)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool alive(std::int32_t pid)
+{
+    return pid > 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+}
+
+std::uint64_t toBits(double value)
+{
+    std::uint64_t result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+double toDouble(std::uint64_t bits)
+{
+    double result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void addDouble(std::atomic<std::uint64_t> &cell, double value)
+{
+    std::uint64_t current = cell.load(std::memory_order_relaxed);
+    while (!cell.compare_exchange_weak(current, toBits(toDouble(current) + value), std::memory_order_relaxed)) {}
+}
+}
+
+struct SharedSegment::Header {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t processes;
+    std::uint32_t slots;
+    std::uint32_t max_buckets;
+    std::atomic<std::uint32_t> used; // slots allocated (may exceed 'slots' when full)
+};
+
+struct SharedSegment::Descriptor {
+    std::atomic<std::uint32_t> state;
+    Kind kind;
+    std::uint8_t merge;
+    std::uint16_t buckets;
+    std::uint16_t labels_size;
+    char name[128];
+    char help[256];
+    char labels[512]; // sorted 'name\0value\0' pairs
+};
+
+SharedSegment::SharedSegment(const std::string &path, const shared_segment_config_t &config, bool create)
+    : path_(path), fd_(-1), base_(nullptr), size_(0), row_state_(0)
+{
+    map(create, config);
+}
+
+SharedSegment::~SharedSegment()
+{
+    if (base_) ::munmap(base_, size_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void SharedSegment::map(bool create, const shared_segment_config_t &config)
+{
+    fd_ = ::open(path_.c_str(), create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0600);
+    if (fd_ < 0) {
+        throw std::runtime_error("Cannot open shared segment " + path_ + ": " + std::strerror(errno));
+    }
+
+    Header header{};
+    if (create) {
+        if (config.processes == 0 || config.processes > max_processes || config.slots == 0 || config.slots >= no_slot || config.max_buckets > std::numeric_limits<std::uint16_t>::max() - 1) {
+            throw std::runtime_error("Invalid shared segment layout");
+        }
+        header.processes = config.processes;
+        header.slots = config.slots;
+        header.max_buckets = config.max_buckets;
+    }
+    else if (::pread(fd_, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != segment_magic || header.version != segment_version) {
+        throw std::runtime_error("Invalid shared segment " + path_);
+    }
+
+    processes_ = header.processes;
+    slots_ = header.slots;
+    max_buckets_ = header.max_buckets;
+    row_cells_ = align((max_buckets_ + 2) * slots_, 64 / sizeof(std::uint64_t));
+
+    std::size_t pidsOffset = align(sizeof(Header));
+    std::size_t descriptorsOffset = align(pidsOffset + processes_ * sizeof(std::int32_t));
+    std::size_t boundsOffset = align(descriptorsOffset + slots_ * sizeof(Descriptor));
+    std::size_t cellsOffset = align(boundsOffset + slots_ * max_buckets_ * sizeof(double));
+    size_ = cellsOffset + processes_ * row_cells_ * sizeof(std::uint64_t);
+
+    if (create) {
+        if (::ftruncate(fd_, size_) != 0) {
+            throw std::runtime_error("Cannot size shared segment " + path_ + ": " + std::strerror(errno));
+        }
+    }
+    else {
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || std::size_t(st.st_size) < size_) {
+            throw std::runtime_error("Truncated shared segment " + path_);
+        }
+    }
+
+    void *base = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("Cannot map shared segment " + path_ + ": " + std::strerror(errno));
+    }
+    base_ = static_cast<unsigned char*>(base);
+
+    header_ = reinterpret_cast<Header*>(base_);
+    pids_ = reinterpret_cast<std::atomic<std::int32_t>*>(base_ + pidsOffset);
+    descriptors_ = reinterpret_cast<Descriptor*>(base_ + descriptorsOffset);
+    bounds_ = reinterpret_cast<double*>(base_ + boundsOffset);
+    cells_ = reinterpret_cast<std::atomic<std::uint64_t>*>(base_ + cellsOffset);
+
+    if (create) {
+        // Zero-filled by truncation: magic is written last, so openers never see a partial header
+        header_->version = segment_version;
+        header_->processes = header.processes;
+        header_->slots = header.slots;
+        header_->max_buckets = header.max_buckets;
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = segment_magic;
+    }
+}
+
+std::size_t SharedSegment::claimRow()
+{
+    std::call_once(atfork_once, []() {
+        ::pthread_atfork(nullptr, nullptr, onForkChild);
+    });
+
+    std::uint64_t generation = fork_generation.load(std::memory_order_relaxed);
+    std::uint64_t state = row_state_.load(std::memory_order_acquire);
+    if ((state >> 16) == generation) {
+        std::uint64_t row = state & 0xffff;
+        return (row == no_row) ? std::string::npos : row - 1;
+    }
+
+    std::int32_t pid = ::getpid();
+    std::size_t row = std::string::npos;
+    bool claimed = false; // taken now (not already owned by this process)
+
+    // Own row (same process mapping the segment twice), free row, or row of a finished process:
+    for (std::size_t r = 0; r < processes_ && row == std::string::npos; r++) {
+        if (pids_[r].load(std::memory_order_acquire) == pid) row = r;
+    }
+    for (std::size_t r = 0; r < processes_ && row == std::string::npos; r++) {
+        std::int32_t expected = 0;
+        if (pids_[r].compare_exchange_strong(expected, pid)) row = r;
+        claimed = (row != std::string::npos);
+    }
+    for (std::size_t r = 0; r < processes_ && row == std::string::npos; r++) {
+        std::int32_t expected = pids_[r].load(std::memory_order_acquire);
+        if (alive(expected) || !pids_[r].compare_exchange_strong(expected, pid)) continue;
+        row = r;
+        claimed = true;
+
+        // Gauges of the finished process are not inherited (counters and histograms keep accumulating):
+        std::size_t used = size();
+        for (std::size_t slot = 0; slot < used; slot++) {
+            if (descriptors_[slot].state.load(std::memory_order_acquire) == slot_ready && descriptors_[slot].kind == Kind::Gauge) {
+                cells_[r * row_cells_ + slot * (max_buckets_ + 2)].store(toBits(0.0), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::uint64_t desired = (generation << 16) | (row == std::string::npos ? no_row : row + 1);
+    if (!row_state_.compare_exchange_strong(state, desired, std::memory_order_acq_rel)) {
+        // Another thread of this process claimed first: give back our row unless it is the same one
+        if (claimed && (state & 0xffff) != row + 1) pids_[row].store(0, std::memory_order_release);
+        return claimRow();
+    }
+
+    if (row == std::string::npos) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("No free process row in shared segment %s (%zu processes): updates from pid %d are dropped", path_.c_str(), processes_, pid), ERT_FILE_LOCATION);
+    }
+
+    return row;
+}
+
+std::atomic<std::uint64_t> *SharedSegment::cells(std::uint32_t slot)
+{
+    std::uint64_t state = row_state_.load(std::memory_order_acquire);
+    std::size_t row;
+    if ((state >> 16) == fork_generation.load(std::memory_order_relaxed)) {
+        state &= 0xffff;
+        if (state == no_row) return nullptr;
+        row = state - 1;
+    }
+    else {
+        row = claimRow();
+        if (row == std::string::npos) return nullptr;
+    }
+
+    return cells_ + row * row_cells_ + slot * (max_buckets_ + 2);
+}
+
+std::uint32_t SharedSegment::registerSeries(Kind kind, gauge_merge_t merge, const std::string &name, const std::string &help, const labels_t &labels, const bucket_boundaries_t &bounds)
+{
+    if (!prometheus::CheckMetricName(name)) {
+        throw std::invalid_argument("Invalid metric name");
+    }
+
+    std::string serialized;
+    for (const auto &label: labels) {
+        if (!prometheus::CheckLabelName(label.first)) {
+            throw std::invalid_argument("Invalid label name");
+        }
+        serialized.append(label.first).push_back('\0');
+        serialized.append(label.second).push_back('\0');
+    }
+
+    Descriptor *descriptor = nullptr;
+    if (name.size() >= sizeof(descriptor->name) || serialized.size() > sizeof(descriptor->labels)) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Series %s too long for shared segment", name.c_str()), ERT_FILE_LOCATION);
+        return no_slot;
+    }
+    if (bounds.size() > max_buckets_ || !std::is_sorted(bounds.begin(), bounds.end())) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Invalid bucket boundaries for %s (sorted, up to %zu)", name.c_str(), max_buckets_), ERT_FILE_LOCATION);
+        return no_slot;
+    }
+
+    // Existing series:
+    std::size_t used = std::min<std::size_t>(header_->used.load(std::memory_order_acquire), slots_);
+    for (std::size_t slot = 0; slot < used; slot++) {
+        const Descriptor &d = descriptors_[slot];
+        if (d.state.load(std::memory_order_acquire) != slot_ready) continue;
+        if (d.kind == kind && name == d.name && d.labels_size == serialized.size() && std::memcmp(d.labels, serialized.data(), serialized.size()) == 0) {
+            return slot;
+        }
+    }
+
+    // New slot (a concurrent registration from another process may duplicate it: merged on scrape):
+    std::uint32_t slot = header_->used.fetch_add(1, std::memory_order_acq_rel);
+    if (slot >= slots_) {
+        ert::tracing::Logger::error(ert::tracing::Logger::asString("Shared segment %s is full (%zu series): %s not registered", path_.c_str(), slots_, name.c_str()), ERT_FILE_LOCATION);
+        return no_slot;
+    }
+
+    descriptor = &descriptors_[slot];
+    descriptor->state.store(slot_writing, std::memory_order_relaxed);
+    descriptor->kind = kind;
+    descriptor->merge = static_cast<std::uint8_t>(merge);
+    descriptor->buckets = bounds.size();
+    descriptor->labels_size = serialized.size();
+    std::memcpy(descriptor->name, name.c_str(), name.size() + 1);
+    std::size_t helpSize = std::min(help.size(), sizeof(descriptor->help) - 1);
+    std::memcpy(descriptor->help, help.data(), helpSize);
+    descriptor->help[helpSize] = '\0';
+    std::memcpy(descriptor->labels, serialized.data(), serialized.size());
+    std::copy(bounds.begin(), bounds.end(), bounds_ + slot * max_buckets_);
+    descriptor->state.store(slot_ready, std::memory_order_release);
+
+    return slot;
+}
+
+SharedCounter SharedSegment::counter(const std::string &name, const std::string &help, const labels_t &labels)
+{
+    std::uint32_t slot = registerSeries(Kind::Counter, gauge_merge_t::Sum, name, help, labels, {});
+    return (slot == no_slot) ? SharedCounter() : SharedCounter(this, slot);
+}
+
+SharedGauge SharedSegment::gauge(const std::string &name, const std::string &help, const labels_t &labels, gauge_merge_t merge)
+{
+    std::uint32_t slot = registerSeries(Kind::Gauge, merge, name, help, labels, {});
+    return (slot == no_slot) ? SharedGauge() : SharedGauge(this, slot);
+}
+
+SharedHistogram SharedSegment::histogram(const std::string &name, const std::string &help, const labels_t &labels, const bucket_boundaries_t &bucketBoundaries)
+{
+    std::uint32_t slot = registerSeries(Kind::Histogram, gauge_merge_t::Sum, name, help, labels, bucketBoundaries);
+    return (slot == no_slot) ? SharedHistogram() : SharedHistogram(this, slot);
+}
+
+std::size_t SharedSegment::size() const
+{
+    return std::min<std::size_t>(header_->used.load(std::memory_order_acquire), slots_);
+}
+
+std::vector<prometheus::MetricFamily> SharedSegment::Collect() const
+{
+    std::vector<std::int32_t> pids(processes_);
+    std::vector<bool> live(processes_);
+    for (std::size_t r = 0; r < processes_; r++) {
+        pids[r] = pids_[r].load(std::memory_order_acquire);
+        live[r] = alive(pids[r]);
+    }
+
+    // Series merged by name and labels (duplicated slots included):
+    struct Aggregate {
+        std::size_t family;
+        prometheus::ClientMetric metric;
+        bool present{};
+    };
+    std::vector<prometheus::MetricFamily> result;
+    std::map<std::string, std::size_t> families;
+    std::map<std::string, Aggregate> series;
+    std::vector<std::string> order;
+
+    std::size_t used = size();
+    for (std::size_t slot = 0; slot < used; slot++) {
+        const Descriptor &d = descriptors_[slot];
+        if (d.state.load(std::memory_order_acquire) != slot_ready) continue;
+
+        prometheus::MetricType type = (d.kind == Kind::Counter) ? prometheus::MetricType::Counter :
+                                      (d.kind == Kind::Gauge) ? prometheus::MetricType::Gauge : prometheus::MetricType::Histogram;
+
+        auto fit = families.find(d.name);
+        if (fit == families.end()) {
+            fit = families.emplace(d.name, result.size()).first;
+            result.push_back(prometheus::MetricFamily{d.name, d.help, type, {}});
+        }
+        else if (result[fit->second].type != type) {
+            continue; // same name registered with another type
+        }
+
+        std::vector<prometheus::ClientMetric::Label> labels;
+        for (std::size_t k = 0; k < d.labels_size;) {
+            prometheus::ClientMetric::Label label;
+            label.name = d.labels + k;
+            k += label.name.size() + 1;
+            label.value = d.labels + k;
+            k += label.value.size() + 1;
+            labels.push_back(std::move(label));
+        }
+        std::string key(d.name);
+        key.push_back('\0');
+        key.append(d.labels, d.labels_size);
+
+        auto aggregate = [&](const std::string &seriesKey, const std::vector<prometheus::ClientMetric::Label> &seriesLabels) -> Aggregate& {
+            auto it = series.find(seriesKey);
+            if (it == series.end()) {
+                it = series.emplace(seriesKey, Aggregate{fit->second, {}, false}).first;
+                it->second.metric.label = seriesLabels;
+                order.push_back(seriesKey);
+            }
+            return it->second;
+        };
+
+        const std::atomic<std::uint64_t> *column = cells_ + slot * (max_buckets_ + 2);
+
+        if (d.kind == Kind::Counter) {
+            Aggregate &a = aggregate(key, labels);
+            a.present = true;
+            for (std::size_t r = 0; r < processes_; r++) {
+                a.metric.counter.value += toDouble(column[r * row_cells_].load(std::memory_order_relaxed));
+            }
+        }
+        else if (d.kind == Kind::Histogram) {
+            Aggregate &a = aggregate(key, labels);
+            auto &buckets = a.metric.histogram.bucket;
+            if (!a.present) {
+                buckets.resize(d.buckets + 1);
+                for (std::size_t b = 0; b <= d.buckets; b++) {
+                    buckets[b].upper_bound = (b == d.buckets) ? std::numeric_limits<double>::infinity() : bounds_[slot * max_buckets_ + b];
+                }
+                a.present = true;
+            }
+            else if (buckets.size() != std::size_t(d.buckets) + 1) {
+                continue;
+            }
+            for (std::size_t r = 0; r < processes_; r++) {
+                const std::atomic<std::uint64_t> *cells = column + r * row_cells_;
+                for (std::size_t b = 0; b <= d.buckets; b++) buckets[b].cumulative_count += cells[b].load(std::memory_order_relaxed);
+                a.metric.histogram.sample_sum += toDouble(cells[max_buckets_ + 1].load(std::memory_order_relaxed));
+            }
+        }
+        else {
+            gauge_merge_t merge = static_cast<gauge_merge_t>(d.merge);
+            for (std::size_t r = 0; r < processes_; r++) {
+                if (!live[r]) continue;
+                double value = toDouble(column[r * row_cells_].load(std::memory_order_relaxed));
+
+                if (merge == gauge_merge_t::PerPid) {
+                    auto pidLabels = labels;
+                    pidLabels.push_back(prometheus::ClientMetric::Label{"pid", std::to_string(pids[r])});
+                    Aggregate &a = aggregate(key + '\0' + std::to_string(pids[r]), pidLabels);
+                    a.metric.gauge.value += value;
+                    a.present = true;
+                    continue;
+                }
+
+                Aggregate &a = aggregate(key, labels);
+                if (merge == gauge_merge_t::Max && a.present) a.metric.gauge.value = std::max(a.metric.gauge.value, value);
+                else a.metric.gauge.value += value;
+                a.present = true;
+            }
+        }
+    }
+
+    for (const auto &seriesKey: order) {
+        Aggregate &a = series[seriesKey];
+        if (!a.present) continue;
+
+        auto &histogram = a.metric.histogram;
+        std::uint64_t cumulative = 0;
+        for (auto &bucket: histogram.bucket) {
+            cumulative += bucket.cumulative_count;
+            bucket.cumulative_count = cumulative;
+        }
+        histogram.sample_count = cumulative;
+
+        result[a.family].metric.push_back(std::move(a.metric));
+    }
+
+    result.erase(std::remove_if(result.begin(), result.end(), [](const prometheus::MetricFamily &family) {
+        return family.metric.empty();
+    }), result.end());
+
+    return result;
+}
+
+void SharedCounter::Increment(double value) const
+{
+    if (!segment_ || value < 0) return;
+    if (auto cells = segment_->cells(slot_)) addDouble(cells[0], value);
+}
+
+void SharedGauge::Set(double value) const
+{
+    if (!segment_) return;
+    if (auto cells = segment_->cells(slot_)) cells[0].store(toBits(value), std::memory_order_relaxed);
+}
+
+void SharedGauge::Increment(double value) const
+{
+    if (!segment_) return;
+    if (auto cells = segment_->cells(slot_)) addDouble(cells[0], value);
+}
+
+void SharedGauge::Decrement(double value) const
+{
+    Increment(-value);
+}
+
+void SharedHistogram::Observe(double value) const
+{
+    if (!segment_) return;
+    auto cells = segment_->cells(slot_);
+    if (!cells) return;
+
+    const double *bounds = segment_->bounds_ + slot_ * segment_->max_buckets_;
+    std::size_t bucket = std::lower_bound(bounds, bounds + segment_->descriptors_[slot_].buckets, value) - bounds;
+    cells[bucket].fetch_add(1, std::memory_order_relaxed);
+    addDouble(cells[segment_->max_buckets_ + 1], value);
+}
+
+}
+}
@@ -0,0 +1,81 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/metrics/SlabPool.hpp>
+#include <ert/metrics/Sharded.hpp>
+
+#include <algorithm>
+#include <new>
+
+namespace ert
+{
+namespace metrics
+{
+
+void SlabPool::Free::operator()(unsigned char *slab) const
+{
+    ::operator delete[](slab, std::align_val_t(cache_line_size));
+}
+
+SlabPool::SlabPool(std::size_t size, std::size_t alignment, bool padded)
+{
+    alignment = std::max<std::size_t>(1, std::min(alignment, cache_line_size));
+    const std::size_t unit = padded ? cache_line_size : alignment;
+
+    slot_size_ = std::max<std::size_t>(unit, (size + unit - 1) / unit * unit);
+    slots_per_slab_ = std::max<std::size_t>(1, slab_size / slot_size_);
+    used_ = slots_per_slab_; // no slab yet
+}
+
+void *SlabPool::allocate()
+{
+    if (!free_.empty()) {
+        void *result = free_.back();
+        free_.pop_back();
+        return result;
+    }
+
+    if (used_ == slots_per_slab_) {
+        unsigned char *slab = static_cast<unsigned char*>(::operator new[](slots_per_slab_ * slot_size_, std::align_val_t(cache_line_size)));
+        slabs_.emplace_back(slab);
+        used_ = 0;
+    }
+
+    return slabs_.back().get() + (used_++) * slot_size_;
+}
+
+}
+}
+
@@ -0,0 +1,265 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/Summary.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace ert
+{
+namespace metrics
+{
+
+void DDSketch::Store::add(std::int32_t key, std::uint64_t n)
+{
+    const std::int32_t size = static_cast<std::int32_t>(bins.size());
+
+    if (count == 0) {
+        offset = key - size / 2;
+    }
+
+    count += n;
+
+    if (key < offset) { // collapse into lowest bin
+        bins[0] += n;
+        return;
+    }
+
+    if (key >= offset + size) { // shift window up, collapsing lowest bins
+        const std::int32_t shift = key - (offset + size - 1);
+        if (shift >= size) {
+            std::uint64_t total = 0;
+            for (auto bin: bins) total += bin;
+            std::fill(bins.begin(), bins.end(), 0);
+            bins[0] = total;
+        }
+        else {
+            std::uint64_t collapsed = 0;
+            for (std::int32_t k = 0; k <= shift; k++) collapsed += bins[k];
+            std::move(bins.begin() + shift + 1, bins.end(), bins.begin() + 1);
+            std::fill(bins.end() - shift, bins.end(), 0);
+            bins[0] = collapsed;
+        }
+        offset += shift;
+    }
+
+    bins[key - offset] += n;
+}
+
+void DDSketch::Store::clear()
+{
+    std::fill(bins.begin(), bins.end(), 0);
+    offset = 0;
+    count = 0;
+}
+
+DDSketch::DDSketch(double relativeAccuracy, std::size_t maxBins)
+{
+    if (!(relativeAccuracy > 0.0 && relativeAccuracy < 1.0)) {
+        throw std::invalid_argument("Sketch relative accuracy must be within (0, 1)");
+    }
+    if (maxBins == 0) {
+        throw std::invalid_argument("Sketch bins must be positive");
+    }
+
+    gamma_ = (1.0 + relativeAccuracy) / (1.0 - relativeAccuracy);
+    log_gamma_ = std::log(gamma_);
+    min_indexable_ = DBL_MIN * gamma_;
+
+    positive_.bins.assign(maxBins, 0);
+    negative_.bins.assign(maxBins, 0);
+}
+
+std::int32_t DDSketch::key(double value) const
+{
+    return static_cast<std::int32_t>(std::ceil(std::log(value) / log_gamma_));
+}
+
+double DDSketch::value(std::int32_t key) const
+{
+    return 2.0 * std::pow(gamma_, key) / (1.0 + gamma_);
+}
+
+void DDSketch::add(double value)
+{
+    if (value > min_indexable_) {
+        positive_.add(key(std::min(value, DBL_MAX)), 1);
+    }
+    else if (value < -min_indexable_) {
+        negative_.add(key(std::min(-value, DBL_MAX)), 1);
+    }
+    else if (!std::isnan(value)) {
+        zero_count_++;
+    }
+}
+
+void DDSketch::merge(const DDSketch &other)
+{
+    if (other.gamma_ != gamma_ || other.positive_.bins.size() != positive_.bins.size()) {
+        throw std::invalid_argument("Sketches to merge must have the same accuracy and bins");
+    }
+
+    for (auto store: { std::make_pair(&positive_, &other.positive_), std::make_pair(&negative_, &other.negative_) }) {
+        if (store.second->count == 0) continue;
+        const auto &bins = store.second->bins;
+        for (std::size_t k = 0; k < bins.size(); k++) {
+            if (bins[k]) store.first->add(store.second->offset + static_cast<std::int32_t>(k), bins[k]);
+        }
+    }
+    zero_count_ += other.zero_count_;
+}
+
+void DDSketch::clear()
+{
+    positive_.clear();
+    negative_.clear();
+    zero_count_ = 0;
+}
+
+double DDSketch::quantile(double q) const
+{
+    const std::uint64_t total = count();
+    if (total == 0 || q < 0.0 || q > 1.0) return std::numeric_limits<double>::quiet_NaN();
+
+    const double rank = q * (total - 1);
+    std::uint64_t cumulative = 0;
+
+    // Negative values, from the most negative (highest key):
+    if (negative_.count) {
+        for (std::size_t k = negative_.bins.size(); k-- > 0;) {
+            cumulative += negative_.bins[k];
+            if (cumulative > rank) return -value(negative_.offset + static_cast<std::int32_t>(k));
+        }
+    }
+
+    cumulative += zero_count_;
+    if (cumulative > rank) return 0.0;
+
+    for (std::size_t k = 0; k < positive_.bins.size(); k++) {
+        cumulative += positive_.bins[k];
+        if (cumulative > rank) return value(positive_.offset + static_cast<std::int32_t>(k));
+    }
+
+    return value(positive_.offset + static_cast<std::int32_t>(positive_.bins.size()) - 1);
+}
+
+SketchSummary::SketchSummary(const summary_config_t &config)
+    : config_(config), merged_(config.relative_accuracy, config.max_bins)
+{
+    if (config_.age_buckets == 0 || config_.window.count() <= 0) {
+        throw std::invalid_argument("Summary window and age buckets must be positive");
+    }
+    for (auto q: config_.quantiles) {
+        if (q < 0.0 || q > 1.0) throw std::invalid_argument("Summary quantiles must be within [0, 1]");
+    }
+
+    slice_ms_ = std::max<std::int64_t>(1, config_.window.count() / config_.age_buckets);
+    slices_.assign(config_.age_buckets, merged_);
+    epoch_ = nowMs() / slice_ms_;
+}
+
+std::int64_t SketchSummary::nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SketchSummary::rotate(std::int64_t epoch) const
+{
+    if (epoch <= epoch_) return;
+
+    const std::int64_t expired = std::min<std::int64_t>(epoch - epoch_, slices_.size());
+    for (std::int64_t k = 1; k <= expired; k++) {
+        slices_[(epoch_ + k) % slices_.size()].clear();
+    }
+    epoch_ = epoch;
+}
+
+void SketchSummary::Observe(double value)
+{
+    if (std::isnan(value)) return;
+
+    const std::int64_t epoch = nowMs() / slice_ms_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    rotate(epoch);
+    slices_[epoch_ % slices_.size()].add(value);
+    count_++;
+    sum_ += value;
+}
+
+double SketchSummary::quantile(double q) const
+{
+    const std::int64_t epoch = nowMs() / slice_ms_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    rotate(epoch);
+    merged_.clear();
+    for (const auto &slice: slices_) merged_.merge(slice);
+
+    return merged_.quantile(q);
+}
+
+prometheus::ClientMetric SketchSummary::Collect() const
+{
+    const std::int64_t epoch = nowMs() / slice_ms_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    rotate(epoch);
+    merged_.clear();
+    for (const auto &slice: slices_) merged_.merge(slice);
+
+    prometheus::ClientMetric metric;
+    metric.summary.sample_count = count_;
+    metric.summary.sample_sum = sum_;
+    metric.summary.quantile.reserve(config_.quantiles.size());
+    for (auto q: config_.quantiles) {
+        prometheus::ClientMetric::Quantile quantile;
+        quantile.quantile = q;
+        quantile.value = merged_.quantile(q);
+        metric.summary.quantile.push_back(quantile);
+    }
+
+    return metric;
+}
+
+}
+}
+
@@ -0,0 +1,439 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/TextEncoder.hpp>
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+inline std::uint64_t mix(std::uint64_t seed, std::uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    return seed;
+}
+
+inline std::uint64_t bits(double value)
+{
+    std::uint64_t result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+std::uint64_t labelsHash(const std::vector<prometheus::ClientMetric::Label> &labels)
+{
+    std::hash<std::string_view> hasher;
+    std::uint64_t seed = labels.size();
+    for (const auto &label: labels) {
+        seed = mix(seed, hasher(label.name));
+        seed = mix(seed, hasher(label.value));
+    }
+    return seed;
+}
+
+void appendEscaped(std::string &out, const std::string &value, bool quotes)
+{
+    for (char c: value) {
+        switch (c) {
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '"':
+            if (quotes) out += "\\\"";
+            else out += c;
+            break;
+        default:
+            out += c;
+        }
+    }
+}
+
+bool endsWith(const std::string &value, const char *suffix)
+{
+    const std::size_t length = std::strlen(suffix);
+    return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+}
+
+const char *typeName(prometheus::MetricType type, bool openMetrics)
+{
+    switch (type) {
+    case prometheus::MetricType::Counter:
+        return "counter";
+    case prometheus::MetricType::Gauge:
+        return "gauge";
+    case prometheus::MetricType::Summary:
+        return "summary";
+    case prometheus::MetricType::Histogram:
+        return "histogram";
+    default:
+        return openMetrics ? "unknown" : "untyped";
+    }
+}
+
+/** Line prefix: name + suffix + {labels[,extra]} + space */
+std::string linePrefix(const std::string &name, const char *suffix, const std::vector<prometheus::ClientMetric::Label> &labels, const char *extraName = nullptr, double extraValue = 0.0)
+{
+    std::string result(name);
+    result += suffix;
+
+    if (!labels.empty() || extraName) {
+        result += '{';
+        const char *separator = "";
+        for (const auto &label: labels) {
+            result += separator;
+            result += label.name;
+            result += "=\"";
+            appendEscaped(result, label.value, true);
+            result += '"';
+            separator = ",";
+        }
+        if (extraName) {
+            result += separator;
+            result += extraName;
+            result += "=\"";
+            TextEncoder::appendValue(result, extraValue);
+            result += '"';
+        }
+        result += '}';
+    }
+
+    result += ' ';
+    return result;
+}
+
+void appendUnsigned(std::string &out, std::uint64_t value)
+{
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr - buffer);
+}
+
+/** Timestamp: milliseconds (text format) or seconds (OpenMetrics), preceded by space. Zero means none */
+void appendTimestamp(std::string &out, std::int64_t timestamp, bool seconds)
+{
+    if (!timestamp) return;
+
+    out += ' ';
+    if (seconds) {
+        TextEncoder::appendValue(out, timestamp / 1000.0);
+        return;
+    }
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), timestamp);
+    out.append(buffer, result.ptr - buffer);
+}
+
+void appendLine(std::string &out, const std::string &prefix, double value, std::int64_t timestamp, bool seconds)
+{
+    out += prefix;
+    TextEncoder::appendValue(out, value);
+    appendTimestamp(out, timestamp, seconds);
+    out += '\n';
+}
+
+void appendLine(std::string &out, const std::string &prefix, std::uint64_t value, std::int64_t timestamp, bool seconds)
+{
+    out += prefix;
+    appendUnsigned(out, value);
+    appendTimestamp(out, timestamp, seconds);
+    out += '\n';
+}
+
+/** Fingerprint of series values (and bounds) */
+std::uint64_t valuesHash(prometheus::MetricType type, const prometheus::ClientMetric &metric)
+{
+    std::uint64_t seed = static_cast<std::uint64_t>(metric.timestamp_ms);
+    switch (type) {
+    case prometheus::MetricType::Counter:
+        return mix(seed, bits(metric.counter.value));
+    case prometheus::MetricType::Gauge:
+        return mix(seed, bits(metric.gauge.value));
+    case prometheus::MetricType::Summary:
+        seed = mix(seed, metric.summary.sample_count);
+        seed = mix(seed, bits(metric.summary.sample_sum));
+        for (const auto &quantile: metric.summary.quantile) {
+            seed = mix(seed, bits(quantile.quantile));
+            seed = mix(seed, bits(quantile.value));
+        }
+        return seed;
+    case prometheus::MetricType::Histogram:
+        seed = mix(seed, metric.histogram.sample_count);
+        seed = mix(seed, bits(metric.histogram.sample_sum));
+        for (const auto &bucket: metric.histogram.bucket) {
+            seed = mix(seed, bits(bucket.upper_bound));
+            seed = mix(seed, bucket.cumulative_count);
+        }
+        return seed;
+    default:
+        return mix(seed, bits(metric.untyped.value));
+    }
+}
+}
+
+void TextEncoder::appendValue(std::string &out, double value)
+{
+    if (std::isnan(value)) {
+        out += "NaN";
+    }
+    else if (std::isinf(value)) {
+        out += (value > 0) ? "+Inf" : "-Inf";
+    }
+    else {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr - buffer);
+    }
+}
+
+const TextEncoder::SeriesEntry &TextEncoder::seriesEntry(FamilyState &state, const prometheus::MetricFamily &family, const prometheus::ClientMetric &metric, std::uint64_t labelsHash)
+{
+    // Bounds which determine the lines:
+    std::vector<double> bounds;
+    if (family.type == prometheus::MetricType::Histogram) {
+        bounds.reserve(metric.histogram.bucket.size());
+        for (const auto &bucket: metric.histogram.bucket) bounds.push_back(bucket.upper_bound);
+    }
+    else if (family.type == prometheus::MetricType::Summary) {
+        bounds.reserve(metric.summary.quantile.size());
+        for (const auto &quantile: metric.summary.quantile) bounds.push_back(quantile.quantile);
+    }
+
+    // Linear probing on hash collisions (different labels with the same hash):
+    std::uint64_t key = labelsHash;
+    auto it = state.series.find(key);
+    while (it != state.series.end() && it->second.labels != metric.label) {
+        it = state.series.find(++key);
+    }
+
+    if (it != state.series.end() && std::equal(it->second.bounds.begin(), it->second.bounds.end(), bounds.begin(), bounds.end(),
+    [](double a, double b) {
+    return bits(a) == bits(b);
+    })) {
+        it->second.generation = generation_;
+        return it->second;
+    }
+
+    if (it == state.series.end()) {
+        it = state.series.emplace(key, SeriesEntry()).first;
+        cached_series_++;
+    }
+
+    SeriesEntry &entry = it->second;
+    entry.labels = metric.label;
+    entry.bounds = std::move(bounds);
+    entry.generation = generation_;
+    entry.lines.clear();
+
+    switch (family.type) {
+    case prometheus::MetricType::Summary:
+        for (double quantile: entry.bounds) entry.lines.push_back(linePrefix(family.name, "", metric.label, "quantile", quantile));
+        entry.lines.push_back(linePrefix(family.name, "_sum", metric.label));
+        entry.lines.push_back(linePrefix(family.name, "_count", metric.label));
+        break;
+    case prometheus::MetricType::Histogram:
+        for (double bound: entry.bounds) entry.lines.push_back(linePrefix(family.name, "_bucket", metric.label, "le", bound));
+        entry.lines.push_back(linePrefix(family.name, "_sum", metric.label));
+        entry.lines.push_back(linePrefix(family.name, "_count", metric.label));
+        break;
+    case prometheus::MetricType::Counter: // OpenMetrics counter samples end with '_total'
+        entry.lines.push_back(linePrefix(family.name, (format_ == Format::OpenMetrics && !endsWith(family.name, "_total")) ? "_total" : "", metric.label));
+        break;
+    default:
+        entry.lines.push_back(linePrefix(family.name, "", metric.label));
+    }
+
+    return entry;
+}
+
+void TextEncoder::render(FamilyState &state, const prometheus::MetricFamily &family, const std::vector<std::uint64_t> &labelsHashes)
+{
+    std::string &out = state.block;
+    out.clear();
+
+    for (std::size_t k = 0; k < family.metric.size(); k++) {
+        const auto &metric = family.metric[k];
+        const SeriesEntry &entry = seriesEntry(state, family, metric, labelsHashes[k]);
+        const std::int64_t timestamp = metric.timestamp_ms;
+        const bool seconds = (format_ == Format::OpenMetrics);
+
+        switch (family.type) {
+        case prometheus::MetricType::Counter:
+            appendLine(out, entry.lines[0], metric.counter.value, timestamp, seconds);
+            break;
+        case prometheus::MetricType::Gauge:
+            appendLine(out, entry.lines[0], metric.gauge.value, timestamp, seconds);
+            break;
+        case prometheus::MetricType::Summary: {
+            const auto &quantiles = metric.summary.quantile;
+            for (std::size_t q = 0; q < quantiles.size(); q++) appendLine(out, entry.lines[q], quantiles[q].value, timestamp, seconds);
+            appendLine(out, entry.lines[quantiles.size()], metric.summary.sample_sum, timestamp, seconds);
+            appendLine(out, entry.lines[quantiles.size() + 1], metric.summary.sample_count, timestamp, seconds);
+            break;
+        }
+        case prometheus::MetricType::Histogram: {
+            const auto &buckets = metric.histogram.bucket;
+            for (std::size_t b = 0; b < buckets.size(); b++) appendLine(out, entry.lines[b], buckets[b].cumulative_count, timestamp, seconds);
+            appendLine(out, entry.lines[buckets.size()], metric.histogram.sample_sum, timestamp, seconds);
+            appendLine(out, entry.lines[buckets.size() + 1], metric.histogram.sample_count, timestamp, seconds);
+            break;
+        }
+        default:
+            appendLine(out, entry.lines[0], metric.untyped.value, timestamp, seconds);
+        }
+    }
+}
+
+const char *TextEncoder::contentType() const
+{
+    return (format_ == Format::OpenMetrics) ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "text/plain; version=0.0.4; charset=utf-8";
+}
+
+void TextEncoder::prepare(FamilyState &state, const prometheus::MetricFamily &family, std::vector<std::uint64_t> &labelsHashes)
+{
+    if (state.header.empty() || state.help != family.help || state.type != family.type) {
+        const bool openMetrics = (format_ == Format::OpenMetrics);
+
+        // OpenMetrics counter metadata goes without '_total' suffix:
+        std::string name = family.name;
+        if (openMetrics && family.type == prometheus::MetricType::Counter && endsWith(name, "_total")) name.resize(name.size() - 6);
+
+        state.help = family.help;
+        state.type = family.type;
+        state.header = "# HELP " + name + " ";
+        appendEscaped(state.header, family.help, openMetrics);
+        state.header += "\n# TYPE " + name + " " + typeName(family.type, openMetrics) + "\n";
+        state.block.clear();
+    }
+
+    labelsHashes.clear();
+    std::uint64_t fingerprint = family.metric.size();
+    for (const auto &metric: family.metric) {
+        labelsHashes.push_back(labelsHash(metric.label));
+        fingerprint = mix(fingerprint, labelsHashes.back());
+        fingerprint = mix(fingerprint, valuesHash(family.type, metric));
+    }
+
+    if (state.generation == 0 || fingerprint != state.fingerprint || state.block.empty()) {
+        render(state, family, labelsHashes);
+        state.fingerprint = fingerprint;
+    }
+    else { // unchanged: keep series entries alive
+        for (auto &series: state.series) series.second.generation = generation_;
+    }
+    state.generation = generation_;
+
+    pieces_.push_back(state.header);
+    pieces_.push_back(state.block);
+}
+
+const std::vector<std::string_view> &TextEncoder::prepare(const std::vector<prometheus::MetricFamily> &families)
+{
+    generation_++;
+    pieces_.clear();
+    for (const auto &duplicate: duplicates_) cached_series_ -= duplicate.series.size();
+    duplicates_.clear();
+
+    std::vector<std::uint64_t> labelsHashes;
+    std::size_t alive = 0;
+
+    for (const auto &family: families) {
+        FamilyState &state = families_[family.name];
+
+        // Pieces already taken from the family state must stay valid:
+        if (state.generation == generation_) {
+            duplicates_.emplace_back();
+            prepare(duplicates_.back(), family, labelsHashes);
+        }
+        else {
+            prepare(state, family, labelsHashes);
+        }
+        alive += family.metric.size();
+    }
+
+    if (format_ == Format::OpenMetrics) pieces_.push_back("# EOF\n");
+
+    sweep(alive);
+    return pieces_;
+}
+
+void TextEncoder::encode(const std::vector<prometheus::MetricFamily> &families, std::string &out)
+{
+    for (std::string_view piece: prepare(families)) out.append(piece.data(), piece.size());
+}
+
+void TextEncoder::sweep(std::size_t alive)
+{
+    if (cached_series_ <= 2 * alive + 1024) return;
+
+    for (auto fit = families_.begin(); fit != families_.end();) {
+        if (fit->second.generation != generation_) {
+            cached_series_ -= fit->second.series.size();
+            fit = families_.erase(fit);
+            continue;
+        }
+        auto &series = fit->second.series;
+        for (auto sit = series.begin(); sit != series.end();) {
+            if (sit->second.generation != generation_) {
+                sit = series.erase(sit);
+                cached_series_--;
+            }
+            else {
+                sit++;
+            }
+        }
+        fit++;
+    }
+}
+
+void TextEncoder::clear()
+{
+    families_.clear();
+    cached_series_ = 0;
+}
+
+}
+}
+
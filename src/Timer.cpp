@@ -0,0 +1,106 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+#include <ert/metrics/Timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace ert
+{
+namespace metrics
+{
+
+namespace
+{
+// Invariant TSC: constant rate on every power state (CPUID.80000007H:EDX[8])
+bool invariantTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) return false;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+}
+
+TimerClock::TimerClock() : source_(Source::Coarse), seconds_per_tick_(1e-9)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (!invariantTsc()) return;
+
+    // Calibration against the monotonic clock (5 milliseconds):
+    auto begin = std::chrono::steady_clock::now();
+    std::uint64_t ticks = __rdtsc();
+    std::chrono::steady_clock::time_point end;
+    do {
+        end = std::chrono::steady_clock::now();
+    } while (end - begin < std::chrono::milliseconds(5));
+    ticks = __rdtsc() - ticks;
+
+    if (ticks == 0) return;
+
+    source_ = Source::Tsc;
+    seconds_per_tick_ = std::chrono::duration<double>(end - begin).count() / ticks;
+#endif
+}
+
+std::uint32_t Timer::seed()
+{
+    std::size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id()) ^ std::size_t(TimerClock::now());
+    std::uint32_t result = std::uint32_t(hash ^ (hash >> 32));
+    return result ? result : 0x9e3779b9; // xorshift state must not be zero
+}
+
+Timer::Timer(HistogramHandle histogram, std::uint32_t sampling) : histogram_(histogram)
+{
+    std::uint32_t size = 1;
+    while (size < sampling) size <<= 1;
+    mask_ = size - 1;
+
+    TimerClock::source(); // calibration out of the measurements
+}
+
+}
+}
+
@@ -0,0 +1,268 @@
+/*
+ _____________________________________________________________
+|             _                         _        _            |
+|            | |                       | |      (_)           |
+|    ___ _ __| |_   __   _ __ ___   ___| |_ _ __ _  ___ ___   |  Metrics wrapper library C++
+|   / _ \ '__| __| |__| | '_ ` _ \ / _ \ __| '__| |/ __/ __|  |  Version 1.0.z
+|  |  __/ |  | |_       | | | | | |  __/ |_| |  | | (__\__ \  |  https://github.com/testillano/metrics
+|   \___|_|   \__|      |_| |_| |_|\___|\__|_|  |_|\___|___/  |
+|_____________________________________________________________|
+
+Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+SPDX-License-Identifier: MIT
+Copyright (c) 2021 Eduardo Ramos
+
+Permission is hereby  granted, free of charge, to any  person obtaining a copy
+of this software and associated  documentation files (the "Software"), to deal
+in the Software  without restriction, including without  limitation the rights
+to  use, copy,  modify, merge,  publish, distribute,  sublicense, and/or  sell
+copies  of  the Software,  and  to  permit persons  to  whom  the Software  is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE  IS PROVIDED "AS  IS", WITHOUT WARRANTY  OF ANY KIND,  EXPRESS OR
+IMPLIED,  INCLUDING BUT  NOT  LIMITED TO  THE  WARRANTIES OF  MERCHANTABILITY,
+FITNESS FOR  A PARTICULAR PURPOSE AND  NONINFRINGEMENT. IN NO EVENT  SHALL THE
+AUTHORS  OR COPYRIGHT  HOLDERS  BE  LIABLE FOR  ANY  CLAIM,  DAMAGES OR  OTHER
+LIABILITY, WHETHER IN AN ACTION OF  CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE  OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <ert/metrics/WindowedView.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ert
+{
+namespace metrics
+{
+
+WindowedSeries::WindowedSeries(const WindowedView &view, counter_t *counter, histogram_t *histogram)
+    : view_(view), counter_(counter), histogram_(histogram), width_(1)
+{
+    if (histogram_) {
+        // Boundaries of the existing series (not the ones requested):
+        for (const auto &bucket: histogram_->Collect().histogram.bucket) {
+            if (!std::isinf(bucket.upper_bound)) bounds_.push_back(bucket.upper_bound);
+        }
+        width_ = bounds_.size() + 1;
+    }
+
+    deltas_ = std::make_unique<std::atomic<double>[]>(view_.slots_ * width_);
+    last_.assign(width_, 0.0);
+    current_.assign(width_, 0.0);
+    read(last_);
+}
+
+void WindowedSeries::read(std::vector<double> &values) const
+{
+    if (counter_) {
+        values[0] = counter_->Value();
+        return;
+    }
+
+    prometheus::ClientMetric metric = histogram_->Collect();
+    double previous = 0;
+    for (std::size_t k = 0; k < width_; k++) {
+        double cumulative = (k < metric.histogram.bucket.size()) ? double(metric.histogram.bucket[k].cumulative_count) : previous;
+        values[k] = cumulative - previous;
+        previous = cumulative;
+    }
+}
+
+void WindowedSeries::sample(std::size_t slot)
+{
+    read(current_);
+    for (std::size_t k = 0; k < width_; k++) {
+        deltas_[slot * width_ + k].store(current_[k] - last_[k], std::memory_order_relaxed);
+    }
+    last_.swap(current_);
+}
+
+double WindowedSeries::increase(std::chrono::milliseconds window) const
+{
+    std::uint64_t ticks;
+    std::size_t slots = view_.window(window, ticks);
+
+    double result = 0;
+    for (std::size_t k = 0; k < slots; k++) {
+        std::size_t slot = (ticks - 1 - k) % view_.slots_;
+        for (std::size_t b = 0; b < width_; b++) result += deltas_[slot * width_ + b].load(std::memory_order_relaxed);
+    }
+
+    return result;
+}
+
+double WindowedSeries::rate(std::chrono::milliseconds window) const
+{
+    std::uint64_t ticks;
+    std::size_t slots = view_.window(window, ticks);
+
+    double increase = 0, seconds = 0;
+    for (std::size_t k = 0; k < slots; k++) {
+        std::size_t slot = (ticks - 1 - k) % view_.slots_;
+        seconds += view_.durations_[slot].load(std::memory_order_relaxed);
+        for (std::size_t b = 0; b < width_; b++) increase += deltas_[slot * width_ + b].load(std::memory_order_relaxed);
+    }
+
+    return (seconds > 0) ? increase / seconds : 0.0;
+}
+
+double WindowedSeries::quantile(double quantile, std::chrono::milliseconds window) const
+{
+    if (!histogram_) return std::numeric_limits<double>::quiet_NaN();
+
+    std::uint64_t ticks;
+    std::size_t slots = view_.window(window, ticks);
+
+    // Bucket counts within the window are summed on the fly (no allocation): total first, then bucket by bucket
+    auto bucketCount = [&](std::size_t b) {
+        double count = 0;
+        for (std::size_t k = 0; k < slots; k++) count += deltas_[((ticks - 1 - k) % view_.slots_) * width_ + b].load(std::memory_order_relaxed);
+        return count;
+    };
+
+    double total = 0;
+    for (std::size_t b = 0; b < width_; b++) total += bucketCount(b);
+    if (total <= 0) return std::numeric_limits<double>::quiet_NaN();
+
+    double rank = std::min(std::max(quantile, 0.0), 1.0) * total;
+    double cumulative = 0;
+    for (std::size_t b = 0; b < width_; b++) {
+        double count = bucketCount(b);
+        if (cumulative + count < rank || count <= 0) {
+            cumulative += count;
+            continue;
+        }
+
+        if (b == bounds_.size()) return bounds_.empty() ? std::numeric_limits<double>::quiet_NaN() : bounds_.back(); // '+Inf' bucket
+        double upper = bounds_[b];
+        double lower = (b == 0) ? std::min(0.0, upper) : bounds_[b - 1];
+        return lower + (upper - lower) * (rank - cumulative) / count;
+    }
+
+    return bounds_.empty() ? std::numeric_limits<double>::quiet_NaN() : bounds_.back();
+}
+
+WindowedView::WindowedView(Metrics &metrics, std::chrono::milliseconds interval, std::size_t slots)
+    : metrics_(metrics), interval_(std::max(interval, std::chrono::milliseconds(1))), slots_(std::max<std::size_t>(slots, 2)), ticks_(0), stopping_(false)
+{
+    durations_ = std::make_unique<std::atomic<double>[]>(slots_);
+    ticker_ = std::thread(&WindowedView::loop, this);
+}
+
+WindowedView::~WindowedView()
+{
+    {
+        std::lock_guard<std::mutex> lock(ticker_mutex_);
+        stopping_ = true;
+    }
+    ticker_cv_.notify_all();
+    ticker_.join();
+}
+
+void WindowedView::loop()
+{
+    std::unique_lock<std::mutex> lock(ticker_mutex_);
+
+    auto last = std::chrono::steady_clock::now();
+    auto next = last + interval_;
+
+    while (!ticker_cv_.wait_until(lock, next, [this]() { return stopping_; })) {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        lock.unlock();
+        tick(seconds);
+        lock.lock();
+
+        next += interval_;
+        if (next <= now) next = now + interval_; // ticks missed (overloaded): slot covers the actual duration
+    }
+}
+
+void WindowedView::tick(double seconds)
+{
+    std::uint64_t ticks = ticks_.load(std::memory_order_relaxed);
+    std::size_t slot = ticks % slots_;
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto &family: series_) {
+            for (const auto &series: family.second) series.second->sample(slot);
+        }
+    }
+
+    durations_[slot].store(seconds, std::memory_order_relaxed);
+    ticks_.store(ticks + 1, std::memory_order_release);
+}
+
+std::size_t WindowedView::window(std::chrono::milliseconds window, std::uint64_t &ticks) const
+{
+    ticks = ticks_.load(std::memory_order_acquire);
+
+    auto intervals = (std::chrono::duration_cast<std::chrono::steady_clock::duration>(window) + interval_ - std::chrono::steady_clock::duration(1)) / interval_;
+    std::uint64_t result = std::max<std::int64_t>(intervals, 1);
+
+    // Slot being written by the ticker is never read:
+    return std::min<std::uint64_t>({result, slots_ - 1, ticks});
+}
+
+const WindowedSeries *WindowedView::watch(const std::string &familyName, const labels_t &labels, counter_t *counter, histogram_t *histogram)
+{
+    if (!counter && !histogram) return nullptr;
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    auto &family = series_[familyName];
+    auto it = family.find(labels);
+    if (it == family.end()) {
+        it = family.emplace(labels, std::unique_ptr<WindowedSeries>(new WindowedSeries(*this, counter, histogram))).first;
+    }
+
+    return it->second.get();
+}
+
+const WindowedSeries *WindowedView::watchCounter(const std::string &familyName, const labels_t &labels)
+{
+    return watch(familyName, labels, metrics_.counterHandle(familyName, labels).get(), nullptr);
+}
+
+const WindowedSeries *WindowedView::watchHistogram(const std::string &familyName, const labels_t &labels, const bucket_boundaries_t &bucketBoundaries)
+{
+    return watch(familyName, labels, nullptr, metrics_.histogramHandle(familyName, labels, bucketBoundaries).get());
+}
+
+double WindowedView::rate(const std::string &familyName, const labels_t &labels, std::chrono::milliseconds window) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    auto family = series_.find(familyName);
+    if (family == series_.end()) return std::numeric_limits<double>::quiet_NaN();
+    auto it = family->second.find(labels);
+    if (it == family->second.end()) return std::numeric_limits<double>::quiet_NaN();
+
+    return it->second->rate(window);
+}
+
+double WindowedView::quantile(const std::string &familyName, const labels_t &labels, double quantile, std::chrono::milliseconds window) const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    auto family = series_.find(familyName);
+    if (family == series_.end()) return std::numeric_limits<double>::quiet_NaN();
+    auto it = family->second.find(labels);
+    if (it == family->second.end()) return std::numeric_limits<double>::quiet_NaN();
+
+    return it->second->quantile(quantile, window);
+}
+
+}
+}